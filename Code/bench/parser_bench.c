@@ -0,0 +1,274 @@
+/**
+ * @file parser_bench.c
+ * @brief Micro-benchmark for the parsing side of the shell: parser(), expandParsed() on globs and
+ * expandAlias(), run in-process over generated corpora so that no fork or exec shows up in the numbers.
+ * Built and run with `make bench` (use BUILD_DEFAULT=release for meaningful timings). Allocations are
+ * counted by wrapping malloc and friends at link time, see BENCH_WRAP_FLAGS in the Makefile.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#define _GNU_SOURCE // mkdtemp()
+
+#include "shell.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define MIN_BENCH_NS 200000000LL // every case runs for at least 0.2s
+#define NUM_OF_LINES 64          // lines per corpus, varied so branch predictors can't learn one line
+
+// ---- STRUCTS ----
+
+struct Corpus
+{
+    const char *name;
+    char *lines[NUM_OF_LINES];
+    size_t bytes;           // total length of all lines
+};
+
+// ---- GLOBAL VARIABLES ----
+
+static uint64_t allocations = 0;        // calls to malloc / calloc / realloc / strdup / strndup made by the shell code
+static struct Words parsed = {NULL};
+
+// ---- ALLOCATION COUNTING ----
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *str);
+char *__real_strndup(const char *str, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *str)
+{
+    allocations++;
+    return __real_strdup(str);
+}
+
+char *__wrap_strndup(const char *str, size_t size)
+{
+    allocations++;
+    return __real_strndup(str, size);
+}
+
+// ---- FUNCTION DECLARATIONS ----
+
+static int64_t now(); //monotonic clock in nanoseconds
+static char *generate(const char *prefix, const char *piece, int count, const char *separator, int variant); //builds prefix piece sep piece ...
+static void buildCorpora(struct Corpus *corpora); //generates the synthetic inputs
+static void runParserRaw(char *line); //parser() keeping quotes, as inputHandler() sees a command
+static void runParserUnquote(char *line); //parser() dropping quotes
+static void runAlias(char *line); //parser() + expandAlias(), the alias step of inputHandler()
+static void runWildcards(char *line); //parser() + expandParsed(), which globs, in a directory of generated files
+static void bench(const char *function, struct Corpus *corpus, void (*run)(char *line)); //times run() over a corpus and prints a row
+
+int main()
+{
+    struct Corpus corpora[6];
+    char directory[] = "/tmp/parser_bench.XXXXXX";
+
+    if (mkdtemp(directory) == NULL || chdir(directory) != 0)
+
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    for (int i = 0; i < 256; i++) // something for the glob patterns to match
+
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "file%03d.%s", i, (i % 3 == 0) ? "c" : (i % 3 == 1) ? "h" : "txt");
+        close(open(name, O_CREAT | O_WRONLY, 0644));
+    }
+
+    for (int i = 0; i < 100; i++)
+
+    {
+        char name[32], value[64];
+        snprintf(name, sizeof(name), "a%d", i);
+        snprintf(value, sizeof(value), "ls -la --color=never dir%d", i);
+        addAlias(name, value);
+    }
+
+    buildCorpora(corpora);
+
+    printf("%-18s %-14s %10s %10s %12s %12s\n", "function", "corpus", "bytes/line", "ns/byte", "ns/line", "allocs/line");
+
+    bench("parser(raw)", &corpora[0], runParserRaw);
+    bench("parser(raw)", &corpora[1], runParserRaw);
+    bench("parser(raw)", &corpora[2], runParserRaw);
+    bench("parser(unquote)", &corpora[0], runParserUnquote);
+    bench("parser(unquote)", &corpora[1], runParserUnquote);
+    bench("parser(raw)", &corpora[5], runParserRaw);
+    bench("expandAlias", &corpora[3], runAlias);
+    bench("expandParsed", &corpora[4], runWildcards);
+
+    for (int i = 0; i < 256; i++)
+
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "file%03d.%s", i, (i % 3 == 0) ? "c" : (i % 3 == 1) ? "h" : "txt");
+        unlink(name);
+    }
+
+    if (chdir("/") == 0)
+
+    {
+        rmdir(directory);
+    }
+
+    return 0;
+}
+
+static int64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static char *generate(const char *prefix, const char *piece, int count, const char *separator, int variant)
+{
+    struct Buffer buf = {NULL, 0, 0};
+    char number[16];
+
+    bufferAppend(&buf, prefix, strlen(prefix));
+
+    for (int i = 0; i < count; i++)
+
+    {
+        bufferAppend(&buf, separator, strlen(separator));
+        bufferAppend(&buf, piece, strlen(piece));
+        snprintf(number, sizeof(number), "%d", (i * 7 + variant) % 1000); // keeps the words distinct
+        bufferAppend(&buf, number, strlen(number));
+    }
+
+    return buf.data;
+}
+
+static void buildCorpora(struct Corpus *corpora)
+{
+    static const char *quoted[] = {
+        "\"double quoted $HOME words\"", "'single quoted \"inner\" words'", "esc\\ aped\\ spaces",
+        "mixed\"quo ted\"'parts here'", "\"$(echo \"nested $(echo deep)\")\"", "`echo back tick`"
+    };
+
+    corpora[0].name = "long-argv";
+    corpora[1].name = "deep-quoting";
+    corpora[2].name = "pipeline-1000";
+    corpora[3].name = "alias-heavy";
+    corpora[4].name = "wildcards";
+    corpora[5].name = "arg-max";
+
+    for (int i = 0; i < NUM_OF_LINES; i++)
+
+    {
+        corpora[0].lines[i] = generate("cmd", "argument-", 490, " ", i); // what used to be the 499 word limit of parsed arrays
+        corpora[5].lines[i] = generate("cmd", "/usr/share/some/path/component-", 16000, " ", i); // about half a megabyte, find | xargs territory
+
+        struct Buffer line = {NULL, 0, 0};
+        bufferAppend(&line, "printf", 6);
+
+        for (int j = 0; j < 120; j++)
+
+        {
+            const char *word = quoted[(i + j) % 6];
+            bufferAppend(&line, " ", 1);
+            bufferAppend(&line, word, strlen(word));
+        }
+
+        corpora[1].lines[i] = line.data;
+        corpora[2].lines[i] = generate("cat", "grep -v x", 999, " | ", i);
+
+        char prefix[16];
+        snprintf(prefix, sizeof(prefix), "a%d", (i * 13) % 100);
+        corpora[3].lines[i] = generate(prefix, "-opt", 20, " ", i);
+
+        corpora[4].lines[i] = strdup((i % 2) ? "ls *.c file0?.h *.txt plain words" : "cat file1*.txt *.h nomatch*.zz");
+    }
+
+    for (int c = 0; c < 6; c++)
+
+    {
+        corpora[c].bytes = 0;
+
+        for (int i = 0; i < NUM_OF_LINES; i++)
+
+        {
+            corpora[c].bytes += strlen(corpora[c].lines[i]);
+        }
+    }
+}
+
+static void runParserRaw(char *line)
+{
+    parser(line, &parsed, false);
+}
+
+static void runParserUnquote(char *line)
+{
+    parser(line, &parsed, true);
+}
+
+static void runAlias(char *line)
+{
+    parser(line, &parsed, false);
+    expandAlias(&parsed);
+}
+
+static void runWildcards(char *line)
+{
+    parser(line, &parsed, false);
+    expandParsed(&parsed);
+}
+
+static void bench(const char *function, struct Corpus *corpus, void (*run)(char *line))
+{
+    int64_t rounds = 0;
+    int64_t start = now();
+    int64_t elapsed = 0;
+    uint64_t allocationsBefore = allocations;
+
+    while (elapsed < MIN_BENCH_NS)
+
+    {
+        for (int i = 0; i < NUM_OF_LINES; i++)
+
+        {
+            run(corpus->lines[i]);
+        }
+
+        rounds++;
+        elapsed = now() - start;
+    }
+
+    double lines = (double) rounds * NUM_OF_LINES;
+    double bytes = (double) rounds * corpus->bytes;
+
+    printf("%-18s %-14s %10zu %10.3f %12.1f %12.2f\n", function, corpus->name, corpus->bytes / NUM_OF_LINES,
+           elapsed / bytes, elapsed / lines, (allocations - allocationsBefore) / lines);
+}
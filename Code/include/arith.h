@@ -0,0 +1,18 @@
+/**
+ * @file arith.h
+ * @brief In-process evaluation of $(( )) arithmetic expressions on 64-bit signed integers.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// evaluates an already $-expanded expression. Bare names read (and =, +=, ... assign) shell variables.
+// On a syntax error or division by zero an error is printed, *ok is set to false and 0 is returned.
+int64_t evaluateArithmetic(char *expression, bool *ok);
+
+#endif // ARITH_H
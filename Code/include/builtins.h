@@ -0,0 +1,25 @@
+/**
+ * @file builtins.h
+ * @brief Builtins that used to need an external process (test, [, read, tee) or that act on the shell process itself
+ * (exec, coproc, timeout, watch, stats). They run inside the shell so that loops like `while read line; do [ ... ]; done` don't fork at all.
+ * Each returns the command's exit status.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "shell.h"
+
+int builtinTest(char **parsed); // test EXPR / [ EXPR ], 0 true, 1 false, 2 on a usage error
+bool probeFile(const char *op, const char *left, const char *right); // the file tests of test, -f FILE, -t FD, ... and, with right, A -nt B, A -ot B, A -ef B
+int builtinRead(char **parsed); // read [-r] [-p PROMPT] [NAME ...], 0 when a full line was read
+int builtinExec(char **parsed); // exec [COMMAND ...] [REDIRECTION ...], only returns without a command
+int builtinTee(char **parsed); // tee [-a] [FILE ...], 0 when every output got all of the input
+int builtinTimeout(char **parsed); // timeout DURATION [-s SIG] [-k DURATION] COMMAND [ARG ...], 124 when it timed out
+int builtinWatch(char **parsed); // watch [-p PATH] [-d MS] [-n COUNT] COMMAND [ARG ...], re-runs COMMAND when a path changes
+int builtinStats(char **parsed); // stats [-p], prints the runtime counters, in Prometheus text format with -p
+int builtinCoproc(char **parsed); // coproc [NAME] COMMAND [ARG ...], starts a worker and sets NAME_0, NAME_1 and NAME_PID
+
+#endif // BUILTINS_H
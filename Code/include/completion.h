@@ -0,0 +1,15 @@
+/**
+ * @file completion.h
+ * @brief Tab completion of command names for the interactive prompt. Executables on PATH and builtins are kept in a
+ * prefix trie that a background thread builds at startup and refreshes directory by directory when a PATH entry's
+ * mtime changes, so pressing Tab never waits for a directory scan.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+void initCompletion(); // hooks the completer into readline and starts the indexing thread
+
+#endif // COMPLETION_H
@@ -0,0 +1,19 @@
+/**
+ * @file historyindex.h
+ * @brief Indexed history search. Every command added to the history also goes into a trigram index (trigram to
+ * the list of entries containing it) that is updated as entries arrive, so a substring search only verifies the
+ * entries that share all of the query's trigrams instead of scanning the whole history. Results are ranked by how
+ * often and how recently a command was run. The `hsearch` builtin prints them and Ctrl-R at the prompt browses
+ * them in place of readline's linear reverse search.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef HISTORYINDEX_H
+#define HISTORYINDEX_H
+
+void addHistoryEntry(const char *line); // add_history() plus indexing, repeated commands share one entry in the index
+void initHistorySearch(); // binds Ctrl-R to the indexed search
+int builtinHsearch(char **parsed); // hsearch [-f] [-n COUNT] PATTERN ..., best matches first, 0 if there was one
+
+#endif // HISTORYINDEX_H
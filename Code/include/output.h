@@ -0,0 +1,21 @@
+/**
+ * @file output.h
+ * @brief Output layer for builtins. Pieces written by a builtin are gathered (small ones copied, large ones
+ * referenced) and go out with a single writev() when the command finishes. outFlush() is also called before every
+ * fork() and dup2() of stdout, so a child never inherits unwritten builtin output and bytes are never duplicated.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+void outWrite(const char *str, size_t len); // queues a copy of len bytes of str
+void outWriteRef(const char *str, size_t len); // queues str itself, it has to stay valid until the next outFlush()
+void outPrintf(const char *format, ...) __attribute__((format(printf, 1, 2))); // queues formatted text
+unsigned long long outTotal(); // bytes queued since the shell started, flushed or not
+void outFlush(); // flushes stdio's stdout, then writes everything queued to stdout (or the $(...) capture stream)
+
+#endif // OUTPUT_H
@@ -0,0 +1,37 @@
+/**
+ * @file pipes.h
+ * @brief Pipe capacity and pipeline statistics. Pipes between pipeline stages can be grown past the kernel's
+ * default 64 KiB with F_SETPIPE_SZ, either for every pipeline (PIPESIZE=1M) or for one pipeline
+ * (PIPESIZE=4M cmd | cmd). With VERBOSE set, the bytes each stage moved and the number of times it stalled
+ * (voluntary context switches, mostly waits on an empty or full pipe) are reported on stderr.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef PIPES_H
+#define PIPES_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+// ---- STRUCTS ----
+
+struct StageStats
+{
+    const char *name;       // the stage's words joined with spaces, for the report, heap allocated
+    long long readBytes;    // rchar from /proc/PID/io, includes the stage's own children
+    long long writtenBytes; // wchar, for every stage but the last this is what went through its pipe
+    long stalls;            // voluntary context switches from wait4()
+};
+
+// ---- FUNCTION DECLARATIONS ----
+
+long parsePipeSize(char *text); //parses 65536, 256K, 4M or 1G and clamps it to /proc/sys/fs/pipe-max-size, 0 if invalid
+long pipeSize(char *prefix); //capacity for a pipeline's pipes, from a PIPESIZE= prefix word (may be NULL) or the PIPESIZE variable
+long resizePipe(int fd, long size); //sets a pipe's capacity (0 keeps the kernel default) and returns the capacity it ended up with
+bool isVerbose(); //checks if verbose mode is on (the VERBOSE variable is set to something other than 0)
+int waitStage(pid_t pid, struct StageStats *stats, struct rusage *usage); //waits for a stage and returns its wait status, collecting its counters if stats is not NULL
+void reportPipeline(struct StageStats *stats, int numOfStages, long size); //prints the counters collected by waitStage() to stderr
+
+#endif // PIPES_H
@@ -0,0 +1,34 @@
+/**
+ * @file profile.h
+ * @brief Per-line script profiler, `Shell --profile[=FILE] script.sh`. Every simple command and pipeline the script
+ * runs is charged to the line it starts on: how often it ran, the time spent parsing it and expanding its aliases
+ * and wildcards, the processes it spawned, its wall time and the user and sys time and peak RSS of the children
+ * reaped while it ran. Time spent in a function is also charged to the line that called it, so the numbers are
+ * inclusive, like a call graph profiler's. When the script exits the lines are printed on stderr, most expensive
+ * first, and the call stacks are written to FILE (SCRIPT.folded in the current directory by default) in the
+ * folded format flamegraph.pl and speedscope read, weighted by the microseconds spent in each stack.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <sys/resource.h>
+
+// ---- GLOBAL VARIABLES ----
+
+extern bool profiling; // set by startProfile(), every hook below is only called when it is
+
+// ---- FUNCTION DECLARATIONS ----
+
+void startProfile(char *script, char *output); //starts profiling a script, output is the folded stack file (NULL for the default)
+long long profileClock(); //CLOCK_MONOTONIC in ns, the start of an interval handed to the hooks below
+void profileParse(int line, long long started); //charges the time since started to parsing a line, line 0 is the lexer's pass over the whole script
+void profileExpansion(long long started); //charges the time since started to alias and wildcard expansion on the current line
+void profileChild(struct rusage *usage); //adds a reaped child's cpu time and peak RSS to the current line
+void profileEnter(int line); //a command on the given line starts running
+void profileLeave(); //the command profileEnter() was last called for is done
+
+#endif // PROFILE_H
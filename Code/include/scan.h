@@ -0,0 +1,28 @@
+/**
+ * @file scan.h
+ * @brief Buffer scanning kernels for the text builtins (grep, wc, cut, uniq) and the command line lexers: byte
+ * search, byte counting, word counting, fixed-string search and searching for any byte of a small set. Each has an AVX2, an SSE2 and a plain C version, the best one the CPU supports
+ * is picked the first time any of them is called.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAX_FIND_SET 16 // bytes findAny() looks for at once, the lexers' delimiters fit
+
+// ---- FUNCTION DECLARATIONS ----
+
+const char *findByte(const char *data, size_t len, char c); //memchr(), NULL if c isn't in data
+const char *findEither(const char *data, size_t len, char a, char b); //first a or b in data, NULL if there is neither
+size_t countByte(const char *data, size_t len, char c); //number of times c occurs in data
+size_t countWords(const char *data, size_t len, bool *inWord); //words starting in data, inWord carries a word over from the previous block
+const char *findString(const char *data, size_t len, const char *needle, size_t needleLen); //memmem(), NULL if needle isn't in data
+const char *findAny(const char *data, size_t len, const char *set); //first byte of data that is in set (up to MAX_FIND_SET bytes), NULL if there is none
+const char *scanLevel(); //the kernels in use: "avx2", "sse2" or "scalar"
+
+#endif // SCAN_H
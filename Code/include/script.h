@@ -0,0 +1,85 @@
+/**
+ * @file script.h
+ * @brief Compiles shell source (scripts, interactive input, $(...) bodies) into a syntax tree once and executes the tree. Control flow (if, while, until, for, case, functions, &&, ||, ;) is handled here, simple commands are handed back to inputHandler() / executePipeline() in main.c.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct Buffer;
+struct SnapshotReader;
+
+// results of compiling a piece of source
+#define COMPILE_OK 0
+#define COMPILE_INCOMPLETE 1 /* the source ends inside a construct (if without fi, pending heredoc, trailing &&, ...) */
+#define COMPILE_ERROR 2
+
+enum NodeType
+{
+    NODE_SIMPLE,    /* a simple command, or a pipeline made only of simple commands */
+    NODE_PIPELINE,  /* a pipeline with at least one compound stage, stages are chained through next */
+    NODE_AND,
+    NODE_OR,
+    NODE_NOT,
+    NODE_IF,
+    NODE_WHILE,
+    NODE_UNTIL,
+    NODE_FOR,
+    NODE_CASE,
+    NODE_CASE_ITEM,
+    NODE_GROUP,     /* { list; } */
+    NODE_SUBSHELL,  /* ( list ) */
+    NODE_FUNCTION   /* name() body */
+};
+
+struct Node
+{
+    enum NodeType type;
+
+    char **words;           // NODE_SIMPLE: the raw words (quotes kept), NODE_FOR: the loop items, NODE_CASE_ITEM: the patterns
+    int numOfWords;
+    bool pipeline;          // NODE_SIMPLE: words contain | separators
+    char *heredoc;          // NODE_SIMPLE: raw body of a << heredoc
+    bool heredocLiteral;    // the heredoc delimiter was quoted, don't expand the body
+
+    char *name;             // NODE_FOR variable, NODE_CASE word, NODE_FUNCTION name
+    char **redirects;       // compound commands: operator / target pairs applied around the whole command
+    int numOfRedirects;
+    bool background;        // terminated by &
+    int line;               // NODE_SIMPLE and NODE_PIPELINE: line of the script the command starts on, 0 if unknown
+
+    struct Node *first;     // condition, left operand, loop / function / group body, case items or pipeline stages
+    struct Node *second;    // then branch, right operand or while / until body
+    struct Node *third;     // else branch (an elif is a nested NODE_IF)
+    struct Node *next;      // next node of the same list
+
+    int refs;               // owners of this node: its parent, plus the function table for function bodies
+};
+
+struct Function
+{
+    char name[100];
+    struct Node *body;
+};
+
+extern struct Function *functions; // shell functions, grown on demand
+extern int numOfFunctions;
+extern pid_t lastBackground; // pid of the last command started with &, $!
+
+int checkComplete(char *source); // returns COMPILE_OK, COMPILE_INCOMPLETE or COMPILE_ERROR without executing anything
+struct Node *compileSource(char *source, int *status); // compiles all of source into a list of nodes
+void runSource(char *source, bool addToHistory); // compiles and executes source one complete command at a time
+void executeList(struct Node *list); // executes a list of nodes, stops early for break, continue and return
+void executeNode(struct Node *node); // executes a single node
+void freeNode(struct Node *node); // releases a list of nodes (nodes still referenced elsewhere are kept)
+int builtinWait(char **parsed); // wait [pid ...], waits for the given background jobs (all of them without arguments) and returns the status of the last
+struct Function *getFunction(char *name); // looks up a shell function by name, NULL if undefined
+void saveFunctions(struct Buffer *out); // appends every function and its syntax tree to a startup snapshot
+bool loadFunctions(struct SnapshotReader *in, int count); // adds count functions saved by saveFunctions() to an empty table, false if the data is damaged
+
+#endif // SCRIPT_H
@@ -0,0 +1,128 @@
+/**
+ * @file shell.h
+ * @brief Shared state and the functions implemented in main.c (parsing, expansion, builtins and command execution), so that other translation units can drive the shell.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef SHELL_H
+#define SHELL_H
+
+#include "utils.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// a quoted empty word ("" or '') after quote removal. parsed arrays end at the first empty string, so an
+// empty argument is stored as this marker and turned back into "" by wordValue() wherever words are consumed
+#define EMPTY_WORD "\x01"
+
+// how expandWord() escapes the values it inserts, see appendValue()
+enum ExpandMode
+{
+    EXPAND_FIELDS, // a command word, unquoted values are split into fields at whitespace and may glob
+    EXPAND_WORD, // a single word (assignment, redirect target, case word), quotes are removed afterwards
+    EXPAND_HEREDOC // a heredoc body, quotes are plain text and the result is used as it is
+};
+
+// ---- STRUCTS ----
+
+struct Alias
+{
+    char pair[2][100]; // pair[0] = name, pair[1] = value
+};
+
+struct Variable
+{
+    char *name; // heap allocated
+    char *value; // heap allocated, values can be arbitrarily long (e.g. captured command output)
+};
+
+struct Words
+{
+    char **list; // the words of a command, ending with an empty string. One block holds the pointers and the text, NULL until something was parsed
+};
+
+struct Buffer
+{
+    char *data; // growable, always null terminated once something has been appended
+    size_t len;
+    size_t cap;
+};
+
+// ---- GLOBAL VARIABLES ----
+
+extern struct Alias *aliases; // array of alias objects, grown on demand
+extern int numOfAliases; // number of alias objects
+extern int aliasesCapacity;
+
+extern struct Variable *variables; // array of shell variables, grown on demand
+extern int numOfVariables;
+extern int variablesCapacity;
+
+extern FILE *builtinOutput; // where builtins write to. NULL means stdout, a memstream while capturing $(...)
+
+extern struct Buffer heredocBody; // body of the heredoc of the command being executed, consumed by inputHandler()
+
+extern int lastStatus; // exit status of the last command, $?
+extern char *shellName; // $0
+extern bool interactiveMode; // reading commands from the prompt rather than a script
+extern bool expansionFailed; // set when an expansion fails, cleared by expansionError()
+extern bool tailCallPending; // the next external command is the last thing the shell runs, it may replace the shell
+extern int numOfSubstitutions; // open <(...) / >(...) pipes, see closeSubstitutions()
+extern char **positionalParams; // $1, $2, ... of the running script or function
+extern int numOfPositionalParams;
+
+// ---- FUNCTION DECLARATIONS ----
+
+int length(char **arr); // returns the number of words in a list
+void parser(char *inputArr, struct Words *parsed, bool flag); // parses the input string and stores it in parsed, replacing the words it held
+void setWords(struct Words *words, char **list, int count); // replaces the words with copies of the first count words of list
+void freeWords(struct Words *words); // releases the words
+void dropWords(char **parsed, int start, int count); // removes count words starting at start, the list stays terminated
+void inputHandler(struct Words *command); // handles IO redirection and aliases. Calls handleCommand() to execute the command.
+bool aliasExists(char *aliasName); //checks if alias exists in array of alias objects
+struct Alias* getAlias(char *aliasName); //searches for alias value using name in array of alias objects
+void deleteAlias(char *aliasName); //deletes alias from array of alias objects
+void addAlias(char *aliasName, char *aliasValue); //adds alias to array of alias objects
+void printAliases(); //prints all aliases in array of alias objects
+void launchScriptMode(char *fName); //launches the shell in script mode
+void launchProfileMode(char *fName, char *output); //launches script mode under the per-line profiler, output is the folded stack file or NULL
+void launchInteractiveMode(); //launches the shell in interactive mode
+int getIndex(char *toFind, char **parsed, int start); //returns the index of a string in a list of words
+void handleCommand(struct Words *command); //handles internal commands and external commands
+int countPipes(char **parsed); //counts the number of pipe symbols in a command
+void executePipeline(char **words, int numOfWords); //executes a pipeline of commands, the stages are the words between the | words
+bool isValidPipeline(char **words, int numOfWords); //pipeline input validation method
+char *readFile(char* fName); //reads a whole file into a heap allocated string
+void replaceWildcards(struct Words *command); //replaces each word with a wildcard by its matching filenames joined with spaces (watch), commands glob in expandParsed()
+bool parseDupRedirect(char *word, int *target, int *source); //recognizes [n]>&m and [n]<&m (m may be $VAR, source is -1 for &-)
+void expandAlias(struct Words *command); //replaces a leading alias name with its value and re-parses the command
+void expandParsed(struct Words *command); //expands the words, splits unquoted results into fields, globs them and drops the quotes
+char **appendField(char **fields, int *numOfFields, int *capacity, char *field); //appends a heap allocated field to a growable array, returns the array
+char *globPattern(char *field); //returns the glob pattern for a field with an unquoted * or ?, quoted characters escaped, NULL if it has none
+char *tokenEnd(char *start, char *end); //returns pointer to the first unquoted space (or end) after start
+char *matchingParen(char *open); //returns pointer just past the ')' matching the '(' at open
+void removeQuotes(char *dest, char *src, int len); //copies len chars of src to dest, dropping quotes and backslashes
+char *closingQuote(char *start); //returns pointer to the " that closes a double quoted string starting at start, NULL if none
+char *closingBrace(char *start); //returns pointer to the } that closes a ${ whose name starts at start, NULL if none
+void unescapeDouble(char *dest, char *src, int len); //copies the inside of a double quoted string, dropping the backslash in front of $ ` " and another backslash
+bool isAssignment(char *token); //checks if a token is of the form NAME=value
+char *getVariable(char *name); //returns the value of a shell (or environment) variable, NULL if unset
+void setVariable(char *name, char *value); //creates or updates a shell variable
+char *expandWord(char *word, enum ExpandMode mode); //expands $VAR, $(...) and `...` in a word, returns a heap allocated string
+char *expandParameter(char *name, char *spec, bool length, enum ExpandMode mode); //the heap allocated value of ${name}, ${#name} or ${name:-word} and the like, NULL if unset or on error
+bool expansionError(); //checks for a failed expansion since the last check: sets $? to 2 and exits a script, true if the command must not run
+void appendValue(struct Buffer *out, char *value, enum ExpandMode mode, bool inDouble); //appends an expanded value, escaped so that quote removal gives it back unchanged
+char *captureCommand(char *command); //runs a command and returns its stdout with trailing newlines trimmed
+bool isCaptureSafe(char **parsed); //checks if a command is a builtin that can be captured without forking
+void bufferAppend(struct Buffer *buf, const char *str, size_t len); //appends len bytes of str to a growable buffer
+bool isProcessSubstitution(char *word); //checks if a word is <(...) or >(...)
+char *substituteProcess(char *word); //starts the command of a <(...) or >(...) word on a pipe and returns /dev/fd/N for it
+void closeSubstitutions(int mark); //closes the pipes of the process substitutions made after numOfSubstitutions was mark
+int heredocFd(char *body, size_t len); //returns a readable fd (memfd or pipe) positioned at the start of body
+void setStatus(int waitStatus); //sets lastStatus from a status returned by waitpid()
+void execParsed(char **parsed); //replaces the shell with the command in parsed, only returns by exiting
+char *wordValue(char *token); //returns the string a parsed token stands for, "" for EMPTY_WORD
+
+#endif // SHELL_H
@@ -0,0 +1,26 @@
+/**
+ * @file spawn.h
+ * @brief Spawn governor. Every fork() the shell makes goes through spawnProcess(), which admits at most
+ * SPAWN_LIMIT running children at a time (the rest wait for a slot; a pipeline waits as a whole, before its first
+ * stage, since its stages only exit once all of them run) and rides out transient EAGAIN and ENOMEM from fork() with bounded exponential backoff, where the shell
+ * used to give up on the command or exit. Waits, retries and failures are counted in shellStats.
+ * SPAWN_LIMIT is a soft limit: a fork() that has waited 2 seconds for a slot goes ahead anyway, since the children
+ * holding the slots may be waiting for something only the new child will do.
+ * Exited children still hold a process slot until they are reaped, so before retrying the governor reaps the ones
+ * that have exited and keeps their status for whoever waits for them, pipelines and `wait` (see takeReapedStatus()).
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+pid_t spawnProcess(); //fork() under the governor, -1 with errno set once retrying didn't help
+void beginPipeline(); //the following forks are stages of one pipeline, they don't wait for each other's slots
+void endPipeline(); //all stages of the pipeline have been started
+bool takeReapedStatus(pid_t pid, int *status); //the wait status of a child the governor reaped early, false if it didn't
+
+#endif // SPAWN_H
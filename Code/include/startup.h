@@ -0,0 +1,44 @@
+/**
+ * @file startup.h
+ * @brief The `source` builtin and ~/.shellrc. An interactive shell runs ~/.shellrc when it starts, then saves
+ * the aliases, variables and functions it ended up with to ~/.shellrc.snapshot. The snapshot records the size
+ * and mtime of the rc file and of every file it sourced, every environment variable it read, the result of every
+ * file test it made and, if it used relative paths, globs or pwd, the working directory. At the next start it is mmap()ed, and if none of those files, variables and test results has
+ * changed the state is copied straight out of it, so nothing is lexed, parsed or executed. An rc file
+ * that starts processes, prints something, changes directory or reads $$ or $! has effects or values a snapshot
+ * can't replay, so it is run every time and no snapshot is kept for it.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include "shell.h"
+#include <stdbool.h>
+
+#define SNAPSHOT_VERSION 4 // bump when the layout of the snapshot or of struct Node changes, older snapshots are then ignored
+
+// ---- STRUCTS ----
+
+struct SnapshotReader
+{
+    const char *ptr;        // next byte to read, in the mapping
+    const char *end;
+    bool failed;            // a read went past the end or found a bad length, everything read after it is 0 or NULL
+};
+
+// ---- FUNCTION DECLARATIONS ----
+
+int builtinSource(char **parsed); //source FILE (or . FILE), runs FILE in the current shell and returns the status of its last command
+void loadStartupFile(); //runs ~/.shellrc, or restores what it defined from its snapshot if none of the files it read changed
+void recordEnvironment(const char *name, const char *value); //notes an environment variable the rc file read, value is NULL if it is unset
+void recordProbe(const char *op, const char *left, const char *right, bool result); //notes a file test the rc file made, right is the second file of -nt, -ot and -ef
+void recordDirectory(); //notes that the rc file's result depends on the working directory (relative paths, globs, pwd)
+void recordProcessValue(); //notes that the rc file read $$ or $!, which no other process shares, so no snapshot is kept
+void putInt(struct Buffer *out, long long value); //appends a number to a snapshot
+void putString(struct Buffer *out, const char *str); //appends a string (or NULL) to a snapshot
+long long takeInt(struct SnapshotReader *in); //reads a number written by putInt()
+const char *takeString(struct SnapshotReader *in); //reads a string written by putString(), it points into the mapping
+
+#endif // STARTUP_H
@@ -0,0 +1,72 @@
+/**
+ * @file stats.h
+ * @brief Runtime counters. The parser, the expander and every place that forks bump counters, and the time from each
+ * fork to the moment its child is reaped goes into a histogram per kind of child. Redirected commands and pipeline
+ * stages expand their aliases and globs after the fork, so the counters live in a MAP_SHARED page the shell's
+ * children inherit and are bumped with atomic adds; what a child counts is seen by the shell. The `stats` builtin
+ * prints them; with STATS_FILE set they are also written there in Prometheus text format (atomically, for the node
+ * exporter's textfile collector) at most every STATS_INTERVAL seconds and once more when the shell exits.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "shell.h"
+#include <stdbool.h>
+#include <sys/resource.h>
+
+#define NUM_LATENCY_BUCKETS 14 // upper bounds are in stats.c, one more bucket catches everything slower
+#define STATS_ADD(counter, n) __atomic_fetch_add(&shellStats->counter, (n), __ATOMIC_RELAXED) // from any process of the shell
+
+// ---- STRUCTS ----
+
+enum SpawnKind
+{
+    SPAWN_COMMAND,      // an external command (or a redirected builtin) run by itself
+    SPAWN_STAGE,        // one stage of a pipeline
+    SPAWN_SUBSHELL,     // ( ... )
+    SPAWN_CAPTURE,      // $(...) that couldn't be captured in-process
+    NUM_SPAWN_KINDS
+};
+
+struct Histogram
+{
+    unsigned long long buckets[NUM_LATENCY_BUCKETS + 1]; // not cumulative, the Prometheus export adds them up
+    unsigned long long count;
+    long long sumNs;
+};
+
+struct ShellStats
+{
+    unsigned long long lines;           // input lines handed to the parser
+    unsigned long long tokens;
+    unsigned long long aliasHits;
+    unsigned long long globExpansions;  // words with a wildcard
+    unsigned long long globMatches;     // file names they expanded to
+    unsigned long long spawns;          // every fork(), reaped by the shell or not
+    unsigned long long spawnThrottles;  // forks that waited for one of the SPAWN_LIMIT slots
+    unsigned long long spawnRetries;    // fork() calls repeated after EAGAIN or ENOMEM
+    unsigned long long spawnFailures;   // forks given up on after the retries
+    unsigned long long execFailures;    // execvp() calls that failed, the command then exits 127 (not found) or 126
+    unsigned long long pipelineStages;
+    unsigned long long redirectedBytes; // written to files through > and >>
+    struct Histogram latency[NUM_SPAWN_KINDS];
+};
+
+// ---- GLOBAL VARIABLES ----
+
+extern struct ShellStats *shellStats; // process-private until initStats(), shared with the shell's children after it
+
+// ---- FUNCTION DECLARATIONS ----
+
+void initStats(); //moves the counters to a page shared with every child forked afterwards
+long long spawnStarted(); //the monotonic time a fork was made at, in ns (spawnProcess() counts the fork itself)
+void spawnExited(enum SpawnKind kind, long long started, struct rusage *usage); //adds a reaped child's lifetime to its histogram, usage (from wait4()) goes to the profiler
+long long fileSize(const char *path); //size of a file, 0 if it doesn't exist
+void formatStats(struct Buffer *out, bool prometheus); //appends the counters as a table, or in Prometheus text format
+bool isExporting(); //checks if STATS_FILE is set
+void exportStats(); //writes the counters to $STATS_FILE if STATS_INTERVAL seconds have passed since the last time
+
+#endif // STATS_H
@@ -0,0 +1,24 @@
+/**
+ * @file textutils.h
+ * @brief In-shell versions of the text tools pipelines lean on: grep for fixed strings, wc, cut -d -f, uniq and sort.
+ * They cover the options scripts actually use; isTextBuiltin() says whether a command stays within them, if it
+ * doesn't the real tool is run as an external command, so the builtins never change what a command means.
+ * Files are mmap()ed, pipes are read in large blocks of whole lines, and the scanning is done by the SIMD kernels
+ * in scan.c.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#ifndef TEXTUTILS_H
+#define TEXTUTILS_H
+
+#include <stdbool.h>
+
+bool isTextBuiltin(char **parsed); // checks if the command is grep, wc, cut, uniq or sort with options the builtins below support
+int builtinGrep(char **parsed); // grep [-Fvcqn] PATTERN [FILE ...], the pattern is a fixed string, 0 when a line was selected
+int builtinWc(char **parsed); // wc [-lwc] [FILE ...]
+int builtinCut(char **parsed); // cut -f LIST [-d C] [-s] [FILE ...]
+int builtinUniq(char **parsed); // uniq [-cdu] [INPUT]
+int builtinSort(char **parsed); // sort [-nru] [-t C] [-k POS1[,POS2]]... [-S SIZE] [FILE ...], in parallel, spilling runs beyond SIZE to $TMPDIR
+
+#endif // TEXTUTILS_H
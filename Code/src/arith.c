@@ -0,0 +1,637 @@
+/**
+ * @file arith.c
+ * @brief Recursive descent evaluator for $(( )) with the C operator precedence used by POSIX shells.
+ * Everything is computed on int64_t with wrap-around semantics, so scripts never need to spawn expr or bc.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "arith.h"
+#include "shell.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+// ---- STRUCTS ----
+
+struct Arith
+{
+    char *expression;       // the whole expression, for error messages
+    char *ptr;              // current position
+    bool ok;
+};
+
+// ---- FUNCTION DECLARATIONS ----
+
+static void arithError(struct Arith *a, const char *message); //reports the first error, later ones are dropped
+static void skipSpaces(struct Arith *a); //skips whitespace between tokens
+static bool accept(struct Arith *a, const char *op, const char *notFollowedBy); //consumes op unless it is a prefix of a longer operator
+static bool parseNumber(char *str, char **end, int64_t *value); //parses a decimal, 0x hex or 0 octal constant
+static int64_t readVariable(struct Arith *a, char *name); //returns the numeric value of a variable, 0 if unset or empty
+static int64_t applyBinary(struct Arith *a, char op, int64_t left, int64_t right, bool evaluate); //applies a binary operator
+static int64_t parseAssign(struct Arith *a, bool evaluate); //NAME op= expression, or a conditional expression
+static int64_t parseTernary(struct Arith *a, bool evaluate); //cond ? a : b
+static int64_t parseLogicalOr(struct Arith *a, bool evaluate); //||
+static int64_t parseLogicalAnd(struct Arith *a, bool evaluate); //&&
+static int64_t parseBitOr(struct Arith *a, bool evaluate); //|
+static int64_t parseBitXor(struct Arith *a, bool evaluate); //^
+static int64_t parseBitAnd(struct Arith *a, bool evaluate); //&
+static int64_t parseEquality(struct Arith *a, bool evaluate); //== !=
+static int64_t parseRelational(struct Arith *a, bool evaluate); //< <= > >=
+static int64_t parseShift(struct Arith *a, bool evaluate); //<< >>
+static int64_t parseAdditive(struct Arith *a, bool evaluate); //+ -
+static int64_t parseMultiplicative(struct Arith *a, bool evaluate); //* / %
+static int64_t parseUnary(struct Arith *a, bool evaluate); //+ - ! ~
+static int64_t parsePrimary(struct Arith *a, bool evaluate); //numbers, names and parentheses
+
+int64_t evaluateArithmetic(char *expression, bool *ok)
+{
+    struct Arith a = {expression, expression, true};
+
+    skipSpaces(&a);
+    int64_t result = (*a.ptr == '\0') ? 0 : parseAssign(&a, true); // $(( )) is 0
+    skipSpaces(&a);
+
+    if (a.ok && *a.ptr != '\0')
+
+    {
+        arithError(&a, "syntax error");
+    }
+
+    *ok = a.ok;
+    return a.ok ? result : 0;
+}
+
+static void arithError(struct Arith *a, const char *message)
+{
+    if (a->ok)
+
+    {
+        fprintf(stderr, "%s: arithmetic expression: %s: \"%s\"\n", shellName, message, a->expression);
+        a->ok = false;
+    }
+
+    a->ptr += strlen(a->ptr); // nothing after an error is evaluated
+}
+
+static void skipSpaces(struct Arith *a)
+{
+    while (isspace((unsigned char) *a->ptr))
+
+    {
+        a->ptr++;
+    }
+}
+
+static bool accept(struct Arith *a, const char *op, const char *notFollowedBy)
+{
+    skipSpaces(a);
+    size_t len = strlen(op);
+
+    if (strncmp(a->ptr, op, len) != 0)
+
+    {
+        return false;
+    }
+
+    if (a->ptr[len] != '\0' && notFollowedBy != NULL && strchr(notFollowedBy, a->ptr[len]) != NULL)
+
+    {
+        return false; // e.g. | when the input is || or |=
+    }
+
+    a->ptr += len;
+    return true;
+}
+
+static bool parseNumber(char *str, char **end, int64_t *value)
+{
+    int base = 10;
+    char *ptr = str;
+
+    if (ptr[0] == '0' && (ptr[1] == 'x' || ptr[1] == 'X'))
+
+    {
+        base = 16;
+        ptr += 2;
+    }
+
+    else if (ptr[0] == '0')
+
+    {
+        base = 8;
+    }
+
+    uint64_t result = 0;
+    char *digits = ptr;
+
+    while (isalnum((unsigned char) *ptr))
+
+    {
+        int digit = isdigit((unsigned char) *ptr) ? *ptr - '0' : tolower((unsigned char) *ptr) - 'a' + 10;
+
+        if (digit >= base)
+
+        {
+            return false;
+        }
+
+        result = result * base + digit; // wraps like the C expression would
+        ptr++;
+    }
+
+    if (ptr == digits)
+
+    {
+        return false;
+    }
+
+    *value = (int64_t) result;
+    *end = ptr;
+    return true;
+}
+
+static int64_t readVariable(struct Arith *a, char *name)
+{
+    char *value = getVariable(name);
+
+    if (value == NULL)
+
+    {
+        return 0;
+    }
+
+    while (isspace((unsigned char) *value))
+
+    {
+        value++;
+    }
+
+    if (*value == '\0')
+
+    {
+        return 0;
+    }
+
+    bool negative = (*value == '-');
+    char *end = NULL;
+    int64_t result = 0;
+
+    if (*value == '-' || *value == '+')
+
+    {
+        value++;
+    }
+
+    if (!parseNumber(value, &end, &result) || *end != '\0')
+
+    {
+        arithError(a, "illegal number");
+        return 0;
+    }
+
+    return negative ? (int64_t) (0 - (uint64_t) result) : result;
+}
+
+static int64_t applyBinary(struct Arith *a, char op, int64_t left, int64_t right, bool evaluate)
+{
+    if (!evaluate)
+
+    {
+        return 0; // the unevaluated side of && || ?: must not fail on x / 0
+    }
+
+    switch (op)
+
+    {
+        case '+': return (int64_t) ((uint64_t) left + (uint64_t) right);
+        case '-': return (int64_t) ((uint64_t) left - (uint64_t) right);
+        case '*': return (int64_t) ((uint64_t) left * (uint64_t) right);
+        case '<': return (int64_t) ((uint64_t) left << (right & 63));
+        case '>': return left >> (right & 63);
+        case '&': return left & right;
+        case '^': return left ^ right;
+        case '|': return left | right;
+        case '/':
+        case '%':
+
+            if (right == 0)
+
+            {
+                arithError(a, "division by zero");
+                return 0;
+            }
+
+            if (left == INT64_MIN && right == -1)
+
+            {
+                return (op == '/') ? INT64_MIN : 0; // the one quotient that doesn't fit
+            }
+
+            return (op == '/') ? left / right : left % right;
+    }
+
+    return 0;
+}
+
+static int64_t parseAssign(struct Arith *a, bool evaluate)
+{
+    skipSpaces(a);
+
+    if (isalpha((unsigned char) *a->ptr) || *a->ptr == '_')
+
+    {
+        char *start = a->ptr;
+        char *end = start;
+
+        while (isalnum((unsigned char) *end) || *end == '_')
+
+        {
+            end++;
+        }
+
+        char *op = end;
+
+        while (isspace((unsigned char) *op))
+
+        {
+            op++;
+        }
+
+        static const char *assignOps[] = {"=", "+=", "-=", "*=", "/=", "%=", "<<=", ">>=", "&=", "^=", "|="};
+
+        for (size_t i = 0; i < sizeof(assignOps) / sizeof(assignOps[0]); i++)
+
+        {
+            size_t opLen = strlen(assignOps[i]);
+
+            if (strncmp(op, assignOps[i], opLen) != 0 || (opLen == 1 && op[1] == '='))
+
+            {
+                continue; // == is a comparison
+            }
+
+            char name[100] = "";
+            size_t nameLen = (end - start < 99) ? end - start : 99;
+            memcpy(name, start, nameLen);
+
+            a->ptr = op + opLen;
+            int64_t value = parseAssign(a, evaluate);
+
+            if (opLen > 1)
+
+            {
+                value = applyBinary(a, op[0], readVariable(a, name), value, evaluate);
+            }
+
+            if (evaluate && a->ok)
+
+            {
+                char text[32];
+                snprintf(text, sizeof(text), "%" PRId64, value);
+                setVariable(name, text);
+            }
+
+            return value;
+        }
+    }
+
+    return parseTernary(a, evaluate);
+}
+
+static int64_t parseTernary(struct Arith *a, bool evaluate)
+{
+    int64_t condition = parseLogicalOr(a, evaluate);
+
+    if (!accept(a, "?", NULL))
+
+    {
+        return condition;
+    }
+
+    int64_t whenTrue = parseAssign(a, evaluate && condition);
+
+    if (!accept(a, ":", NULL))
+
+    {
+        arithError(a, "expecting ':'");
+        return 0;
+    }
+
+    int64_t whenFalse = parseTernary(a, evaluate && !condition);
+    return condition ? whenTrue : whenFalse;
+}
+
+static int64_t parseLogicalOr(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseLogicalAnd(a, evaluate);
+
+    while (accept(a, "||", NULL))
+
+    {
+        int64_t right = parseLogicalAnd(a, evaluate && !left);
+        left = (left || right);
+    }
+
+    return left;
+}
+
+static int64_t parseLogicalAnd(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseBitOr(a, evaluate);
+
+    while (accept(a, "&&", NULL))
+
+    {
+        int64_t right = parseBitOr(a, evaluate && left);
+        left = (left && right);
+    }
+
+    return left;
+}
+
+static int64_t parseBitOr(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseBitXor(a, evaluate);
+
+    while (accept(a, "|", "|="))
+
+    {
+        left = applyBinary(a, '|', left, parseBitXor(a, evaluate), evaluate);
+    }
+
+    return left;
+}
+
+static int64_t parseBitXor(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseBitAnd(a, evaluate);
+
+    while (accept(a, "^", "="))
+
+    {
+        left = applyBinary(a, '^', left, parseBitAnd(a, evaluate), evaluate);
+    }
+
+    return left;
+}
+
+static int64_t parseBitAnd(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseEquality(a, evaluate);
+
+    while (accept(a, "&", "&="))
+
+    {
+        left = applyBinary(a, '&', left, parseEquality(a, evaluate), evaluate);
+    }
+
+    return left;
+}
+
+static int64_t parseEquality(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseRelational(a, evaluate);
+
+    while (true)
+
+    {
+        if (accept(a, "==", NULL))
+
+        {
+            left = (left == parseRelational(a, evaluate));
+        }
+
+        else if (accept(a, "!=", NULL))
+
+        {
+            left = (left != parseRelational(a, evaluate));
+        }
+
+        else
+
+        {
+            return left;
+        }
+    }
+}
+
+static int64_t parseRelational(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseShift(a, evaluate);
+
+    while (true)
+
+    {
+        if (accept(a, "<=", NULL))
+
+        {
+            left = (left <= parseShift(a, evaluate));
+        }
+
+        else if (accept(a, ">=", NULL))
+
+        {
+            left = (left >= parseShift(a, evaluate));
+        }
+
+        else if (accept(a, "<", "<"))
+
+        {
+            left = (left < parseShift(a, evaluate));
+        }
+
+        else if (accept(a, ">", ">"))
+
+        {
+            left = (left > parseShift(a, evaluate));
+        }
+
+        else
+
+        {
+            return left;
+        }
+    }
+}
+
+static int64_t parseShift(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseAdditive(a, evaluate);
+
+    while (true)
+
+    {
+        if (accept(a, "<<", "="))
+
+        {
+            left = applyBinary(a, '<', left, parseAdditive(a, evaluate), evaluate);
+        }
+
+        else if (accept(a, ">>", "="))
+
+        {
+            left = applyBinary(a, '>', left, parseAdditive(a, evaluate), evaluate);
+        }
+
+        else
+
+        {
+            return left;
+        }
+    }
+}
+
+static int64_t parseAdditive(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseMultiplicative(a, evaluate);
+
+    while (true)
+
+    {
+        if (accept(a, "+", "="))
+
+        {
+            left = applyBinary(a, '+', left, parseMultiplicative(a, evaluate), evaluate);
+        }
+
+        else if (accept(a, "-", "="))
+
+        {
+            left = applyBinary(a, '-', left, parseMultiplicative(a, evaluate), evaluate);
+        }
+
+        else
+
+        {
+            return left;
+        }
+    }
+}
+
+static int64_t parseMultiplicative(struct Arith *a, bool evaluate)
+{
+    int64_t left = parseUnary(a, evaluate);
+
+    while (true)
+
+    {
+        char op = '\0';
+
+        if (accept(a, "*", "="))
+
+        {
+            op = '*';
+        }
+
+        else if (accept(a, "/", "="))
+
+        {
+            op = '/';
+        }
+
+        else if (accept(a, "%", "="))
+
+        {
+            op = '%';
+        }
+
+        else
+
+        {
+            return left;
+        }
+
+        left = applyBinary(a, op, left, parseUnary(a, evaluate), evaluate);
+    }
+}
+
+static int64_t parseUnary(struct Arith *a, bool evaluate)
+{
+    if (accept(a, "-", NULL))
+
+    {
+        return (int64_t) (0 - (uint64_t) parseUnary(a, evaluate));
+    }
+
+    if (accept(a, "+", NULL))
+
+    {
+        return parseUnary(a, evaluate);
+    }
+
+    if (accept(a, "!", "="))
+
+    {
+        return !parseUnary(a, evaluate);
+    }
+
+    if (accept(a, "~", NULL))
+
+    {
+        return ~parseUnary(a, evaluate);
+    }
+
+    return parsePrimary(a, evaluate);
+}
+
+static int64_t parsePrimary(struct Arith *a, bool evaluate)
+{
+    skipSpaces(a);
+
+    if (accept(a, "(", NULL))
+
+    {
+        int64_t value = parseAssign(a, evaluate);
+
+        if (!accept(a, ")", NULL))
+
+        {
+            arithError(a, "missing ')'");
+        }
+
+        return value;
+    }
+
+    if (isdigit((unsigned char) *a->ptr))
+
+    {
+        int64_t value = 0;
+        char *end = NULL;
+
+        if (!parseNumber(a->ptr, &end, &value))
+
+        {
+            arithError(a, "illegal number");
+            return 0;
+        }
+
+        a->ptr = end;
+        return value;
+    }
+
+    if (isalpha((unsigned char) *a->ptr) || *a->ptr == '_')
+
+    {
+        char name[100] = "";
+        int len = 0;
+
+        while ((isalnum((unsigned char) *a->ptr) || *a->ptr == '_'))
+
+        {
+            if (len < 99)
+
+            {
+                name[len++] = *a->ptr;
+            }
+
+            a->ptr++;
+        }
+
+        return evaluate ? readVariable(a, name) : 0;
+    }
+
+    arithError(a, "syntax error");
+    return 0;
+}
@@ -0,0 +1,2143 @@
+/**
+ * @file builtins.c
+ * @brief test / [, read, exec, tee, coproc, timeout, watch and stats, implemented in-process. read never consumes
+ * more than its line, whoever reads stdin next gets the rest. Regular files are read in large blocks and seeked back
+ * to the end of the line. Pipes are peeked with tee(2) into a scratch pipe, so exactly the line is then read out of
+ * them. Other inputs (terminals, sockets) are read a byte at a time, like every other shell does. tee moves
+ * pipe pages with tee(2) and splice(2) and only copies through user space for outputs that can't take a splice.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#define _GNU_SOURCE // tee(), splice()
+
+#include "builtins.h"
+#include "shell.h"
+#include "output.h"
+#include "pipes.h"
+#include "stats.h"
+#include "spawn.h"
+#include "startup.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <libgen.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <poll.h>
+
+#define READ_BLOCK_SIZE 65536
+#define READ_PEEK_SIZE 512      // bytes of a pipe read copies per peek, every peek copies them twice
+#define KILL_AFTER_DEFAULT 5.0  // seconds between timeout's signal and the SIGKILL that follows if the command ignores it
+#define DEBOUNCE_DEFAULT 100    // ms without events before watch re-runs its command
+#define FILE_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#define DIRECTORY_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO)
+
+// ---- STRUCTS ----
+
+struct TestArgs
+{
+    char **argv;            // the expression, without test / [ and ]
+    int count;
+    int pos;
+    bool error;             // a usage error was reported, status 2
+};
+
+struct TeeTarget
+{
+    int fd;
+    const char *name;       // for error messages
+    bool copy;              // splice() doesn't work on it (O_APPEND files, some devices), gets write() instead
+    bool switching;         // found out this round, becomes copy once the round's bytes are out
+    bool failed;            // a write failed, it gets nothing more
+};
+
+struct Watch
+{
+    int wd;
+    char *pattern;          // directory watches for globs and missing files: entry names that count, NULL for any
+};
+
+struct WatchList
+{
+    int fd;                 // inotify instance, made fresh after every run so the command's own changes are never seen
+    struct Watch *watches;
+    int count;
+    int cap;
+};
+
+struct ReadAhead
+{
+    dev_t dev;              // identity of the regular file the buffered data came from
+    ino_t ino;
+    off_t position;         // file offset of data[start], the fd is always left positioned here
+    struct timespec mtime;  // the buffer is dropped if the file changes
+    off_t size;
+    char *data;
+    size_t start;           // data[start .. len) has been read from the fd but not consumed yet
+    size_t len;
+    size_t cap;
+};
+
+// ---- GLOBAL VARIABLES ----
+
+static struct ReadAhead readAhead = {0, 0, 0, {0, 0}, 0, NULL, 0, 0, 0};
+static int peekPipe[2] = {-1, -1}; // scratch pipe read peeks a pipe on stdin through
+
+// ---- FUNCTION DECLARATIONS ----
+
+static bool testError(struct TestArgs *t, const char *message, const char *arg); //reports a usage error
+static bool isUnaryOp(const char *arg); //checks if arg is a unary test operator such as -f or -z
+static bool isBinaryOp(const char *arg); //checks if arg is a binary test operator such as = or -lt
+static bool toInteger(struct TestArgs *t, const char *arg, long long *value); //parses an integer operand
+static bool unaryTest(struct TestArgs *t, const char *op, const char *operand); //evaluates -f FILE, -n STRING, ...
+static bool compareFiles(const char *left, const char *op, const char *right); //evaluates A -nt B, A -ot B and A -ef B
+static bool binaryTest(struct TestArgs *t, const char *left, const char *op, const char *right); //evaluates A = B, A -lt B, ...
+static bool evaluateArgs(struct TestArgs *t, int count); //POSIX rules for up to four arguments, the grammar beyond that
+static bool testOr(struct TestArgs *t); //EXPR -o EXPR
+static bool testAnd(struct TestArgs *t); //EXPR -a EXPR
+static bool testNot(struct TestArgs *t); //! EXPR
+static bool testPrimary(struct TestArgs *t); //( EXPR ), unary and binary primaries, plain strings
+static void dropReadAhead(); //forgets the buffered input
+static int readLine(struct Buffer *line, bool raw); //reads one logical line from stdin, 1 complete, 0 cut short by EOF, -1 nothing read
+static ssize_t peekInput(char *data, size_t cap); //copies what a pipe on stdin holds without consuming it, -1 if it can't be peeked
+static int readExactLine(struct Buffer *line, bool raw, bool isPipe); //readLine() for inputs that can't be seeked back
+static bool isIfs(char c, const char *ifs, bool whitespace); //checks if c is an IFS (whitespace) character
+static int applyRedirection(char *token, char *next); //applies [n]>file, [n]>>file, [n]<file, [n]>&m, [n]<&-, ... for good
+static int teeSplice(struct TeeTarget *targets, int count); //tee for a pipe on stdin, pages are duplicated instead of copied
+static int teeCopy(struct TeeTarget *targets, int count); //tee for any other stdin, read() once and write() to every target
+static int lastSpliceTarget(struct TeeTarget *targets, int count); //the target that can consume the input, -1 if a copy is needed anyway
+static ssize_t spliceBytes(int from, int to, size_t len); //splice() until len bytes moved, returns how many did
+static ssize_t readBytes(int fd, char *data, size_t len); //read() until len bytes or end of file, returns how many were read
+static bool writeBytes(int fd, const char *data, size_t len); //write() all of data, false on an error
+static int writeTargets(struct TeeTarget *targets, int count, const char *data, size_t len, bool copyOnly); //write()s data to the targets, 1 if one failed
+static void targetFailed(struct TeeTarget *target); //reports a failed output, tee keeps going with the others
+static bool isName(const char *word); //checks if word can be a variable name
+static void setFdVariable(const char *name, const char *suffix, long value); //sets NAME_suffix to a number
+static bool parseDuration(const char *text, double *seconds); //parses 10, 1.5, 100ms, 2m, 1h or 1d
+static int parseSignal(const char *text); //TERM, SIGTERM or 15 to a signal number, -1 if unknown
+static void armTimer(int timer, double seconds); //one-shot timerfd expiry, seconds from now
+static void watchWords(struct WatchList *list, char **words); //watches the paths the words expand to, and the directories of their globs
+static void addWatch(struct WatchList *list, char *path, uint32_t mask, char *pattern); //adds one inotify watch
+static bool relevantEvents(struct WatchList *list); //reads the pending events, true if one of them is about a watched path
+static void clearWatches(struct WatchList *list); //closes the inotify instance and forgets its watches
+
+int builtinTest(char **parsed)
+{
+    int argc = length(parsed);
+    char **argv = malloc((argc + 1) * sizeof(char *));
+
+    for (int i = 0; i < argc; i++)
+
+    {
+        argv[i] = wordValue(parsed[i]);
+    }
+
+    if (strcmp(argv[0], "[") == 0)
+
+    {
+        if (strcmp(argv[argc - 1], "]") != 0)
+
+        {
+            fprintf(stderr, "%s: [: missing ]\n", shellName);
+            free(argv);
+            return 2;
+        }
+
+        argc--;
+    }
+
+    struct TestArgs t = {argv + 1, argc - 1, 0, false};
+    bool result = evaluateArgs(&t, t.count);
+
+    if (!t.error && t.pos < t.count)
+
+    {
+        testError(&t, "unexpected operator", t.argv[t.pos]);
+    }
+
+    free(argv);
+    return t.error ? 2 : (result ? 0 : 1);
+}
+
+static bool testError(struct TestArgs *t, const char *message, const char *arg)
+{
+    if (!t->error)
+
+    {
+        fprintf(stderr, "%s: test: %s: %s\n", shellName, arg, message);
+        t->error = true;
+    }
+
+    t->pos = t->count;
+    return false;
+}
+
+static bool isUnaryOp(const char *arg)
+{
+    return arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0' && strchr("bcdefghknprsStuwxzLOG", arg[1]) != NULL;
+}
+
+static bool isBinaryOp(const char *arg)
+{
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", "-a", "-o"};
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+
+    {
+        if (strcmp(arg, ops[i]) == 0)
+
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool toInteger(struct TestArgs *t, const char *arg, long long *value)
+{
+    char *end = NULL;
+
+    errno = 0;
+    *value = strtoll(arg, &end, 10);
+
+    while (end != NULL && (*end == ' ' || *end == '\t'))
+
+    {
+        end++;
+    }
+
+    if (end == arg || *end != '\0' || errno == ERANGE)
+
+    {
+        return testError(t, "illegal number", arg);
+    }
+
+    return true;
+}
+
+static bool unaryTest(struct TestArgs *t, const char *op, const char *operand)
+{
+    if (op[1] == 'n' || op[1] == 'z')
+
+    {
+        return (op[1] == 'n') == (operand[0] != '\0');
+    }
+
+    if (strchr("bcdefghprsStuwxkLOG", op[1]) == NULL)
+
+    {
+        return testError(t, "unexpected operator", op);
+    }
+
+    bool result = probeFile(op, operand, NULL);
+    recordProbe(op, operand, NULL, result); // a ~/.shellrc snapshot is only valid while it gives the same answer
+    return result;
+}
+
+bool probeFile(const char *op, const char *left, const char *right)
+{
+    struct stat st;
+
+    if (right != NULL)
+
+    {
+        return compareFiles(left, op, right);
+    }
+
+    switch (op[1])
+
+    {
+        case 't': return isatty(atoi(left));
+        case 'r': return access(left, R_OK) == 0;
+        case 'w': return access(left, W_OK) == 0;
+        case 'x': return access(left, X_OK) == 0;
+        case 'h':
+        case 'L': return lstat(left, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+
+    if (stat(left, &st) != 0)
+
+    {
+        return false;
+    }
+
+    switch (op[1])
+
+    {
+        case 'e': return true;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'O': return st.st_uid == geteuid();
+        case 'G': return st.st_gid == getegid();
+    }
+
+    return false;
+}
+
+static bool compareFiles(const char *left, const char *op, const char *right)
+{
+    struct stat a, b;
+    bool haveA = (stat(left, &a) == 0);
+    bool haveB = (stat(right, &b) == 0);
+
+    if (op[1] == 'e')
+
+    {
+        return haveA && haveB && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    }
+
+    const struct stat *newer = (op[1] == 'n') ? &a : &b;
+    const struct stat *older = (op[1] == 'n') ? &b : &a;
+    bool haveNewer = (op[1] == 'n') ? haveA : haveB;
+    bool haveOlder = (op[1] == 'n') ? haveB : haveA;
+
+    if (!haveNewer || !haveOlder)
+
+    {
+        return haveNewer; // an existing file is newer than a missing one
+    }
+
+    return newer->st_mtim.tv_sec > older->st_mtim.tv_sec ||
+           (newer->st_mtim.tv_sec == older->st_mtim.tv_sec && newer->st_mtim.tv_nsec > older->st_mtim.tv_nsec);
+}
+
+static bool binaryTest(struct TestArgs *t, const char *left, const char *op, const char *right)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+
+    {
+        return strcmp(left, right) == 0;
+    }
+
+    if (strcmp(op, "!=") == 0)
+
+    {
+        return strcmp(left, right) != 0;
+    }
+
+    if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0)
+
+    {
+        int cmp = strcoll(left, right);
+        return (op[0] == '<') ? cmp < 0 : cmp > 0;
+    }
+
+    if (strcmp(op, "-a") == 0 || strcmp(op, "-o") == 0)
+
+    {
+        bool a = (left[0] != '\0');
+        bool b = (right[0] != '\0');
+        return (op[1] == 'a') ? (a && b) : (a || b);
+    }
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0)
+
+    {
+        bool result = compareFiles(left, op, right);
+        recordProbe(op, left, right, result);
+        return result;
+    }
+
+    long long a = 0, b = 0;
+
+    if (!toInteger(t, left, &a) || !toInteger(t, right, &b))
+
+    {
+        return false;
+    }
+
+    switch (op[1] * 256 + op[2])
+
+    {
+        case 'e' * 256 + 'q': return a == b;
+        case 'n' * 256 + 'e': return a != b;
+        case 'l' * 256 + 't': return a < b;
+        case 'l' * 256 + 'e': return a <= b;
+        case 'g' * 256 + 't': return a > b;
+        case 'g' * 256 + 'e': return a >= b;
+    }
+
+    return testError(t, "unexpected operator", op);
+}
+
+static bool evaluateArgs(struct TestArgs *t, int count)
+{
+    // the POSIX argument count rules decide what `[ -n ]`, `[ ! = ! ]` and friends mean,
+    // longer expressions go through the -o / -a / ! grammar
+
+    char **argv = t->argv + t->pos;
+
+    switch (count)
+
+    {
+        case 0:
+            return false;
+
+        case 1:
+            t->pos += 1;
+            return argv[0][0] != '\0';
+
+        case 2:
+
+            if (strcmp(argv[0], "!") == 0)
+
+            {
+                t->pos += 2;
+                return argv[1][0] == '\0';
+            }
+
+            if (isUnaryOp(argv[0]))
+
+            {
+                t->pos += 2;
+                return unaryTest(t, argv[0], argv[1]);
+            }
+
+            return testError(t, "unexpected operator", argv[0]);
+
+        case 3:
+
+            if (isBinaryOp(argv[1]))
+
+            {
+                t->pos += 3;
+                return binaryTest(t, argv[0], argv[1], argv[2]);
+            }
+
+            if (strcmp(argv[0], "!") == 0)
+
+            {
+                t->pos += 1;
+                return !evaluateArgs(t, 2);
+            }
+
+            if (strcmp(argv[0], "(") == 0 && strcmp(argv[2], ")") == 0)
+
+            {
+                t->pos += 3;
+                return argv[1][0] != '\0';
+            }
+
+            break;
+
+        case 4:
+
+            if (strcmp(argv[0], "!") == 0)
+
+            {
+                t->pos += 1;
+                return !evaluateArgs(t, 3);
+            }
+
+            if (strcmp(argv[0], "(") == 0 && strcmp(argv[3], ")") == 0)
+
+            {
+                t->pos += 1;
+                bool result = evaluateArgs(t, 2);
+                t->pos += 1;
+                return result;
+            }
+
+            break;
+    }
+
+    return testOr(t);
+}
+
+static bool testOr(struct TestArgs *t)
+{
+    bool result = testAnd(t);
+
+    while (t->pos < t->count && strcmp(t->argv[t->pos], "-o") == 0)
+
+    {
+        t->pos++;
+        bool right = testAnd(t);
+        result = result || right;
+    }
+
+    return result;
+}
+
+static bool testAnd(struct TestArgs *t)
+{
+    bool result = testNot(t);
+
+    while (t->pos < t->count && strcmp(t->argv[t->pos], "-a") == 0)
+
+    {
+        t->pos++;
+        bool right = testNot(t);
+        result = result && right;
+    }
+
+    return result;
+}
+
+static bool testNot(struct TestArgs *t)
+{
+    if (t->pos + 1 < t->count && strcmp(t->argv[t->pos], "!") == 0)
+
+    {
+        t->pos++;
+        return !testNot(t);
+    }
+
+    return testPrimary(t);
+}
+
+static bool testPrimary(struct TestArgs *t)
+{
+    if (t->pos >= t->count)
+
+    {
+        return testError(t, "argument expected", t->count > 0 ? t->argv[t->count - 1] : "test");
+    }
+
+    char **argv = t->argv + t->pos;
+    int left = t->count - t->pos;
+
+    if (left >= 3 && isBinaryOp(argv[1]) && strcmp(argv[1], "-a") != 0 && strcmp(argv[1], "-o") != 0)
+
+    {
+        t->pos += 3;
+        return binaryTest(t, argv[0], argv[1], argv[2]);
+    }
+
+    if (left >= 2 && isUnaryOp(argv[0]))
+
+    {
+        t->pos += 2;
+        return unaryTest(t, argv[0], argv[1]);
+    }
+
+    if (strcmp(argv[0], "(") == 0 && left >= 2)
+
+    {
+        t->pos++;
+        bool result = testOr(t);
+
+        if (t->pos >= t->count || strcmp(t->argv[t->pos], ")") != 0)
+
+        {
+            return testError(t, "closing paren expected", "(");
+        }
+
+        t->pos++;
+        return result;
+    }
+
+    t->pos++;
+    return argv[0][0] != '\0';
+}
+
+int builtinRead(char **parsed)
+{
+    bool raw = false;
+    char *prompt = NULL;
+    int i = 1;
+
+    for (; parsed[i][0] != '\0' && parsed[i][0] == '-' && parsed[i][1] != '\0'; i++)
+
+    {
+        if (strcmp(parsed[i], "--") == 0)
+
+        {
+            i++;
+            break;
+        }
+
+        for (char *opt = parsed[i] + 1; *opt != '\0'; opt++)
+
+        {
+            if (*opt == 'r')
+
+            {
+                raw = true;
+            }
+
+            else if (*opt == 'p' && (opt[1] != '\0' || parsed[i + 1][0] != '\0'))
+
+            {
+                prompt = (opt[1] != '\0') ? opt + 1 : wordValue(parsed[++i]);
+                break;
+            }
+
+            else
+
+            {
+                fprintf(stderr, "%s: read: Illegal option -%c\n", shellName, *opt);
+                return 2;
+            }
+        }
+    }
+
+    char *defaultName[] = {"REPLY"};
+    char **names = defaultName;
+    int numOfNames = length(parsed + i);
+
+    if (numOfNames > 0)
+
+    {
+        names = parsed + i;
+    }
+
+    else
+
+    {
+        numOfNames = 1;
+    }
+
+    if (prompt != NULL && isatty(STDIN_FILENO))
+
+    {
+        fputs(prompt, stderr);
+    }
+
+    outFlush(); // a prompt written by an earlier command has to show up before we block
+
+    struct Buffer line = {NULL, 0, 0};
+    int status = readLine(&line, raw);
+
+    // drop the backslashes of escaped characters, remembering that what they protected is not a separator
+
+    size_t len = 0;
+    bool *literal = calloc(line.len + 1, sizeof(bool));
+
+    for (size_t j = 0; j < line.len; j++)
+
+    {
+        if (!raw && line.data[j] == '\\' && j + 1 < line.len)
+
+        {
+            j++;
+            literal[len] = true;
+        }
+
+        line.data[len++] = line.data[j];
+    }
+
+    char *ifs = getVariable("IFS");
+    ifs = (ifs == NULL) ? " \t\n" : ifs;
+
+    size_t pos = 0;
+
+    while (pos < len && !literal[pos] && isIfs(line.data[pos], ifs, true))
+
+    {
+        pos++; // leading IFS whitespace never makes a field
+    }
+
+    for (int n = 0; n < numOfNames; n++)
+
+    {
+        size_t start = pos;
+        size_t end = pos;
+
+        if (n == numOfNames - 1) // the last name gets the rest of the line, minus trailing IFS whitespace
+
+        {
+            end = len;
+
+            while (end > start && !literal[end - 1] && isIfs(line.data[end - 1], ifs, true))
+
+            {
+                end--;
+            }
+
+            pos = len;
+        }
+
+        else
+
+        {
+            while (end < len && (literal[end] || !isIfs(line.data[end], ifs, false)))
+
+            {
+                end++;
+            }
+
+            pos = end;
+
+            while (pos < len && !literal[pos] && isIfs(line.data[pos], ifs, true))
+
+            {
+                pos++;
+            }
+
+            if (pos < len && !literal[pos] && isIfs(line.data[pos], ifs, false))
+
+            {
+                pos++; // one non-whitespace separator, plus the whitespace around it
+
+                while (pos < len && !literal[pos] && isIfs(line.data[pos], ifs, true))
+
+                {
+                    pos++;
+                }
+            }
+        }
+
+        char *value = strndup(line.data ? line.data + start : "", end - start);
+        setVariable(names[n], value);
+        free(value);
+    }
+
+    free(literal);
+    free(line.data);
+
+    return (status == 1) ? 0 : 1;
+}
+
+static bool isIfs(char c, const char *ifs, bool whitespace)
+{
+    if (c == '\0' || strchr(ifs, c) == NULL)
+
+    {
+        return false;
+    }
+
+    return !whitespace || c == ' ' || c == '\t' || c == '\n';
+}
+
+static void dropReadAhead()
+{
+    readAhead.dev = 0;
+    readAhead.ino = 0;
+    readAhead.start = 0;
+    readAhead.len = 0;
+}
+
+static int readLine(struct Buffer *line, bool raw)
+{
+    struct stat st;
+
+    if (fstat(STDIN_FILENO, &st) != 0)
+
+    {
+        fprintf(stderr, "%s: read: %s\n", shellName, strerror(errno));
+        return -1;
+    }
+
+    if (readAhead.cap < READ_BLOCK_SIZE)
+
+    {
+        readAhead.data = realloc(readAhead.data, READ_BLOCK_SIZE);
+        readAhead.cap = READ_BLOCK_SIZE;
+    }
+
+    if (!S_ISREG(st.st_mode))
+
+    {
+        dropReadAhead();
+        return readExactLine(line, raw, S_ISFIFO(st.st_mode));
+    }
+
+    off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    bool sameSource = readAhead.dev == st.st_dev && readAhead.ino == st.st_ino && offset == readAhead.position && st.st_size == readAhead.size &&
+                      st.st_mtim.tv_sec == readAhead.mtime.tv_sec && st.st_mtim.tv_nsec == readAhead.mtime.tv_nsec;
+
+    if (!sameSource) // stdin was redirected, something else moved the offset or the file changed
+
+    {
+        dropReadAhead();
+        readAhead.dev = st.st_dev;
+        readAhead.ino = st.st_ino;
+        readAhead.position = offset;
+        readAhead.mtime = st.st_mtim;
+        readAhead.size = st.st_size;
+    }
+
+    int status = -1;
+
+    while (true)
+
+    {
+        char *data = readAhead.data + readAhead.start;
+        size_t available = readAhead.len - readAhead.start;
+        char *newline = (available > 0) ? memchr(data, '\n', available) : NULL;
+
+        if (newline != NULL)
+
+        {
+            size_t segment = newline - data;
+            size_t slashes = 0;
+
+            while (!raw && slashes < segment && data[segment - 1 - slashes] == '\\')
+
+            {
+                slashes++;
+            }
+
+            bool continued = (slashes % 2 == 1); // backslash-newline joins the next line
+            bufferAppend(line, data, continued ? segment - 1 : segment);
+
+            readAhead.start += segment + 1;
+            readAhead.position += segment + 1;
+            status = 1;
+
+            if (!continued)
+
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if (available > 0)
+
+        {
+            bufferAppend(line, data, available);
+            readAhead.position += available;
+            status = 0;
+        }
+
+        readAhead.start = 0;
+        readAhead.len = 0;
+
+        ssize_t n = read(STDIN_FILENO, readAhead.data, readAhead.cap);
+
+        while (n < 0 && errno == EINTR)
+
+        {
+            n = read(STDIN_FILENO, readAhead.data, readAhead.cap);
+        }
+
+        if (n <= 0)
+
+        {
+            status = (line->len > 0 || status == 1) ? 0 : -1; // input ended before a newline
+            break;
+        }
+
+        readAhead.len = n;
+    }
+
+    lseek(STDIN_FILENO, readAhead.position, SEEK_SET); // hand the unread rest of the file back to whoever reads next
+
+    if (line->data == NULL)
+
+    {
+        bufferAppend(line, "", 0);
+    }
+
+    return status;
+}
+
+static ssize_t peekInput(char *data, size_t cap)
+{
+    if (peekPipe[0] < 0 && pipe2(peekPipe, O_CLOEXEC) < 0)
+
+    {
+        return -1;
+    }
+
+    ssize_t n = tee(STDIN_FILENO, peekPipe[1], cap, 0); // waits for data like read() would, 0 at EOF
+
+    while (n < 0 && errno == EINTR)
+
+    {
+        n = tee(STDIN_FILENO, peekPipe[1], cap, 0);
+    }
+
+    ssize_t got = 0;
+
+    while (n > 0 && got < n)
+
+    {
+        ssize_t r = read(peekPipe[0], data + got, n - got);
+
+        if (r < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (r <= 0)
+
+        {
+            close(peekPipe[0]); // the copy is stuck in the scratch pipe, start over with a fresh one
+            close(peekPipe[1]);
+            peekPipe[0] = peekPipe[1] = -1;
+            return -1;
+        }
+
+        got += r;
+    }
+
+    return n;
+}
+
+static int readExactLine(struct Buffer *line, bool raw, bool isPipe)
+{
+    size_t lineStart = line->len; // where the current physical line starts, for its trailing backslashes
+    int status = -1;
+
+    while (true)
+
+    {
+        ssize_t peeked = isPipe ? peekInput(readAhead.data, READ_PEEK_SIZE) : -1; // a line usually fits, a longer one takes more rounds
+        size_t take = 1; // without a peek, the only safe amount
+
+        if (peeked == 0)
+
+        {
+            break; // EOF
+        }
+
+        if (peeked > 0)
+
+        {
+            char *newline = memchr(readAhead.data, '\n', peeked);
+            take = newline ? (size_t) (newline - readAhead.data) + 1 : (size_t) peeked;
+        }
+
+        isPipe = (peeked > 0); // tee() refused this input, read it byte by byte from now on
+        size_t got = 0;
+
+        while (got < take)
+
+        {
+            ssize_t n = read(STDIN_FILENO, readAhead.data + got, take - got);
+
+            if (n < 0 && errno == EINTR)
+
+            {
+                continue;
+            }
+
+            if (n <= 0)
+
+            {
+                break;
+            }
+
+            got += n;
+        }
+
+        if (got == 0)
+
+        {
+            break; // EOF
+        }
+
+        status = 0;
+
+        if (readAhead.data[got - 1] != '\n')
+
+        {
+            bufferAppend(line, readAhead.data, got);
+            continue;
+        }
+
+        bufferAppend(line, readAhead.data, got - 1);
+
+        size_t slashes = 0;
+
+        while (!raw && slashes < line->len - lineStart && line->data[line->len - 1 - slashes] == '\\')
+
+        {
+            slashes++;
+        }
+
+        if (slashes % 2 == 1) // backslash-newline joins the next line
+
+        {
+            line->len--;
+            line->data[line->len] = '\0';
+            lineStart = line->len;
+            continue;
+        }
+
+        status = 1;
+        break;
+    }
+
+    if (line->data == NULL)
+
+    {
+        bufferAppend(line, "", 0);
+    }
+
+    return status;
+}
+
+int builtinExec(char **parsed)
+{
+    struct Words words = {NULL};
+
+    setWords(&words, parsed, length(parsed));
+    expandParsed(&words);
+    parsed = words.list;
+    outFlush(); // whatever was printed so far belongs to the current stdout
+
+    char **command = malloc((length(parsed) + 1) * sizeof(char *));
+    int numOfWords = 0;
+    int status = 0;
+
+    for (int i = 1; parsed[i][0] != '\0'; i++)
+
+    {
+        int consumed = applyRedirection(parsed[i], parsed[i + 1]);
+
+        if (consumed < 0)
+
+        {
+            status = 1;
+            break;
+        }
+
+        if (consumed > 0)
+
+        {
+            i += consumed - 1;
+            continue;
+        }
+
+        command[numOfWords++] = parsed[i];
+    }
+
+    command[numOfWords] = "";
+
+    if (status == 0 && numOfWords > 0)
+
+    {
+        execParsed(command); // doesn't return, it exits when the exec fails
+    }
+
+    free(command); // exec with only redirections changes the shell's own fds
+    freeWords(&words);
+    return status;
+}
+
+static int applyRedirection(char *token, char *next)
+{
+    char *ptr = token;
+    int fd = -1;
+
+    if (isdigit((unsigned char) *ptr))
+
+    {
+        fd = 0;
+
+        while (isdigit((unsigned char) *ptr))
+
+        {
+            fd = fd * 10 + (*ptr++ - '0');
+        }
+    }
+
+    bool output = (*ptr == '>');
+
+    if (*ptr != '>' && *ptr != '<')
+
+    {
+        return 0; // a word of the command
+    }
+
+    bool append = (ptr[0] == '>' && ptr[1] == '>');
+    bool duplicate = (ptr[1] == '&');
+    ptr += (append || duplicate) ? 2 : 1;
+
+    char *target = ptr;
+    int consumed = 1;
+
+    if (*target == '\0')
+
+    {
+        if (next[0] == '\0')
+
+        {
+            fprintf(stderr, "%s: exec: %s: missing target\n", shellName, token);
+            return -1;
+        }
+
+        target = next;
+        consumed = 2;
+    }
+
+    if (fd < 0)
+
+    {
+        fd = output ? STDOUT_FILENO : STDIN_FILENO;
+    }
+
+    if (duplicate && strcmp(target, "-") == 0)
+
+    {
+        close(fd);
+        return consumed;
+    }
+
+    int source = -1;
+
+    if (duplicate)
+
+    {
+        source = atoi(target);
+    }
+
+    else
+
+    {
+        int flags = output ? (O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC)) : O_RDONLY;
+        source = open(wordValue(target), flags, 0666);
+    }
+
+    if (source < 0 || (source != fd && dup2(source, fd) < 0))
+
+    {
+        fprintf(stderr, "%s: exec: %s: %s\n", shellName, target, strerror(errno));
+
+        if (!duplicate && source >= 0)
+
+        {
+            close(source);
+        }
+
+        return -1;
+    }
+
+    if (!duplicate && source != fd)
+
+    {
+        close(source);
+    }
+
+    return consumed;
+}
+
+int builtinTee(char **parsed)
+{
+    bool append = false;
+    int i = 1;
+
+    for (; parsed[i][0] == '-' && parsed[i][1] != '\0'; i++)
+
+    {
+        if (strcmp(parsed[i], "--") == 0)
+
+        {
+            i++;
+            break;
+        }
+
+        for (char *opt = parsed[i] + 1; *opt != '\0'; opt++)
+
+        {
+            if (*opt == 'a')
+
+            {
+                append = true;
+            }
+
+            else if (*opt != 'i') // -i (ignore SIGINT) is accepted, a builtin in a pipeline stage is its own process anyway
+
+            {
+                fprintf(stderr, "%s: tee: Illegal option -%c\n", shellName, *opt);
+                return 2;
+            }
+        }
+    }
+
+    outFlush(); // earlier output goes first, tee writes to fd 1 directly
+
+    struct TeeTarget *targets = calloc(length(parsed) - i + 1, sizeof(struct TeeTarget));
+    int count = 0;
+    int status = 0;
+
+    targets[count++] = (struct TeeTarget) {STDOUT_FILENO, "standard output", false, false, false};
+
+    for (; parsed[i][0] != '\0'; i++)
+
+    {
+        char *name = wordValue(parsed[i]);
+        int fd = open(name, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+
+        if (fd < 0)
+
+        {
+            fprintf(stderr, "%s: tee: %s: %s\n", shellName, name, strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        targets[count++] = (struct TeeTarget) {fd, name, append, false, false}; // splice() refuses O_APPEND files
+    }
+
+    struct stat st;
+    bool isPipe = fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode);
+
+    status |= isPipe ? teeSplice(targets, count) : teeCopy(targets, count);
+
+    for (int j = 1; j < count; j++)
+
+    {
+        close(targets[j].fd);
+    }
+
+    free(targets);
+    return status;
+}
+
+static int teeSplice(struct TeeTarget *targets, int count)
+{
+    int scratch[2];
+    long chunk = fcntl(STDIN_FILENO, F_GETPIPE_SZ);
+
+    if (chunk <= 0 || pipe2(scratch, O_CLOEXEC) < 0)
+
+    {
+        return teeCopy(targets, count);
+    }
+
+    chunk = resizePipe(scratch[PIPE_WRITE_END], chunk); // as big as the input, so one tee() takes everything it holds
+
+    char *data = malloc(chunk);
+    int status = 0;
+
+    while (true)
+
+    {
+        for (int i = 0; i < count; i++)
+
+        {
+            targets[i].copy = targets[i].copy || targets[i].switching;
+            targets[i].switching = false;
+        }
+
+        int last = lastSpliceTarget(targets, count);
+        ssize_t n = -1; // bytes this round, set by whichever call looks at the input first
+
+        // every splice target but the last gets a duplicate of the input's pages through the scratch pipe
+        for (int i = 0; i < count && n != 0 && n != -2; i++)
+
+        {
+            if (targets[i].failed || targets[i].copy || i == last)
+
+            {
+                continue;
+            }
+
+            ssize_t teed = tee(STDIN_FILENO, scratch[PIPE_WRITE_END], (n < 0) ? chunk : n, 0);
+
+            if (teed < 0 && errno == EINTR)
+
+            {
+                i--;
+                continue;
+            }
+
+            if (teed <= 0 || (n > 0 && teed != n))
+
+            {
+                n = (teed == 0 && n < 0) ? 0 : -2; // end of input, or the input can't be duplicated and the copy loop takes over
+                break;
+            }
+
+            n = teed;
+
+            ssize_t moved = spliceBytes(scratch[PIPE_READ_END], targets[i].fd, n);
+
+            if (moved < n)
+
+            {
+                bool unsupported = (moved <= 0 && errno == EINVAL);
+                readBytes(scratch[PIPE_READ_END], data, n - (moved > 0 ? moved : 0)); // empty the scratch pipe
+
+                if (unsupported) // never spliced to, the drained bytes are exactly its share of this round
+
+                {
+                    targets[i].switching = true;
+                    status |= writeBytes(targets[i].fd, data, n) ? 0 : 1;
+                }
+
+                else
+
+                {
+                    targetFailed(&targets[i]);
+                    status = 1;
+                }
+            }
+        }
+
+        if (n == -2)
+
+        {
+            status |= teeCopy(targets, count);
+            break;
+        }
+
+        if (n == 0)
+
+        {
+            break; // end of input
+        }
+
+        // then the input itself is consumed: spliced into the last target, or read once for the targets that need a copy
+        if (last >= 0)
+
+        {
+            ssize_t moved = spliceBytes(STDIN_FILENO, targets[last].fd, (n < 0) ? chunk : n);
+
+            if (moved == 0 && n < 0)
+
+            {
+                break; // end of input
+            }
+
+            if (moved > 0 && (n < 0 || moved == n))
+
+            {
+                continue; // when it is the only target, the splice itself decided how much this round moves
+            }
+
+            if (moved > 0 || errno != EINVAL)
+
+            {
+                targetFailed(&targets[last]);
+                status = 1;
+                readBytes(STDIN_FILENO, data, (n < 0) ? 0 : n - (moved > 0 ? moved : 0)); // the others already have these bytes
+                continue;
+            }
+
+            targets[last].copy = true; // only copy target this round, the ones switching already got their bytes
+        }
+
+        ssize_t got = (n < 0) ? read(STDIN_FILENO, data, chunk) : readBytes(STDIN_FILENO, data, n);
+
+        if (got < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (got <= 0)
+
+        {
+            break;
+        }
+
+        status |= writeTargets(targets, count, data, got, true);
+    }
+
+    close(scratch[PIPE_READ_END]);
+    close(scratch[PIPE_WRITE_END]);
+    free(data);
+    return status;
+}
+
+static int teeCopy(struct TeeTarget *targets, int count)
+{
+    char *data = malloc(READ_BLOCK_SIZE);
+    int status = 0;
+
+    while (true)
+
+    {
+        ssize_t got = read(STDIN_FILENO, data, READ_BLOCK_SIZE);
+
+        if (got < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (got < 0)
+
+        {
+            fprintf(stderr, "%s: tee: %s\n", shellName, strerror(errno));
+            status = 1;
+        }
+
+        if (got <= 0)
+
+        {
+            break;
+        }
+
+        status |= writeTargets(targets, count, data, got, false);
+    }
+
+    free(data);
+    return status;
+}
+
+static int lastSpliceTarget(struct TeeTarget *targets, int count)
+{
+    int last = -1;
+
+    for (int i = 0; i < count; i++)
+
+    {
+        if (targets[i].copy && !targets[i].failed)
+
+        {
+            return -1; // the input has to be read() for this one, which consumes it for everybody
+        }
+
+        if (!targets[i].failed)
+
+        {
+            last = i;
+        }
+    }
+
+    return last;
+}
+
+static ssize_t spliceBytes(int from, int to, size_t len)
+{
+    size_t moved = 0;
+
+    while (moved < len)
+
+    {
+        ssize_t n = splice(from, NULL, to, NULL, len - moved, SPLICE_F_MOVE);
+
+        if (n < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (n <= 0)
+
+        {
+            return (moved > 0 || n == 0) ? (ssize_t) moved : -1;
+        }
+
+        moved += n;
+    }
+
+    return moved;
+}
+
+static ssize_t readBytes(int fd, char *data, size_t len)
+{
+    size_t got = 0;
+
+    while (got < len)
+
+    {
+        ssize_t n = read(fd, data + got, len - got);
+
+        if (n < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (n <= 0)
+
+        {
+            break;
+        }
+
+        got += n;
+    }
+
+    return got;
+}
+
+static bool writeBytes(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+
+    {
+        ssize_t n = write(fd, data, len);
+
+        if (n < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (n < 0)
+
+        {
+            return false;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static int writeTargets(struct TeeTarget *targets, int count, const char *data, size_t len, bool copyOnly)
+{
+    int status = 0;
+
+    for (int i = 0; i < count; i++)
+
+    {
+        if (!targets[i].failed && (targets[i].copy || !copyOnly) && !writeBytes(targets[i].fd, data, len))
+
+        {
+            targetFailed(&targets[i]);
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+static void targetFailed(struct TeeTarget *target)
+{
+    fprintf(stderr, "%s: tee: %s: %s\n", shellName, target->name, strerror(errno));
+    target->failed = true;
+}
+
+int builtinCoproc(char **parsed)
+{
+    char *name = (parsed[1][0] != '\0' && parsed[2][0] != '\0') ? parsed[1] : "COPROC"; // coproc NAME cmd ..., or coproc cmd
+    int first = (name == parsed[1]) ? 2 : 1;
+
+    if (parsed[first][0] == '\0' || !isName(name))
+
+    {
+        fprintf(stderr, "%s: coproc: usage: coproc [NAME] COMMAND [ARG ...]\n", shellName);
+        return 2;
+    }
+
+    int toWorker[2];
+    int fromWorker[2];
+
+    if (pipe2(toWorker, O_CLOEXEC) < 0 || pipe2(fromWorker, O_CLOEXEC) < 0)
+
+    {
+        fprintf(stderr, "%s: coproc: %s\n", shellName, strerror(errno));
+        return 1; // a half made pair is only left open when fds ran out, and then it doesn't matter
+    }
+
+    outFlush();
+    int rc = spawnProcess();
+    spawnStarted();
+
+    if (rc < 0)
+
+    {
+        fprintf(stderr, "%s: coproc: %s\n", shellName, strerror(errno));
+        close(toWorker[PIPE_READ_END]);
+        close(toWorker[PIPE_WRITE_END]);
+        close(fromWorker[PIPE_READ_END]);
+        close(fromWorker[PIPE_WRITE_END]);
+        return 1;
+    }
+
+    if (rc == 0)
+
+    {
+        dup2(toWorker[PIPE_READ_END], STDIN_FILENO);
+        dup2(fromWorker[PIPE_WRITE_END], STDOUT_FILENO);
+        close(toWorker[PIPE_READ_END]);
+        close(toWorker[PIPE_WRITE_END]);
+        close(fromWorker[PIPE_READ_END]);
+        close(fromWorker[PIPE_WRITE_END]);
+
+        struct Words command = {NULL};
+        setWords(&command, parsed + first, length(parsed + first));
+
+        tailCallPending = true; // an external worker replaces this child
+        inputHandler(&command);
+        outFlush();
+        exit(lastStatus);
+    }
+
+    close(toWorker[PIPE_READ_END]);
+    close(fromWorker[PIPE_WRITE_END]);
+
+    // our ends stay close-on-exec above the low fds, a command only gets one through >&$NAME_1 or <&$NAME_0
+    int readFd = fcntl(fromWorker[PIPE_READ_END], F_DUPFD_CLOEXEC, 10);
+    int writeFd = fcntl(toWorker[PIPE_WRITE_END], F_DUPFD_CLOEXEC, 10);
+
+    close(fromWorker[PIPE_READ_END]);
+    close(toWorker[PIPE_WRITE_END]);
+
+    setFdVariable(name, "0", readFd);
+    setFdVariable(name, "1", writeFd);
+    setFdVariable(name, "PID", rc);
+    return 0;
+}
+
+static bool isName(const char *word)
+{
+    if (!isalpha((unsigned char) word[0]) && word[0] != '_')
+
+    {
+        return false;
+    }
+
+    for (const char *ptr = word; *ptr != '\0'; ptr++)
+
+    {
+        if (!isalnum((unsigned char) *ptr) && *ptr != '_')
+
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void setFdVariable(const char *name, const char *suffix, long value)
+{
+    char variable[600];
+    char number[32];
+
+    snprintf(variable, sizeof(variable), "%s_%s", name, suffix);
+    snprintf(number, sizeof(number), "%ld", value);
+    setVariable(variable, number);
+}
+
+int builtinTimeout(char **parsed)
+{
+    int sig = SIGTERM;
+    double duration = -1;
+    double killAfter = KILL_AFTER_DEFAULT;
+    bool foreground = false;
+    bool preserve = false;
+    int i = 1;
+
+    // options may come before the duration (GNU timeout) or right after it (timeout 10 -s INT cmd)
+    for (; parsed[i][0] != '\0'; i++)
+
+    {
+        char *arg = wordValue(parsed[i]);
+        char *value = (arg[0] == '-' && arg[1] != '-' && arg[1] != '\0' && arg[2] != '\0') ? arg + 2 : wordValue(parsed[i + 1]);
+        bool attached = (value == arg + 2);
+
+        if (strncmp(arg, "-s", 2) == 0 || strncmp(arg, "-k", 2) == 0)
+
+        {
+            if (value[0] == '\0' || (arg[1] == 's' ? (sig = parseSignal(value)) < 0 : !parseDuration(value, &killAfter)))
+
+            {
+                fprintf(stderr, "%s: timeout: invalid %s '%s'\n", shellName, arg[1] == 's' ? "signal" : "duration", value);
+                return 125;
+            }
+
+            i += attached ? 0 : 1;
+        }
+
+        else if (strcmp(arg, "--foreground") == 0)
+
+        {
+            foreground = true; // the command stays in the shell's process group, so it can read the terminal
+        }
+
+        else if (strcmp(arg, "--preserve-status") == 0)
+
+        {
+            preserve = true;
+        }
+
+        else if (strcmp(arg, "--") == 0)
+
+        {
+            i++;
+            break;
+        }
+
+        else if (duration < 0 && parseDuration(arg, &duration))
+
+        {
+            continue;
+        }
+
+        else
+
+        {
+            break;
+        }
+    }
+
+    if (duration < 0 || parsed[i][0] == '\0')
+
+    {
+        fprintf(stderr, "%s: timeout: usage: timeout DURATION [-s SIGNAL] [-k DURATION] COMMAND [ARG ...]\n", shellName);
+        return 125;
+    }
+
+    char **command = parsed + i;
+
+    outFlush();
+    int rc = spawnProcess();
+    long long started = spawnStarted();
+
+    if (rc < 0)
+
+    {
+        fprintf(stderr, "%s: timeout: %s\n", shellName, strerror(errno));
+        return 125;
+    }
+
+    if (rc == 0)
+
+    {
+        if (!foreground)
+
+        {
+            setpgid(0, 0);
+        }
+
+        execParsed(command);
+    }
+
+    if (!foreground)
+
+    {
+        setpgid(rc, rc); // both sides, whichever runs first, so the group exists before a signal can be sent to it
+    }
+
+    pid_t target = foreground ? rc : -rc;
+    int child = (int) syscall(SYS_pidfd_open, rc, 0); // readable once the child has exited
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    bool timedOut = false;
+    bool killed = false;
+    int status = 0;
+    struct rusage usage;
+
+    memset(&usage, 0, sizeof(usage));
+    armTimer(timer, duration);
+
+    while (true)
+
+    {
+        struct pollfd fds[2] = {{timer, POLLIN, 0}, {child, POLLIN, 0}};
+        int ready = poll(fds, (child >= 0) ? 2 : 1, (child >= 0) ? -1 : 10); // kernels without pidfd: check on the child every 10ms
+
+        if (ready < 0 && errno != EINTR)
+
+        {
+            break;
+        }
+
+        if (child < 0 ? wait4(rc, &status, WNOHANG, &usage) == rc : (ready > 0 && fds[1].revents != 0))
+
+        {
+            break;
+        }
+
+        uint64_t expirations = 0;
+
+        if (ready <= 0 || !(fds[0].revents & POLLIN) || read(timer, &expirations, sizeof(expirations)) != sizeof(expirations))
+
+        {
+            continue;
+        }
+
+        if (!timedOut)
+
+        {
+            timedOut = true;
+            killed = (sig == SIGKILL);
+            kill(target, sig);
+
+            if (!killed)
+
+            {
+                kill(target, SIGCONT); // a stopped command has to run to act on the signal
+                armTimer(timer, killAfter);
+            }
+        }
+
+        else if (!killed)
+
+        {
+            killed = true;
+            kill(target, SIGKILL);
+        }
+    }
+
+    if (child >= 0)
+
+    {
+        wait4(rc, &status, 0, &usage);
+        close(child);
+    }
+
+    spawnExited(SPAWN_COMMAND, started, &usage);
+    close(timer);
+
+    if (killed)
+
+    {
+        return 128 + SIGKILL;
+    }
+
+    if (timedOut && !preserve)
+
+    {
+        return 124;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static bool parseDuration(const char *text, double *seconds)
+{
+    char *end = NULL;
+    double value = strtod(text, &end);
+
+    if (end == text || value < 0 || !isdigit((unsigned char) text[0]))
+
+    {
+        return false;
+    }
+
+    if (strcmp(end, "ms") == 0)
+
+    {
+        value /= 1000;
+    }
+
+    else if (*end != '\0' && end[1] == '\0' && strchr("smhd", *end) != NULL)
+
+    {
+        value *= (*end == 'm') ? 60 : (*end == 'h') ? 3600 : (*end == 'd') ? 86400 : 1;
+    }
+
+    else if (*end != '\0')
+
+    {
+        return false;
+    }
+
+    *seconds = value;
+    return true;
+}
+
+static int parseSignal(const char *text)
+{
+    static const struct { const char *name; int number; } signals[] = {
+        {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+        {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}
+    };
+
+    if (isdigit((unsigned char) text[0]))
+
+    {
+        char *end = NULL;
+        long number = strtol(text, &end, 10);
+        return (*end == '\0' && number > 0 && number < NSIG) ? (int) number : -1;
+    }
+
+    if (strncasecmp(text, "SIG", 3) == 0)
+
+    {
+        text += 3;
+    }
+
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+
+    {
+        if (strcasecmp(text, signals[i].name) == 0)
+
+        {
+            return signals[i].number;
+        }
+    }
+
+    return -1;
+}
+
+static void armTimer(int timer, double seconds)
+{
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when));
+
+    when.it_value.tv_sec = (time_t) seconds;
+    when.it_value.tv_nsec = (long) ((seconds - (double) when.it_value.tv_sec) * 1e9);
+
+    if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0)
+
+    {
+        return; // a zero duration never expires, like timeout 0
+    }
+
+    timerfd_settime(timer, 0, &when, NULL);
+}
+
+int builtinWatch(char **parsed)
+{
+    char **paths = malloc((length(parsed) + 1) * sizeof(char *)); // the -p values, pointing into parsed
+    int numOfPaths = 0;
+    int debounce = DEBOUNCE_DEFAULT;
+    long runs = 0;
+    int i = 1;
+
+    for (; parsed[i][0] == '-' && parsed[i][1] != '\0'; i++)
+
+    {
+        char option = parsed[i][1];
+        char *value = (parsed[i][2] != '\0') ? parsed[i] + 2 : parsed[i + 1];
+
+        if (strcmp(parsed[i], "--") == 0)
+
+        {
+            i++;
+            break;
+        }
+
+        if ((option != 'p' && option != 'd' && option != 'n') || value[0] == '\0')
+
+        {
+            fprintf(stderr, "%s: watch: usage: watch [-p PATH] [-d MS] [-n COUNT] COMMAND [ARG ...]\n", shellName);
+            free(paths);
+            return 2;
+        }
+
+        i += (value == parsed[i + 1]) ? 1 : 0;
+
+        if (option == 'p')
+
+        {
+            paths[numOfPaths++] = value;
+        }
+
+        else if (option != 'p')
+
+        {
+            char *expanded = expandWord(value, EXPAND_WORD);
+            long number = atol(expanded);
+            free(expanded);
+
+            debounce = (option == 'd') ? (int) number : debounce;
+            runs = (option == 'n') ? number : runs; // stop after this many runs, 0 runs forever
+        }
+    }
+
+    paths[numOfPaths] = "";
+
+    if (parsed[i][0] == '\0')
+
+    {
+        fprintf(stderr, "%s: watch: usage: watch [-p PATH] [-d MS] [-n COUNT] COMMAND [ARG ...]\n", shellName);
+        free(paths);
+        return 2;
+    }
+
+    struct WatchList list = {-1, NULL, 0, 0};
+    struct Words command = {NULL};
+    int status = 0;
+
+    for (long run = 1; ; run++)
+
+    {
+        setWords(&command, parsed + i, length(parsed + i));
+        inputHandler(&command); // takes the words apart, so it runs on a copy
+        outFlush();
+        status = lastStatus;
+
+        if (runs > 0 && run >= runs)
+
+        {
+            break;
+        }
+
+        list.fd = inotify_init1(IN_CLOEXEC);
+
+        if (list.fd < 0)
+
+        {
+            fprintf(stderr, "%s: watch: %s\n", shellName, strerror(errno));
+            status = 1;
+            break;
+        }
+
+        watchWords(&list, (numOfPaths > 0) ? paths : parsed + i); // without -p, the command's words that name files are watched
+
+        if (list.count == 0)
+
+        {
+            fprintf(stderr, "%s: watch: nothing to watch\n", shellName);
+            clearWatches(&list);
+            status = 1;
+            break;
+        }
+
+        while (!relevantEvents(&list))
+
+        {
+            // blocks until something happens to a watched path
+        }
+
+        struct pollfd quiet = {list.fd, POLLIN, 0};
+
+        while (poll(&quiet, 1, debounce) > 0 || (errno == EINTR && debounce > 0)) // a burst of writes is one change
+
+        {
+            relevantEvents(&list);
+            errno = 0;
+        }
+
+        clearWatches(&list);
+    }
+
+    freeWords(&command);
+    free(paths);
+    return status;
+}
+
+static void watchWords(struct WatchList *list, char **words)
+{
+    struct Words expanded = {NULL};
+
+    setWords(&expanded, words, length(words));
+    replaceWildcards(&expanded); // only replaces words, the two lists stay aligned
+
+    for (int i = 0; words[i][0] != '\0'; i++)
+
+    {
+        char *path = malloc(strlen(words[i]) + strlen(expanded.list[i]) + 1); // room for the word or any of its matches
+        removeQuotes(path, words[i], strlen(words[i]));
+
+        if (strpbrk(path, "*?[") != NULL || access(path, F_OK) != 0) // a glob or a file that doesn't exist yet: watch for it to appear
+
+        {
+            char *copy = strdup(path);
+            char *directory = dirname(copy);
+
+            if (strpbrk(directory, "*?[") == NULL)
+
+            {
+                char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+                addWatch(list, directory, DIRECTORY_EVENTS, name);
+            }
+
+            free(copy);
+        }
+
+        // replaceWildcards() put every match into the one word, separated by spaces
+        for (char *match = strtok(expanded.list[i], " "); match != NULL; match = strtok(NULL, " "))
+
+        {
+            removeQuotes(path, match, strlen(match));
+            struct stat st;
+
+            if (stat(path, &st) == 0)
+
+            {
+                addWatch(list, path, S_ISDIR(st.st_mode) ? DIRECTORY_EVENTS : FILE_EVENTS, NULL);
+            }
+        }
+
+        free(path);
+    }
+
+    freeWords(&expanded);
+}
+
+static void addWatch(struct WatchList *list, char *path, uint32_t mask, char *pattern)
+{
+    int wd = inotify_add_watch(list->fd, path, mask);
+
+    if (wd < 0)
+
+    {
+        return;
+    }
+
+    if (list->count == list->cap)
+
+    {
+        list->cap = list->cap ? list->cap * 2 : 16;
+        list->watches = realloc(list->watches, list->cap * sizeof(struct Watch));
+    }
+
+    list->watches[list->count].wd = wd;
+    list->watches[list->count].pattern = pattern ? strdup(pattern) : NULL;
+    list->count++;
+}
+
+static bool relevantEvents(struct WatchList *list)
+{
+    char buffer[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(list->fd, buffer, sizeof(buffer));
+    bool relevant = false;
+
+    for (char *ptr = buffer; len > 0 && ptr < buffer + len; )
+
+    {
+        struct inotify_event *event = (struct inotify_event *) ptr;
+        ptr += sizeof(struct inotify_event) + event->len;
+
+        for (int i = 0; i < list->count && !(event->mask & IN_IGNORED); i++)
+
+        {
+            if (list->watches[i].wd == event->wd)
+
+            {
+                char *pattern = list->watches[i].pattern;
+                relevant = relevant || pattern == NULL || (event->len > 0 && fnmatch(pattern, event->name, 0) == 0);
+            }
+        }
+    }
+
+    return relevant;
+}
+
+static void clearWatches(struct WatchList *list)
+{
+    for (int i = 0; i < list->count; i++)
+
+    {
+        free(list->watches[i].pattern);
+    }
+
+    if (list->fd >= 0)
+
+    {
+        close(list->fd);
+    }
+
+    free(list->watches);
+    list->fd = -1;
+    list->watches = NULL;
+    list->count = 0;
+    list->cap = 0;
+}
+
+int builtinStats(char **parsed)
+{
+    bool prometheus = (strcmp(parsed[1], "-p") == 0);
+
+    if ((parsed[1][0] != '\0' && !prometheus) || (prometheus && parsed[2][0] != '\0'))
+
+    {
+        fprintf(stderr, "%s: stats: usage: stats [-p]\n", shellName);
+        return 2;
+    }
+
+    struct Buffer text = {NULL, 0, 0};
+
+    formatStats(&text, prometheus);
+    outWrite(text.data, text.len);
+    free(text.data);
+    return 0;
+}
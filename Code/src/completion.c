@@ -0,0 +1,504 @@
+/**
+ * @file completion.c
+ * @brief Command name completion backed by a prefix trie. The trie holds builtins and every executable found on
+ * PATH. It is owned by a background thread that scans the PATH directories at startup and, when asked to by the
+ * completer, rescans only the directories whose mtime changed. The completer only ever takes a read lock, so Tab
+ * answers from whatever the trie holds right now. Aliases and functions change with every command and live in the
+ * main thread's tables, they are matched there directly.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "completion.h"
+#include "shell.h"
+#include "script.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <readline/readline.h>
+
+#define REFRESH_INTERVAL_NS 1000000000LL // PATH directories are re-checked at most once a second
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+// ---- STRUCTS ----
+
+struct TrieNode
+{
+    char ch;
+    int count;                  // how many sources (PATH directories, the builtin list) provide the name ending here
+    struct TrieNode *child;     // first node of the next level
+    struct TrieNode *sibling;   // next node of the same level
+};
+
+struct PathDir
+{
+    char *path;
+    struct timespec mtime;      // mtime when names was collected, a directory's mtime changes when entries come and go
+    bool scanned;
+    char **names;               // the executables this directory contributed to the trie
+    int numOfNames;
+};
+
+struct Matches
+{
+    char **names;
+    int count;
+    int capacity;
+};
+
+// ---- GLOBAL VARIABLES ----
+
+static struct TrieNode root = {'\0', 0, NULL, NULL};
+static pthread_rwlock_t trieLock = PTHREAD_RWLOCK_INITIALIZER;
+
+static pthread_mutex_t refreshLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refreshCond = PTHREAD_COND_INITIALIZER;
+static char *requestedPath = NULL;  // PATH handed to the index thread, NULL while no refresh is pending
+static int64_t lastRequest = 0;
+
+static struct PathDir *pathDirs = NULL; // only touched by the index thread
+static int numOfPathDirs = 0;
+
+static const char *builtinNames[] = {
+    "exit", "true", "false", ":", "test", "[", "read", "shift", "pwd", "cd", "alias", "unalias", "echo", "history",
+    "break", "continue", "return", "exec", "tee", "coproc", "timeout", "watch", "stats", "hsearch", "source", "wait"
+};
+
+// ---- FUNCTION DECLARATIONS ----
+
+static int64_t now(); //monotonic clock in nanoseconds
+static void adjustName(const char *name, int delta); //adds delta to the count of name, creating its nodes if needed
+static void collectNames(struct TrieNode *node, struct Buffer *prefix, struct Matches *matches); //every name at or below node
+static void addMatch(struct Matches *matches, const char *name); //appends a copy of name
+static void scanDirectory(struct PathDir *dir); //lists the executables of a directory
+static void forgetDirectory(struct PathDir *dir); //takes a directory's names out of the trie
+static void refreshDirectories(char *path); //brings the trie in line with the directories of path
+static void *indexThread(void *arg); //refreshes the trie whenever the completer asks for it
+static void requestRefresh(); //wakes the index thread up, at most once per REFRESH_INTERVAL_NS
+static bool isCommandPosition(int start); //checks if the word at start is a command name
+static char *commandGenerator(const char *text, int state); //readline generator over the command names matching text
+static char **completeCommand(const char *text, int start, int end); //readline completion hook
+
+void initCompletion()
+{
+    for (size_t i = 0; i < sizeof(builtinNames) / sizeof(builtinNames[0]); i++)
+
+    {
+        adjustName(builtinNames[i], 1);
+    }
+
+    rl_attempted_completion_function = completeCommand;
+
+    char *path = getenv("PATH");
+    pthread_t thread;
+
+    lastRequest = now();
+
+    if (pthread_create(&thread, NULL, indexThread, strdup(path ? path : DEFAULT_PATH)) == 0)
+
+    {
+        pthread_detach(thread);
+    }
+}
+
+static int64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void adjustName(const char *name, int delta)
+{
+    // callers hold the write lock (or run before the index thread exists)
+
+    struct TrieNode *node = &root;
+
+    for (const char *ch = name; *ch != '\0'; ch++)
+
+    {
+        struct TrieNode *next = node->child;
+
+        while (next != NULL && next->ch != *ch)
+
+        {
+            next = next->sibling;
+        }
+
+        if (next == NULL)
+
+        {
+            if (delta < 0)
+
+            {
+                return; // never added
+            }
+
+            next = calloc(1, sizeof(struct TrieNode));
+            next->ch = *ch;
+            next->sibling = node->child;
+            node->child = next;
+        }
+
+        node = next;
+    }
+
+    node->count += delta; // nodes are kept at count 0, the same names tend to come back on the next rescan
+}
+
+static void addMatch(struct Matches *matches, const char *name)
+{
+    if (matches->count == matches->capacity)
+
+    {
+        matches->capacity = matches->capacity ? matches->capacity * 2 : 64;
+        matches->names = realloc(matches->names, matches->capacity * sizeof(char *));
+    }
+
+    matches->names[matches->count++] = strdup(name);
+}
+
+static void collectNames(struct TrieNode *node, struct Buffer *prefix, struct Matches *matches)
+{
+    if (node->count > 0)
+
+    {
+        addMatch(matches, prefix->data);
+    }
+
+    for (struct TrieNode *child = node->child; child != NULL; child = child->sibling)
+
+    {
+        bufferAppend(prefix, &child->ch, 1);
+        collectNames(child, prefix, matches);
+        prefix->data[--prefix->len] = '\0';
+    }
+}
+
+static void scanDirectory(struct PathDir *dir)
+{
+    DIR *d = opendir(dir->path);
+    dir->names = NULL;
+    dir->numOfNames = 0;
+
+    if (d == NULL)
+
+    {
+        return;
+    }
+
+    int capacity = 0;
+    struct dirent *entry = NULL;
+
+    while ((entry = readdir(d)) != NULL)
+
+    {
+        struct stat st;
+
+        if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+
+        {
+            continue;
+        }
+
+        if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+
+        {
+            continue; // directories, sockets, ... can't be run, and skipping them saves a stat
+        }
+
+        if (fstatat(dirfd(d), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode) || faccessat(dirfd(d), entry->d_name, X_OK, 0) != 0)
+
+        {
+            continue;
+        }
+
+        if (dir->numOfNames == capacity)
+
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            dir->names = realloc(dir->names, capacity * sizeof(char *));
+        }
+
+        dir->names[dir->numOfNames++] = strdup(entry->d_name);
+    }
+
+    closedir(d);
+}
+
+static void forgetDirectory(struct PathDir *dir)
+{
+    pthread_rwlock_wrlock(&trieLock);
+
+    for (int i = 0; i < dir->numOfNames; i++)
+
+    {
+        adjustName(dir->names[i], -1);
+    }
+
+    pthread_rwlock_unlock(&trieLock);
+
+    for (int i = 0; i < dir->numOfNames; i++)
+
+    {
+        free(dir->names[i]);
+    }
+
+    free(dir->names);
+    dir->names = NULL;
+    dir->numOfNames = 0;
+    dir->scanned = false;
+}
+
+static void refreshDirectories(char *path)
+{
+    // directories that left PATH are dropped, new ones are added unscanned
+
+    for (int i = 0; i < numOfPathDirs; i++)
+
+    {
+        bool present = false;
+        size_t len = strlen(pathDirs[i].path);
+
+        for (char *entry = path; entry != NULL && !present; entry = strchr(entry, ':') ? strchr(entry, ':') + 1 : NULL)
+
+        {
+            present = (strncmp(entry, pathDirs[i].path, len) == 0 && (entry[len] == ':' || entry[len] == '\0'));
+        }
+
+        if (!present)
+
+        {
+            forgetDirectory(&pathDirs[i]);
+            free(pathDirs[i].path);
+            pathDirs[i--] = pathDirs[--numOfPathDirs];
+        }
+    }
+
+    for (char *entry = path; entry != NULL; entry = strchr(entry, ':') ? strchr(entry, ':') + 1 : NULL)
+
+    {
+        char *end = strchr(entry, ':');
+        size_t len = end ? (size_t) (end - entry) : strlen(entry);
+        bool known = false;
+
+        for (int i = 0; i < numOfPathDirs && !known; i++)
+
+        {
+            known = (strlen(pathDirs[i].path) == len && strncmp(pathDirs[i].path, entry, len) == 0);
+        }
+
+        if (len == 0 || known)
+
+        {
+            continue; // an empty entry means the current directory, which isn't worth indexing
+        }
+
+        pathDirs = realloc(pathDirs, (numOfPathDirs + 1) * sizeof(struct PathDir));
+        memset(&pathDirs[numOfPathDirs], 0, sizeof(struct PathDir));
+        pathDirs[numOfPathDirs].path = strndup(entry, len);
+        numOfPathDirs++;
+    }
+
+    for (int i = 0; i < numOfPathDirs; i++)
+
+    {
+        struct PathDir *dir = &pathDirs[i];
+        struct stat st;
+
+        if (stat(dir->path, &st) != 0)
+
+        {
+            if (dir->scanned)
+
+            {
+                forgetDirectory(dir);
+            }
+
+            continue;
+        }
+
+        if (dir->scanned && st.st_mtim.tv_sec == dir->mtime.tv_sec && st.st_mtim.tv_nsec == dir->mtime.tv_nsec)
+
+        {
+            continue; // nothing was added, removed or renamed in there
+        }
+
+        struct PathDir fresh = *dir;
+        scanDirectory(&fresh); // the slow part runs without the lock
+
+        pthread_rwlock_wrlock(&trieLock);
+
+        for (int j = 0; j < fresh.numOfNames; j++)
+
+        {
+            adjustName(fresh.names[j], 1);
+        }
+
+        for (int j = 0; j < dir->numOfNames; j++)
+
+        {
+            adjustName(dir->names[j], -1);
+        }
+
+        pthread_rwlock_unlock(&trieLock);
+
+        for (int j = 0; j < dir->numOfNames; j++)
+
+        {
+            free(dir->names[j]);
+        }
+
+        free(dir->names);
+        dir->names = fresh.names;
+        dir->numOfNames = fresh.numOfNames;
+        dir->mtime = st.st_mtim;
+        dir->scanned = true;
+    }
+}
+
+static void *indexThread(void *arg)
+{
+    char *path = arg;
+
+    while (true)
+
+    {
+        refreshDirectories(path);
+        free(path);
+
+        pthread_mutex_lock(&refreshLock);
+
+        while (requestedPath == NULL)
+
+        {
+            pthread_cond_wait(&refreshCond, &refreshLock);
+        }
+
+        path = requestedPath;
+        requestedPath = NULL;
+        pthread_mutex_unlock(&refreshLock);
+    }
+
+    return NULL;
+}
+
+static void requestRefresh()
+{
+    int64_t time = now();
+
+    if (time - lastRequest < REFRESH_INTERVAL_NS)
+
+    {
+        return;
+    }
+
+    char *path = getVariable("PATH"); // PATH may have been changed by the script since startup
+
+    lastRequest = time;
+    pthread_mutex_lock(&refreshLock);
+    free(requestedPath);
+    requestedPath = strdup(path ? path : DEFAULT_PATH);
+    pthread_cond_signal(&refreshCond);
+    pthread_mutex_unlock(&refreshLock);
+}
+
+static bool isCommandPosition(int start)
+{
+    int i = start - 1;
+
+    while (i >= 0 && (rl_line_buffer[i] == ' ' || rl_line_buffer[i] == '\t'))
+
+    {
+        i--;
+    }
+
+    return i < 0 || strchr("|;&(`{", rl_line_buffer[i]) != NULL;
+}
+
+static char *commandGenerator(const char *text, int state)
+{
+    static struct Matches matches = {NULL, 0, 0};
+    static int next = 0;
+
+    if (state == 0)
+
+    {
+        size_t len = strlen(text);
+        struct Buffer prefix = {NULL, 0, 0};
+
+        free(matches.names); // the names themselves were handed over to readline
+        matches.names = NULL;
+        matches.count = 0;
+        matches.capacity = 0;
+        next = 0;
+
+        bufferAppend(&prefix, text, len);
+        pthread_rwlock_rdlock(&trieLock);
+
+        struct TrieNode *node = &root;
+
+        for (size_t i = 0; i < len && node != NULL; i++)
+
+        {
+            node = node->child;
+
+            while (node != NULL && node->ch != text[i])
+
+            {
+                node = node->sibling;
+            }
+        }
+
+        if (node != NULL)
+
+        {
+            collectNames(node, &prefix, &matches);
+        }
+
+        pthread_rwlock_unlock(&trieLock);
+        free(prefix.data);
+
+        for (int i = 0; i < numOfAliases; i++)
+
+        {
+            if (strncmp(aliases[i].pair[0], text, len) == 0)
+
+            {
+                addMatch(&matches, aliases[i].pair[0]);
+            }
+        }
+
+        for (int i = 0; i < numOfFunctions; i++)
+
+        {
+            if (strncmp(functions[i].name, text, len) == 0)
+
+            {
+                addMatch(&matches, functions[i].name);
+            }
+        }
+    }
+
+    return (next < matches.count) ? matches.names[next++] : NULL;
+}
+
+static char **completeCommand(const char *text, int start, int end)
+{
+    (void) end;
+
+    if (!isCommandPosition(start) || strchr(text, '/') != NULL)
+
+    {
+        return NULL; // arguments and paths get readline's filename completion
+    }
+
+    requestRefresh();
+    return rl_completion_matches(text, commandGenerator);
+}
@@ -0,0 +1,636 @@
+/**
+ * @file historyindex.c
+ * @brief Trigram index over the history. Each distinct command is one entry (running it again bumps its use count
+ * and its recency), and each trigram maps to the ascending list of entries it occurs in, so adding an entry only
+ * appends to the lists of its own trigrams. A substring query of three bytes or more intersects the lists of its
+ * trigrams, starting from the shortest, and confirms the survivors with strstr(). Shorter and fuzzy queries check
+ * every entry, but a 128-bit mask of the bytes in each entry rejects most of them without touching the text.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "historyindex.h"
+#include "shell.h"
+#include "output.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <readline/readline.h>
+#include <readline/history.h>
+
+#define RECENCY_HALF_LIFE 100   // a command last run this many commands ago weighs half as much as one run just now
+#define DEFAULT_RESULTS 20      // hsearch without -n
+#define BROWSE_RESULTS 100      // matches Ctrl-R cycles through
+
+// ---- STRUCTS ----
+
+struct HistoryEntry
+{
+    char *line;
+    unsigned long long lastUse; // sequence number of the last time it was added
+    unsigned long long uses;
+};
+
+struct Postings
+{
+    uint32_t trigram;           // the three bytes plus one, 0 marks a free slot
+    int *ids;                   // entries containing the trigram, ascending
+    int count;
+    int capacity;
+};
+
+struct Match
+{
+    int id;
+    double score;
+};
+
+// ---- GLOBAL VARIABLES ----
+
+static struct HistoryEntry *entries = NULL;
+static int numOfEntries = 0;
+static int entriesCapacity = 0;
+static unsigned __int128 *byteMasks = NULL; // per entry, bit (c % 128) is set for every byte c of its line; apart so scans stay dense
+static unsigned long long sequence = 0;   // entries added so far, repeats included
+static int latest = -1;                     // the entry added last, the command that is running
+
+static int *lineSlots = NULL;               // open addressing from a line to its entry id plus one, 0 is free
+static int lineSlotsCapacity = 0;
+
+static struct Postings *trigrams = NULL;    // open addressing on the trigram
+static int trigramsCapacity = 0;
+static int numOfTrigrams = 0;
+
+// ---- FUNCTION DECLARATIONS ----
+
+static uint32_t hashBytes(const char *data, size_t len); //FNV-1a
+static int *lineSlot(const char *line); //the slot holding line's entry, or the free slot it would go in
+static struct Postings *postingsFor(uint32_t trigram, bool create); //the list of a trigram; without create a free slot (trigram 0) if there is none, NULL while the table is empty
+static uint32_t trigramAt(const char *ptr); //key of the trigram starting at ptr
+static unsigned __int128 byteMask(const char *str); //the bytes of str as a 128-bit mask, ASCII never collides
+static void indexEntry(int id); //adds an entry to the lists of its trigrams
+static bool hasPosting(struct Postings *list, int id); //binary search of a list
+static bool isSubsequence(const char *query, const char *line); //checks if the bytes of query occur in line in order
+static int compareMatches(const void *a, const void *b); //best score first, then the most recent
+static void keepMatch(struct Match *best, int *count, int limit, struct Match match); //adds a match to the best limit ones, kept as a heap with the worst on top
+static int searchHistory(const char *query, bool fuzzy, int skip, int limit, struct Match **matches); //the best limit (0: all) entries matching query, ranked, skip is an entry id to leave out
+static int reverseSearch(int count, int key); //Ctrl-R: incremental search over the ranked matches
+
+void addHistoryEntry(const char *line)
+{
+    add_history(line);
+    sequence++;
+
+    if (2 * (numOfEntries + 1) > lineSlotsCapacity) // at most half full
+
+    {
+        int oldCapacity = lineSlotsCapacity;
+        int *oldSlots = lineSlots;
+
+        lineSlotsCapacity = lineSlotsCapacity ? lineSlotsCapacity * 2 : 1024;
+        lineSlots = calloc(lineSlotsCapacity, sizeof(int));
+
+        for (int i = 0; i < oldCapacity; i++)
+
+        {
+            if (oldSlots[i] != 0)
+
+            {
+                *lineSlot(entries[oldSlots[i] - 1].line) = oldSlots[i];
+            }
+        }
+
+        free(oldSlots);
+    }
+
+    int *slot = lineSlot(line);
+
+    if (*slot != 0) // run before, only its rank changes
+
+    {
+        entries[*slot - 1].lastUse = sequence;
+        entries[*slot - 1].uses++;
+        latest = *slot - 1;
+        return;
+    }
+
+    if (numOfEntries == entriesCapacity)
+
+    {
+        entriesCapacity = entriesCapacity ? entriesCapacity * 2 : 256;
+        entries = realloc(entries, entriesCapacity * sizeof(struct HistoryEntry));
+        byteMasks = realloc(byteMasks, entriesCapacity * sizeof(unsigned __int128));
+    }
+
+    entries[numOfEntries] = (struct HistoryEntry) {strdup(line), sequence, 1};
+    byteMasks[numOfEntries] = byteMask(line);
+    *slot = numOfEntries + 1;
+    latest = numOfEntries;
+    indexEntry(numOfEntries++);
+}
+
+void initHistorySearch()
+{
+    rl_bind_key(CTRL('r'), reverseSearch);
+}
+
+int builtinHsearch(char **parsed)
+{
+    bool fuzzy = false;
+    long limit = DEFAULT_RESULTS;
+    int i = 1;
+
+    for (; parsed[i][0] == '-' && parsed[i][1] != '\0'; i++)
+
+    {
+        if (strcmp(parsed[i], "-f") == 0)
+
+        {
+            fuzzy = true;
+        }
+
+        else if (strcmp(parsed[i], "-n") == 0 && parsed[i + 1][0] != '\0')
+
+        {
+            char *end = NULL;
+            limit = strtol(wordValue(parsed[++i]), &end, 10);
+
+            if (*end != '\0' || limit < 0)
+
+            {
+                fprintf(stderr, "%s: hsearch: %s: invalid count\n", shellName, parsed[i]);
+                return 2;
+            }
+        }
+
+        else
+
+        {
+            break;
+        }
+    }
+
+    if (parsed[i][0] == '\0')
+
+    {
+        fprintf(stderr, "%s: hsearch: usage: hsearch [-f] [-n COUNT] PATTERN ...\n", shellName);
+        return 2;
+    }
+
+    struct Buffer query = {NULL, 0, 0}; // the words joined back together, as they would be typed
+
+    for (; parsed[i][0] != '\0'; i++)
+
+    {
+        char *word = wordValue(parsed[i]);
+        bufferAppend(&query, " ", (query.len > 0) ? 1 : 0);
+        bufferAppend(&query, word, strlen(word));
+    }
+
+    // the command running now was added to the history right before it started, it isn't a result
+    struct Match *matches = NULL;
+    int numOfMatches = searchHistory(query.data, fuzzy, latest, (int) limit, &matches);
+
+    for (int j = 0; j < numOfMatches; j++)
+
+    {
+        outWriteRef(entries[matches[j].id].line, strlen(entries[matches[j].id].line));
+        outWrite("\n", 1);
+    }
+
+    outFlush();
+    free(matches);
+    free(query.data);
+    return (numOfMatches > 0) ? 0 : 1;
+}
+
+static uint32_t hashBytes(const char *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+
+    {
+        hash = (hash ^ (unsigned char) data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static int *lineSlot(const char *line)
+{
+    int index = hashBytes(line, strlen(line)) & (lineSlotsCapacity - 1);
+
+    while (lineSlots[index] != 0 && strcmp(entries[lineSlots[index] - 1].line, line) != 0)
+
+    {
+        index = (index + 1) & (lineSlotsCapacity - 1);
+    }
+
+    return &lineSlots[index];
+}
+
+static struct Postings *postingsFor(uint32_t trigram, bool create)
+{
+    if (create && 2 * (numOfTrigrams + 1) > trigramsCapacity)
+
+    {
+        int oldCapacity = trigramsCapacity;
+        struct Postings *old = trigrams;
+
+        trigramsCapacity = trigramsCapacity ? trigramsCapacity * 2 : 4096;
+        trigrams = calloc(trigramsCapacity, sizeof(struct Postings));
+
+        for (int i = 0; i < oldCapacity; i++)
+
+        {
+            if (old[i].trigram != 0)
+
+            {
+                *postingsFor(old[i].trigram, false) = old[i]; // lands on the free slot the key would take
+            }
+        }
+
+        free(old);
+    }
+
+    if (trigramsCapacity == 0)
+
+    {
+        return NULL;
+    }
+
+    int index = (trigram * 2654435761u) & (trigramsCapacity - 1);
+
+    while (trigrams[index].trigram != 0 && trigrams[index].trigram != trigram)
+
+    {
+        index = (index + 1) & (trigramsCapacity - 1);
+    }
+
+    if (trigrams[index].trigram == 0 && create)
+
+    {
+        trigrams[index].trigram = trigram;
+        numOfTrigrams++;
+    }
+
+    return &trigrams[index];
+}
+
+static uint32_t trigramAt(const char *ptr)
+{
+    return (((uint32_t) (unsigned char) ptr[0] << 16) | ((uint32_t) (unsigned char) ptr[1] << 8) | (unsigned char) ptr[2]) + 1;
+}
+
+static unsigned __int128 byteMask(const char *str)
+{
+    unsigned __int128 mask = 0;
+
+    for (; *str != '\0'; str++)
+
+    {
+        mask |= (unsigned __int128) 1 << ((unsigned char) *str % 128);
+    }
+
+    return mask;
+}
+
+static void indexEntry(int id)
+{
+    const char *line = entries[id].line;
+    size_t len = strlen(line);
+
+    for (size_t i = 0; i + 3 <= len; i++)
+
+    {
+        struct Postings *list = postingsFor(trigramAt(line + i), true);
+
+        if (list->count > 0 && list->ids[list->count - 1] == id)
+
+        {
+            continue; // the trigram occurs twice in the line
+        }
+
+        if (list->count == list->capacity)
+
+        {
+            list->capacity = list->capacity ? list->capacity * 2 : 4;
+            list->ids = realloc(list->ids, list->capacity * sizeof(int));
+        }
+
+        list->ids[list->count++] = id;
+    }
+}
+
+static bool hasPosting(struct Postings *list, int id)
+{
+    int low = 0, high = list->count - 1;
+
+    while (low <= high)
+
+    {
+        int middle = low + (high - low) / 2;
+
+        if (list->ids[middle] == id)
+
+        {
+            return true;
+        }
+
+        if (list->ids[middle] < id)
+
+        {
+            low = middle + 1;
+        }
+
+        else
+
+        {
+            high = middle - 1;
+        }
+    }
+
+    return false;
+}
+
+static bool isSubsequence(const char *query, const char *line)
+{
+    for (; *query != '\0'; query++)
+
+    {
+        line = strchr(line, *query);
+
+        if (line == NULL)
+
+        {
+            return false;
+        }
+
+        line++;
+    }
+
+    return true;
+}
+
+static int compareMatches(const void *a, const void *b)
+{
+    const struct Match *x = a;
+    const struct Match *y = b;
+
+    if (x->score != y->score)
+
+    {
+        return (x->score < y->score) ? 1 : -1;
+    }
+
+    return (entries[x->id].lastUse < entries[y->id].lastUse) ? 1 : -1;
+}
+
+static void keepMatch(struct Match *best, int *count, int limit, struct Match match)
+{
+    if (limit == 0 || *count < limit)
+
+    {
+        int index = (*count)++;
+
+        for (; limit != 0 && index > 0 && compareMatches(&match, &best[(index - 1) / 2]) > 0; index = (index - 1) / 2)
+
+        {
+            best[index] = best[(index - 1) / 2];
+        }
+
+        best[index] = match;
+        return;
+    }
+
+    if (compareMatches(&match, &best[0]) >= 0)
+
+    {
+        return; // not better than the worst of the best
+    }
+
+    int index = 0;
+
+    while (true)
+
+    {
+        int worst = index;
+        const struct Match *worstMatch = &match; // the hole at index is waiting for match
+
+        for (int child = 2 * index + 1; child <= 2 * index + 2 && child < limit; child++)
+
+        {
+            if (compareMatches(&best[child], worstMatch) > 0)
+
+            {
+                worst = child;
+                worstMatch = &best[child];
+            }
+        }
+
+        if (worst == index)
+
+        {
+            break;
+        }
+
+        best[index] = best[worst];
+        index = worst;
+    }
+
+    best[index] = match;
+}
+
+static int searchHistory(const char *query, bool fuzzy, int skip, int limit, struct Match **matches)
+{
+    size_t len = strlen(query);
+    int numOfMatches = 0;
+    int *candidates = NULL;     // NULL: every entry is a candidate
+    int numOfCandidates = numOfEntries;
+    struct Postings **lists = NULL;
+    int numOfLists = 0;
+
+    if (!fuzzy && len >= 3)
+
+    {
+        lists = malloc((len - 2) * sizeof(struct Postings *));
+
+        for (size_t i = 0; i + 3 <= len; i++)
+
+        {
+            struct Postings *list = postingsFor(trigramAt(query + i), false);
+
+            if (list == NULL || list->trigram == 0)
+
+            {
+                free(lists);
+                *matches = NULL;
+                return 0; // a trigram no entry has
+            }
+
+            lists[numOfLists++] = list;
+        }
+
+        // the shortest list bounds the result, the others are only probed
+        for (int i = 1; i < numOfLists; i++)
+
+        {
+            if (lists[i]->count < lists[0]->count)
+
+            {
+                struct Postings *swap = lists[0];
+                lists[0] = lists[i];
+                lists[i] = swap;
+            }
+        }
+
+        candidates = lists[0]->ids;
+        numOfCandidates = lists[0]->count;
+    }
+
+    unsigned __int128 mask = byteMask(query);
+    int capacity = (limit > 0 && limit < numOfCandidates) ? limit : numOfCandidates;
+    *matches = malloc((capacity > 0 ? capacity : 1) * sizeof(struct Match));
+
+    for (int i = 0; i < numOfCandidates; i++)
+
+    {
+        int id = candidates ? candidates[i] : i;
+        struct HistoryEntry *entry = &entries[id];
+        bool found = id != skip && (byteMasks[id] & mask) == mask;
+
+        for (int j = 1; found && j < numOfLists; j++)
+
+        {
+            found = lists[j] == lists[0] || hasPosting(lists[j], id);
+        }
+
+        found = found && (fuzzy ? isSubsequence(query, entry->line) : strstr(entry->line, query) != NULL);
+
+        if (found)
+
+        {
+            double age = (double) (sequence - entry->lastUse);
+            keepMatch(*matches, &numOfMatches, limit, (struct Match) {id, entry->uses * RECENCY_HALF_LIFE / (RECENCY_HALF_LIFE + age)});
+        }
+    }
+
+    free(lists);
+    qsort(*matches, numOfMatches, sizeof(struct Match), compareMatches);
+    return numOfMatches;
+}
+
+static int reverseSearch(int count, int key)
+{
+    (void) count;
+    (void) key;
+
+    char *original = strdup(rl_line_buffer);
+    int originalPoint = rl_point;
+    struct Buffer query = {NULL, 0, 0};
+    struct Match *matches = NULL;
+    int numOfMatches = 0;
+    int current = 0;
+    bool fuzzy = false;
+
+    bufferAppend(&query, "", 0);
+    rl_save_prompt();
+
+    while (true)
+
+    {
+        const char *shown = (numOfMatches > 0) ? entries[matches[current].id].line : original;
+        const char *at = (numOfMatches > 0 && !fuzzy) ? strstr(shown, query.data) : NULL;
+
+        rl_message("(%s)`%s': ", fuzzy ? "fuzzy-search" : "reverse-i-search", query.data);
+        rl_replace_line(shown, 0);
+        rl_point = at ? (int) (at - shown) : (numOfMatches > 0) ? 0 : originalPoint;
+        rl_redisplay();
+
+        int c = rl_read_key();
+
+        if (c == CTRL('r'))
+
+        {
+            if (numOfMatches > 1)
+
+            {
+                current = (current + 1) % numOfMatches; // the next best match
+            }
+
+            else
+
+            {
+                rl_ding();
+            }
+
+            continue;
+        }
+
+        if (c == 127 || c == CTRL('h'))
+
+        {
+            query.len -= (query.len > 0);
+            query.data[query.len] = '\0';
+        }
+
+        else if (c >= 32 && c != 127)
+
+        {
+            char ch = (char) c;
+            bufferAppend(&query, &ch, 1);
+        }
+
+        else
+
+        {
+            // Ctrl-G gives the line back as it was, anything else keeps the match and is then handled as usual
+            rl_restore_prompt();
+            rl_clear_message();
+
+            if (c == CTRL('g'))
+
+            {
+                rl_replace_line(original, 0);
+                rl_point = originalPoint;
+            }
+
+            else if (c == '\r' || c == '\n')
+
+            {
+                rl_point = rl_end;
+                rl_newline(1, c);
+            }
+
+            else
+
+            {
+                rl_execute_next(c);
+            }
+
+            break;
+        }
+
+        free(matches);
+        matches = NULL;
+        numOfMatches = (query.len > 0) ? searchHistory(query.data, false, -1, BROWSE_RESULTS, &matches) : 0;
+        fuzzy = false;
+
+        if (numOfMatches == 0 && query.len > 0)
+
+        {
+            free(matches);
+            numOfMatches = searchHistory(query.data, true, -1, BROWSE_RESULTS, &matches);
+            fuzzy = numOfMatches > 0;
+        }
+
+        current = 0;
+    }
+
+    free(matches);
+    free(query.data);
+    free(original);
+    return 0;
+}
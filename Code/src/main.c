@@ -8,7 +8,22 @@
  * 
  */
 
-#include "utils.h"
+#define _GNU_SOURCE // memfd_create()
+
+#include "shell.h"
+#include "script.h"
+#include "arith.h"
+#include "builtins.h"
+#include "completion.h"
+#include "output.h"
+#include "pipes.h"
+#include "stats.h"
+#include "textutils.h"
+#include "historyindex.h"
+#include "spawn.h"
+#include "scan.h"
+#include "profile.h"
+#include "startup.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -19,39 +34,35 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <glob.h>
-
-// ---- STRUCTS ----
-
-struct Alias 
-{
-    char pair[2][100]; // pair[0] = name, pair[1] = value
-};
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <inttypes.h>
 
 // ---- GLOBAL VARIABLES ----
 
-struct Alias aliases[100]; // array of alias objects
+struct Alias *aliases = NULL; // array of alias objects, grown on demand (a generated rc file can define hundreds)
 int numOfAliases = 0; // number of alias objects
+int aliasesCapacity = 0;
+
+struct Variable *variables = NULL; // array of shell variables, grown on demand
+int numOfVariables = 0;
+int variablesCapacity = 0;
 
-// ---- FUNCTION DECLARATIONS ---- 
-
-int length(char arr[500][500]); // returns length of a 2D array
-void parser(char *inputArr, char parsed[500][500], bool flag); // parses the input string and stores it in parsed array
-void inputHandler(char parsed[500][500]); // handles IO redirection and aliases. Calls handleCommand() to execute the command.
-bool aliasExists(char *aliasName); //checks if alias exists in array of alias objects
-struct Alias* getAlias(char *aliasName); //searches for alias value using name in array of alias objects
-void deleteAlias(char *aliasName); //deletes alias from array of alias objects
-void addAlias(char *aliasName, char *aliasValue); //adds alias to array of alias objects
-void printAliases(); //prints all aliases in array of alias objects
-void launchScriptMode(char *fName); //launches the shell in script mode
-void launchInteractiveMode(); //launches the shell in interactive mode
-int getIndex(char *toFind, char parsed[500][500], int start); //returns the index of a string in a 2D array
-void handleCommand(char parsed[500][500]); //handles internal commands and external commands
-int countPipes(char parsed[500][500]); //counts the number of pipe symbols in a command
-void executePipeline(char parsed[500][500], char command[MAX_STRING_LENGTH]); //executes a pipeline of commands
-void getCommands(char command[MAX_STRING_LENGTH], char commands[100][MAX_STRING_LENGTH]); //splits a command into multiple commands based on pipe symbol
-bool isValidPipeline(char parsed[500][500], int numOfCommands); //pipeline input validation method
-void readFile(char* fName, char lines[100][MAX_STRING_LENGTH], int* lineCount); //reads a file and stores each line in an array
-void replaceWildcards(char parsed[500][500]); //replaces wildcard characters with matching filenames
+FILE *builtinOutput = NULL; // where builtins write to. NULL means stdout, a memstream while capturing $(...)
+
+struct Buffer heredocBody = {NULL, 0, 0}; // body of the heredoc of the command being executed, consumed by inputHandler()
+
+int lastStatus = 0; // exit status of the last command, $?
+char *shellName = "Shell"; // $0
+bool interactiveMode = false;
+bool expansionFailed = false; // an expansion went wrong ($((1/0))), the command it belongs to must not run
+bool tailCallPending = false;
+int *substitutionFds = NULL; // our ends of the pipes of <(...) and >(...) words, open until their command is done
+int numOfSubstitutions = 0;
+char **positionalParams = NULL; // $1, $2, ...
+int numOfPositionalParams = 0;
 
 /**
  * @brief This is the main function for the shell. It contains the main loop that runs the shell.
@@ -59,24 +70,38 @@ void replaceWildcards(char parsed[500][500]); //replaces wildcard characters wit
  * @return int 
  */
 
+#ifndef SHELL_LIBRARY // the library build (make bench) links these functions into other programs
+
 int main(int argc, char *argv[100])
 {
+    initStats(); // before the first fork, every child must inherit the shared counters
+
     if (argc == 2)
     
     {
+        shellName = argv[1];
         launchScriptMode(argv[1]); // launch the shell in script mode with script name as argument.
     }
 
+    if (argc == 3 && strncmp(argv[1], "--profile", 9) == 0 && (argv[1][9] == '\0' || argv[1][9] == '='))
+
+    {
+        shellName = argv[2];
+        launchProfileMode(argv[2], argv[1][9] == '=' ? argv[1] + 10 : NULL); // --profile[=FILE] script
+    }
+
     if (argc == 1)
 
     {
         launchInteractiveMode(); // launch the shell in interactive mode
     }
 
-    return 0;
+    return lastStatus;
 }
 
-int length(char arr[500][500])
+#endif // SHELL_LIBRARY
+
+int length(char **arr)
 {
     int i = 0;
     
@@ -89,12 +114,16 @@ int length(char arr[500][500])
     return i;
 }
 
-void parser(char *inputArr, char parsed[500][500], bool flag) 
+void parser(char *inputArr, struct Words *parsed, bool flag) 
 {
     // if flag is true, drop quotes during parsing, if flag is false, leave quotes in the parsed array
 
+    struct Buffer text = {NULL, 0, 0}; // the words one after another, each with its null terminator
+    size_t *offsets = NULL; // where each word starts in text, text moves while it grows
+    int capacity = 0;
     int index = 0;
     char *traverse, *head, *tail = NULL; // Pointers to the start and end of a token and the current position in the input string
+    char *end = inputArr + strlen(inputArr); // the delimiter scans are bounded by this rather than looking for the null terminator
     traverse = inputArr; // Start position pointer from the beginning of the input string
 
     while (*traverse != '\0') 
@@ -106,16 +135,25 @@ void parser(char *inputArr, char parsed[500][500], bool flag)
             traverse++; // skip leading whitespaces
         }
 
+        if (*traverse == '\0')
+
+        {
+            break; // only trailing whitespace was left
+        }
+
         head = traverse; // start from the first non-whitespace character
         tail = NULL;
+        bool quoted = false;
+        char quote = '\0';
 
         if (*traverse == '\"' || *traverse == '\'') 
         
         {
-            char quote = *traverse;
+            quote = *traverse;
             traverse++; // move to the character after the quote
             head = traverse; // start from the character after the quote
-            tail = strchr(traverse, quote); // find the ending quote
+            tail = (quote == '\"') ? closingQuote(traverse) : strchr(traverse, quote); // find the ending quote
+            quoted = true;
             
             if (tail == NULL)
             
@@ -130,973 +168,2805 @@ void parser(char *inputArr, char parsed[500][500], bool flag)
                 tail++; // include the ending quote in the token
             }
             
-            traverse = tail + 1; // move traverse to the character after the ending quote
+            traverse = (flag ? tail + 1 : tail); // move traverse to the character after the ending quote
         } 
         
         else 
         
         {
-            tail = strchr(head, ' '); // find the next whitespace
-            
-            if (tail == NULL) 
-            
-            {
-                tail = strchr(head, '\0'); // if no whitespace, find the null terminator
-            }
-
+            tail = tokenEnd(head, end); // find the next whitespace that isn't inside quotes, $(...) or `...`
             traverse = tail; // nove position pointer  to the next whitespace or null terminator
         }
         
         int length = (tail && head) ? tail - head : 0; // calculate the length of the token (tail - head) if both are not null, otherwise 0
-        strncpy(parsed[index], head, length); // copy the token to the parsed array 
-        parsed[index][length] = '\0'; // null termination
-        
-        index++; 
-    }
-}
-
-bool aliasExists(char *aliasName)
-{
-    for (int i = 0; i < numOfAliases; i++) // iterate over complete alias objects array to find if alias for cmd exists
 
-    {
-        if (strcmp(aliases[i].pair[0], aliasName) == 0) 
+        if (index == capacity)
 
         {
-            return true;
+            capacity = capacity ? capacity * 2 : 64;
+            offsets = realloc(offsets, capacity * sizeof(size_t));
         }
-    }
-
-    return false;
-}
 
-void printAliases()
-{
-    for (int i = 0; i < numOfAliases; i++)
+        offsets[index] = text.len;
+        bufferAppend(&text, head, length); // copy the token, dropping quotes below only makes it shorter
+        char *word = text.data + offsets[index];
 
-    {
-        printf("%s='%s'\n", aliases[i].pair[0], aliases[i].pair[1]);
-    }
-}
+        if (flag && !quoted)
 
-struct Alias* getAlias(char *aliasName)
-{
-    if (aliasExists(aliasName))
+        {
+            removeQuotes(word, head, length); // quotes and escapes embedded in the word, e.g. x="a b"
+        }
 
-    {
-        for (int i = 0; i < numOfAliases; i++)
+        else if (flag && quote == '\"')
 
         {
-            if (strcmp(aliases[i].pair[0], aliasName) == 0)
-
-            {
-                return &aliases[i];
-            }
+            unescapeDouble(word, head, length); // \$ \` \" and \\ stand for the character itself
         }
-    }
 
-    return NULL;
-}
-
-void deleteAlias(char *aliasName)
-{
-    for (int i = 0; i < numOfAliases; i++)
+        text.len = offsets[index] + strlen(word);
 
-    {
-        if (strcmp(aliases[i].pair[0], aliasName) == 0)
+        if (flag && word[0] == '\0')
 
         {
-            for (int j = i; j < numOfAliases - 1; j++)
+            bufferAppend(&text, EMPTY_WORD, strlen(EMPTY_WORD)); // "" is still an argument, an empty string would end the list
+        }
 
-            {
-                aliases[j] = aliases[j + 1]; //shift obj to be deleted to end of array 
-            }
+        bufferAppend(&text, "", 1); // the word's null terminator, the next word starts after it
+        index++; 
+    }
 
-            numOfAliases--;
+    char **words = malloc((index + 1) * sizeof(char *));
 
-            memset(aliases[numOfAliases].pair[0], '\0', sizeof(aliases[numOfAliases].pair[0])); 
-            memset(aliases[numOfAliases].pair[1], '\0', sizeof(aliases[numOfAliases].pair[1]));
-        }
+    for (int i = 0; i < index; i++)
+
+    {
+        words[i] = text.data + offsets[i];
     }
+
+    words[index] = ""; // terminate the list
+    setWords(parsed, words, index);
+
+    free(words);
+    free(offsets);
+    free(text.data);
 }
 
-void addAlias(char *aliasName, char *aliasValue)
+void setWords(struct Words *words, char **list, int count)
 {
-    if (aliasExists(aliasName))
+    size_t size = (count + 1) * sizeof(char *) + 1; // the pointers and the empty string that ends the list
+
+    for (int i = 0; i < count; i++)
 
     {
-        LOG_ERROR("Alias already exists!\n");
+        size += strlen(list[i]) + 1;
     }
 
-    else
+    char **block = malloc(size); // one block, so a list is freed at once however it was cut up in the meantime
+    char *text = (char *) (block + count + 1);
+
+    for (int i = 0; i < count; i++)
 
     {
-        strcpy(aliases[numOfAliases].pair[0], aliasName);
-        strcpy(aliases[numOfAliases].pair[1], aliasValue);
-        numOfAliases++;
+        size_t len = strlen(list[i]) + 1;
+        block[i] = memcpy(text, list[i], len);
+        text += len;
     }
+
+    *text = '\0';
+    block[count] = text;
+
+    free(words->list); // only now, list may point into it
+    words->list = block;
 }
 
-void readFile(char* fName, char lines[100][MAX_STRING_LENGTH], int* lineCount) 
+void freeWords(struct Words *words)
 {
-    FILE* file = fopen(fName, "r");
-    
-    if (!file) 
-    
-    {
-        perror("Error opening file");
-        exit(1);
-    }
+    free(words->list);
+    words->list = NULL;
+}
+
+void dropWords(char **parsed, int start, int count)
+{
+    int total = length(parsed);
 
-    *lineCount = 0;
-    ssize_t read;
-    size_t len = 0; // This should be size_t, not int
-    char* line = NULL;
+    if (start + count > total)
 
-    while ((read = getline(&line, &len, file)) != -1) //iterate over the complete file and store each line in an array of inpuuts to execute until no more lines to get.
-    
     {
-        if (line[read - 1] == '\n') 
-        
-        {
-            line[read - 1] = '\0'; // remove newline character at the end if it exists
-        }
-        
-        strcpy(lines[*lineCount], line); // cpy the read line into the lines array
-        
-        (*lineCount)++;
+        count = total - start;
     }
 
-    free(line); 
-    fclose(file);
+    memmove(parsed + start, parsed + start + count, (total - start - count + 1) * sizeof(char *)); // the terminator moves too
 }
 
-void launchScriptMode(char *fName) 
+char *matchingParen(char *open)
 {
-    using_history();
+    int depth = 0;
+    char *ptr = open;
 
-    char commands[100][MAX_STRING_LENGTH] = {'\0'};
-    int numOfCommands = 0;
+    while (*ptr != '\0')
+
+    {
+        if (*ptr == '\\' && ptr[1] != '\0')
 
-    readFile(fName, commands, &numOfCommands);
+        {
+            ptr += 2;
+            continue;
+        }
 
-    for (int i = 0; i < numOfCommands; i++)
+        if (*ptr == '\'' || *ptr == '\"' || *ptr == '`')
 
-    {
-        char parsed[500][500] = {'\0'};
-        
-        add_history(commands[i]);
-        
-        parser(commands[i], parsed, false);
+        {
+            char *close = (*ptr == '\"') ? closingQuote(ptr + 1) : strchr(ptr + 1, *ptr); // nested $(...) in quotes
+            ptr = close ? close + 1 : ptr + 1;
+            continue;
+        }
 
-        if (countPipes(parsed) > 0)
+        if (*ptr == '(')
 
         {
-            executePipeline(parsed, commands[i]);
+            depth++;
         }
 
-        else 
+        else if (*ptr == ')')
 
         {
-            inputHandler(parsed);
+            depth--;
+
+            if (depth == 0)
+
+            {
+                return ptr + 1;
+            }
         }
+
+        ptr++;
     }
+
+    return ptr; // unbalanced, the rest of the line belongs to the substitution
 }
 
-void launchInteractiveMode()
+char *tokenEnd(char *start, char *end)
 {
-    using_history(); 
+    char *ptr = start;
 
-    while (1)
+    while (ptr < end)
 
     {
-        char *userInput = NULL;
-        char inputArr[MAX_STRING_LENGTH] = "";
-        char parsed[500][500] = {'\0'};
+        ptr = (char *) findAny(ptr, end - ptr, " \\'\"`$<>"); // the only bytes that end a word or open something spaces can't end
 
-        userInput = readline("$ ");
+        if (ptr == NULL || *ptr == ' ')
 
-        if (userInput == NULL) 
-        
         {
-            break;   
+            break;
         }
 
-        else 
+        if (*ptr == '\\' && ptr[1] != '\0')
 
         {
-            add_history(userInput); // adding the input command to history
-         
-            strcpy(inputArr, userInput); // copy the input string to arr and free the input buffer 
-            free(userInput);
-   
-            parser(inputArr, parsed, false); // parse the input string and store it in parsed array
+            ptr += 2; // escaped character, never a delimiter
+        }
 
-            if (countPipes(parsed) > 0)
+        else if (*ptr == '\'' || *ptr == '\"' || *ptr == '`')
 
-            {
-                executePipeline(parsed, inputArr);
-            }
+        {
+            char *close = (*ptr == '\"') ? closingQuote(ptr + 1) : strchr(ptr + 1, *ptr);
+            ptr = close ? close + 1 : ptr + 1; // an unmatched quote is just a regular character
+        }
 
-            else 
+        else if ((*ptr == '$' || *ptr == '<' || *ptr == '>') && ptr[1] == '(')
 
-            {
-                inputHandler(parsed);
-            }
+        {
+            ptr = matchingParen(ptr + 1); // $(...), <(...) and >(...) are one word however many spaces they hold
         }
-    }
-}
 
-int getIndex(char *toFind, char parsed[500][500], int start)
-{
-    for (int i = start; i < length(parsed); i++)
+        else if (*ptr == '$' && ptr[1] == '{' && closingBrace(ptr + 2) != NULL)
 
-    {
-        if (strcmp(parsed[i], toFind) == 0)
+        {
+            ptr = closingBrace(ptr + 2) + 1; // so is ${name:-a word}
+        }
+
+        else
 
         {
-            return i;
+            ptr++;
         }
     }
 
-    return -1;
+    return (ptr == NULL) ? end : ptr;
 }
 
-int countPipes(char parsed[500][500])
-{    
-    int count = 0;
+void removeQuotes(char *dest, char *src, int len)
+{
+    int j = 0;
 
-    for (int i = 0; i < length(parsed); i++)
+    for (int i = 0; i < len; i++)
 
     {
-        if (strcmp(parsed[i], "|") == 0)
+        if (src[i] == '\\' && i + 1 < len)
 
         {
-            count++;
+            dest[j++] = src[++i];
         }
-    }
 
-    return count;
-}
+        else if (src[i] == '\'' || src[i] == '\"')
 
-void getCommands(char command[MAX_STRING_LENGTH], char commands[100][MAX_STRING_LENGTH]) 
-{
-    int index = 0;
-    int inQuotes = 0; // flag to check if the current character is inside quotes
-    char *start = command; // pointer to the start of a command
-    
-    for (char *ptr = command; *ptr != '\0'; ptr++) 
-    
-    {
-        if (*ptr == '\"') 
-        
         {
-            inQuotes = !inQuotes; 
-        } 
-        
-        else if (*ptr == '|' && !inQuotes) 
-        
-        {
-            *ptr = '\0'; // replace the pipe character with null terminator to split the string
-            
-            while (*start == ' ') 
-            
+            char *close = (src[i] == '\'') ? memchr(src + i + 1, src[i], len - i - 1) : closingQuote(src + i + 1);
+
+            if (close == NULL || close >= src + len)
+
             {
-                start++; // Remove leading and trailing whitespaces from the token
+                dest[j++] = src[i]; // unmatched quote, keep it as is
+                continue;
             }
 
-            char *end = ptr - 1;
-            
-            while (end > start && *end == ' ') 
-            
+            int end = close - src;
+
+            if (src[i] == '\"')
+
             {
-                end--;
+                unescapeDouble(dest + j, src + i + 1, end - i - 1);
+                j += strlen(dest + j);
             }
-            
-            *(end + 1) = '\0';
-            strncpy(commands[index], start, MAX_STRING_LENGTH - 1); // copy the token to the commands array and null terminate it
-            commands[index][MAX_STRING_LENGTH - 1] = '\0'; 
-            
-            start = ptr + 1; // move the start pointer to the next character after the pipe
-            index++;
+
+            else
+
+            {
+                memcpy(dest + j, src + i + 1, end - i - 1);
+                j += end - i - 1;
+            }
+
+            i = end;
+        }
+
+        else
+
+        {
+            dest[j++] = src[i];
         }
     }
-    
-    // Handle the last command
-    // Remove leading and trailing whitespaces from the token
-    while (*start == ' ') start++; // leading
-    char *end = start + strlen(start) - 1;
-    while (end > start && *end == ' ') end--; // trailing
-    *(end + 1) = '\0';
-    
-    // Copy the last token to the commands array
-    strncpy(commands[index], start, MAX_STRING_LENGTH - 1);
-    commands[index][MAX_STRING_LENGTH - 1] = '\0'; // Ensure null-termination
+
+    dest[j] = '\0';
 }
 
-void executePipeline(char parsed[500][500], char command[MAX_STRING_LENGTH])
+char *closingQuote(char *start)
 {
-    const int numOfCommands = countPipes(parsed) + 1;
-    int pipes[numOfCommands - 1][2];
-    char commandList[100][MAX_STRING_LENGTH] = {"0"}; 
-    getCommands(command, commandList);
+    char *ptr = start;
 
-    if (!isValidPipeline(parsed, numOfCommands)) 
-    
-    {
-        perror("ERR_INVALID_PIPELINE");
-        return;
-    }
+    while (*ptr != '\0' && *ptr != '\"')
 
-    for (int i = 0; i < numOfCommands - 1; i++) 
-    
     {
-        pipe(pipes[i]);
-    }
+        if (*ptr == '$' && ptr[1] == '(')
 
-    for (int i = 0; i < numOfCommands; i++) 
-    
-    {
-        int rc = fork();
-        
-        if (rc < 0) 
-        
         {
-            perror("ERR_FORK_FAILED");
-            exit(1);
-        } 
-        
-        if (rc == 0) 
-        
+            ptr = matchingParen(ptr + 1); // "a $(echo "b c") d" is one string, the inner quotes belong to the substitution
+        }
+
+        else if (*ptr == '`')
+
         {
-            if (i > 0)
-            
-            {
-                dup2(pipes[i-1][0], STDIN_FILENO);
-            }
-            
-            if (i < numOfCommands - 1)
-            
-            {
-                dup2(pipes[i][1], STDOUT_FILENO);
-            }
+            char *close = ptr + 1;
+
+            while (*close != '\0' && *close != '`')
 
-            for (int j = 0; j < numOfCommands - 1; j++)
-            
             {
-                close(pipes[j][1]);
-                close(pipes[j][0]);
+                close += (*close == '\\' && close[1] != '\0') ? 2 : 1;
             }
 
-            char parsedCommand[500][500] = {"\0"}; 
-            parser(commandList[i], parsedCommand, false);
-            inputHandler(parsedCommand);
-            exit(0);
-        } 
-    }
-
-    for (int i = 0; i < numOfCommands - 1; i++)
-    
-    {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
+            ptr = (*close != '\0') ? close + 1 : ptr + 1;
+        }
 
-        if (i < numOfCommands)
+        else
 
         {
-            wait(NULL);
+            ptr += (*ptr == '\\' && ptr[1] != '\0') ? 2 : 1; // \" doesn't end the string
         }
     }
+
+    return (*ptr == '\"') ? ptr : NULL;
 }
 
-bool isValidPipeline(char parsed[500][500], int numOfCommands)
+char *closingBrace(char *start)
 {
-    int flagwCount = 0;
-    int flagaCount = 0;
-    int flagrCount = 0;
-    int pipeCount = 0;
+    int depth = 0;
+
+    for (char *ptr = start; *ptr != '\0'; ptr++)
 
-    for (int i = 0; i < length(parsed); i++)
-    
     {
-        if (strcmp(parsed[i], ">") == 0)
-       
+        if (*ptr == '\\' && ptr[1] != '\0')
+
         {
-            flagwCount++;
+            ptr++;
         }
-       
-        else if (strcmp(parsed[i], ">>") == 0)
-       
+
+        else if (*ptr == '\'' || *ptr == '\"')
+
         {
-            flagaCount++;
+            char *close = (*ptr == '\'') ? strchr(ptr + 1, '\'') : closingQuote(ptr + 1);
+            ptr = close ? close : ptr; // ${v:-"}"} ends at the last brace
         }
-       
-        else if (strcmp(parsed[i], "<") == 0)
-       
+
+        else if (*ptr == '$' && ptr[1] == '(')
+
         {
-            flagrCount++;
+            ptr = matchingParen(ptr + 1) - 1;
         }
-       
-        else if (strcmp(parsed[i], "|") == 0)
-       
+
+        else if (*ptr == '$' && ptr[1] == '{')
+
         {
-            pipeCount++;
+            depth++;
+            ptr++;
         }
 
-        if (pipeCount > 0 && pipeCount < numOfCommands - 1 && (strcmp(parsed[i], "<") == 0 || strcmp(parsed[i], ">>") == 0 || strcmp(parsed[i], ">") == 0))
+        else if (*ptr == '}' && depth-- == 0)
+
+        {
+            return ptr;
+        }
+    }
+
+    return NULL;
+}
+
+void unescapeDouble(char *dest, char *src, int len)
+{
+    int j = 0;
+
+    for (int i = 0; i < len; i++)
+
+    {
+        if (src[i] == '\\' && i + 1 < len && strchr("\\\"$`", src[i + 1]) != NULL)
+
+        {
+            i++; // other backslashes inside double quotes are kept, like in any POSIX shell
+        }
+
+        dest[j++] = src[i];
+    }
+
+    dest[j] = '\0';
+}
+
+bool aliasExists(char *aliasName)
+{
+    for (int i = 0; i < numOfAliases; i++) // iterate over complete alias objects array to find if alias for cmd exists
+
+    {
+        if (strcmp(aliases[i].pair[0], aliasName) == 0) 
+
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void printAliases()
+{
+    for (int i = 0; i < numOfAliases; i++)
+
+    {
+        outPrintf("%s='%s'\n", aliases[i].pair[0], aliases[i].pair[1]);
+    }
+}
+
+struct Alias* getAlias(char *aliasName)
+{
+    if (aliasExists(aliasName))
+
+    {
+        for (int i = 0; i < numOfAliases; i++)
+
+        {
+            if (strcmp(aliases[i].pair[0], aliasName) == 0)
+
+            {
+                return &aliases[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void deleteAlias(char *aliasName)
+{
+    for (int i = 0; i < numOfAliases; i++)
+
+    {
+        if (strcmp(aliases[i].pair[0], aliasName) == 0)
+
+        {
+            for (int j = i; j < numOfAliases - 1; j++)
+
+            {
+                aliases[j] = aliases[j + 1]; //shift obj to be deleted to end of array 
+            }
+
+            numOfAliases--;
+
+            memset(aliases[numOfAliases].pair[0], '\0', sizeof(aliases[numOfAliases].pair[0])); 
+            memset(aliases[numOfAliases].pair[1], '\0', sizeof(aliases[numOfAliases].pair[1]));
+        }
+    }
+}
+
+void addAlias(char *aliasName, char *aliasValue)
+{
+    if (aliasExists(aliasName))
+
+    {
+        LOG_ERROR("Alias already exists!\n");
+    }
+
+    else
+
+    {
+        if (numOfAliases == aliasesCapacity)
+
+        {
+            aliasesCapacity = aliasesCapacity ? aliasesCapacity * 2 : 64;
+            aliases = realloc(aliases, aliasesCapacity * sizeof(struct Alias));
+        }
+
+        strcpy(aliases[numOfAliases].pair[0], aliasName);
+        strcpy(aliases[numOfAliases].pair[1], aliasValue);
+        numOfAliases++;
+    }
+}
+
+char *readFile(char* fName) 
+{
+    FILE* file = fopen(fName, "r");
+    
+    if (!file) 
+    
+    {
+        perror("Error opening file");
+        exit(1);
+    }
+
+    struct Buffer contents = {NULL, 0, 0};
+    char chunk[4096];
+    size_t read;
+
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) // the whole script is compiled at once, so keep it all in memory
+    
+    {
+        bufferAppend(&contents, chunk, read);
+    }
+
+    fclose(file);
+
+    return contents.data ? contents.data : strdup("");
+}
+
+void launchScriptMode(char *fName) 
+{
+    using_history();
+
+    char *source = readFile(fName);
+
+    runSource(source, true); // every complete command is added to the history right before it runs
+    free(source);
+}
+
+void launchProfileMode(char *fName, char *output)
+{
+    startProfile(fName, output); // the report and the folded stacks are written when the shell exits
+    launchScriptMode(fName);
+}
+
+void launchInteractiveMode()
+{
+    using_history(); 
+    interactiveMode = true;
+    initCompletion(); // Tab completes command names from a PATH index built in the background
+    initHistorySearch(); // Ctrl-R searches a trigram index of the history
+    loadStartupFile(); // ~/.shellrc, or its snapshot when the rc file hasn't changed since it was taken
+
+    struct Buffer input = {NULL, 0, 0};
+
+    while (1)
+
+    {
+        char *userInput = NULL;
+
+        userInput = readline(input.len == 0 ? "$ " : "> "); // "> " while an if, loop, heredoc, ... is still open
+
+        if (userInput == NULL) 
+        
+        {
+            break;   
+        }
+
+        bufferAppend(&input, userInput, strlen(userInput));
+        bufferAppend(&input, "\n", 1);
+        free(userInput);
+
+        int status = checkComplete(input.data);
+
+        if (status == COMPILE_INCOMPLETE)
+
+        {
+            continue;
+        }
+
+        input.data[input.len - 1] = '\0';
+        addHistoryEntry(input.data); // adding the input command to history (and to the search index)
+
+        if (status == COMPILE_OK)
+
+        {
+            runSource(input.data, false);
+        }
+
+        input.len = 0;
+    }
+
+    free(input.data);
+}
+
+int getIndex(char *toFind, char **parsed, int start)
+{
+    for (int i = start; parsed[i][0] != '\0'; i++)
+
+    {
+        if (strcmp(parsed[i], toFind) == 0)
+
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int countPipes(char **parsed)
+{    
+    int count = 0;
+
+    for (int i = 0; parsed[i][0] != '\0'; i++)
+
+    {
+        if (strcmp(parsed[i], "|") == 0)
+
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void executePipeline(char **words, int numOfWords)
+{
+    char *prefix = (numOfWords > 1 && strncmp(words[0], "PIPESIZE=", 9) == 0) ? words[0] : NULL; // PIPESIZE=4M cmd | cmd
+
+    if (prefix != NULL)
+
+    {
+        words++;
+        numOfWords--;
+    }
+
+    if (!isValidPipeline(words, numOfWords)) 
+    
+    {
+        perror("ERR_INVALID_PIPELINE");
+        return;
+    }
+
+    long size = pipeSize(prefix);
+    long pipeBytes = 0; // capacity the kernel actually gave the first pipe
+    bool verbose = isVerbose();
+    int prevRead = -1; // read end of the previous stage's pipe, the only pipe fd the shell holds between two forks
+    int numOfStages = 0;
+    int capacity = 0;
+    pid_t *pids = NULL;
+    long long *started = NULL; // fork times, for the spawn latency histogram
+    struct StageStats *stats = NULL;
+    bool forkFailed = false;
+    int stage = 0; // index of the first word of the stage being started
+
+    outFlush();
+    beginPipeline();
+
+    while (stage <= numOfWords)
+
+    {
+        int stageEnd = stage;
+
+        while (stageEnd < numOfWords && strcmp(words[stageEnd], "|") != 0)
+
+        {
+            stageEnd++;
+        }
+
+        bool next = (stageEnd < numOfWords);
+        int fds[2] = {-1, -1};
+
+        // pipes are made one stage at a time, so a long pipeline never has more than three pipe fds open at once
+        if (next && pipe2(fds, O_CLOEXEC) < 0)
+
+        {
+            perror("ERR_PIPE_FAILED");
+            break;
+        }
+
+        if (next)
+
+        {
+            long bytes = resizePipe(fds[PIPE_WRITE_END], size);
+            pipeBytes = pipeBytes ? pipeBytes : bytes;
+        }
+
+        int rc = spawnProcess();
+        long long forkTime = spawnStarted();
+
+        if (rc < 0) // the stages already started see the pipe close and finish, the pipeline fails
+
+        {
+            perror("ERR_FORK_FAILED");
+            forkFailed = true;
+            close(fds[PIPE_READ_END]);
+            close(fds[PIPE_WRITE_END]);
+            break;
+        }
+
+        if (rc == 0)
+
+        {
+            if (prevRead != -1)
+
+            {
+                dup2(prevRead, STDIN_FILENO); // dup2() clears O_CLOEXEC on the copy
+                close(prevRead);
+            }
+
+            if (fds[PIPE_WRITE_END] != -1)
+
+            {
+                dup2(fds[PIPE_WRITE_END], STDOUT_FILENO);
+                close(fds[PIPE_WRITE_END]);
+                close(fds[PIPE_READ_END]);
+            }
+
+            struct Words parsedCommand = {NULL};
+            setWords(&parsedCommand, words + stage, stageEnd - stage);
+            tailCallPending = true; // an external command replaces this child instead of being forked from it
+            inputHandler(&parsedCommand);
+            outFlush();
+            exit(lastStatus);
+        }
+
+        if (prevRead != -1)
+
+        {
+            close(prevRead);
+        }
+
+        if (fds[PIPE_WRITE_END] != -1)
+
+        {
+            close(fds[PIPE_WRITE_END]);
+        }
+
+        prevRead = fds[PIPE_READ_END];
+
+        if (numOfStages == capacity)
+
+        {
+            capacity = capacity ? capacity * 2 : 8;
+            pids = realloc(pids, capacity * sizeof(pid_t));
+            started = realloc(started, capacity * sizeof(long long));
+            stats = verbose ? realloc(stats, capacity * sizeof(struct StageStats)) : NULL;
+        }
+
+        if (verbose)
+
+        {
+            struct Buffer name = {NULL, 0, 0};
+
+            for (int i = stage; i < stageEnd; i++)
+
+            {
+                bufferAppend(&name, words[i], strlen(words[i]));
+                bufferAppend(&name, " ", (i < stageEnd - 1) ? 1 : 0);
+            }
+
+            stats[numOfStages].name = name.data ? name.data : strdup("");
+        }
+
+        STATS_ADD(pipelineStages, 1);
+        started[numOfStages] = forkTime;
+        pids[numOfStages++] = rc;
+        stage = stageEnd + 1;
+    }
+
+    endPipeline();
+
+    if (prevRead != -1)
+
+    {
+        close(prevRead);
+    }
+
+    for (int i = 0; i < numOfStages; i++)
+
+    {
+        struct rusage usage;
+        int status = waitStage(pids[i], verbose ? &stats[i] : NULL, &usage);
+        spawnExited(SPAWN_STAGE, started[i], &usage); // reaped in order, a stage that ends early waits for the ones before it
+
+        if (i == numOfStages - 1)
+
+        {
+            setStatus(status); // the pipeline's status is the status of its last command
+        }
+    }
+
+    if (forkFailed)
+
+    {
+        lastStatus = 1;
+    }
+
+    if (verbose)
+
+    {
+        reportPipeline(stats, numOfStages, pipeBytes);
+    }
+
+    for (int i = 0; verbose && i < numOfStages; i++)
+
+    {
+        free((char *) stats[i].name);
+    }
+
+    free(pids);
+    free(started);
+    free(stats);
+}
+
+bool isValidPipeline(char **words, int numOfWords)
+{
+    int flagwCount = 0;
+    int flagaCount = 0;
+    int flagrCount = 0;
+    int numOfPipes = 0;
+    int pipeCount = 0;
+
+    for (int i = 0; i < numOfWords; i++)
+
+    {
+        if (strcmp(words[i], "|") == 0)
+
+        {
+            numOfPipes++;
+        }
+    }
+
+    for (int i = 0; i < numOfWords; i++)
+    
+    {
+        if (strcmp(words[i], ">") == 0)
+       
+        {
+            flagwCount++;
+        }
+       
+        else if (strcmp(words[i], ">>") == 0)
+       
+        {
+            flagaCount++;
+        }
+       
+        else if (strcmp(words[i], "<") == 0)
+       
+        {
+            flagrCount++;
+        }
+       
+        else if (strcmp(words[i], "|") == 0)
+       
+        {
+            pipeCount++;
+        }
+
+        if (pipeCount > 0 && pipeCount < numOfPipes && (strcmp(words[i], "<") == 0 || strcmp(words[i], ">>") == 0 || strcmp(words[i], ">") == 0))
        
         {
-            LOG_ERROR("Invalid Pipe Error: Middle commands cannot have IO redirections!\n");
-            return false;
+            LOG_ERROR("Invalid Pipe Error: Middle commands cannot have IO redirections!\n");
+            return false;
+        }
+    }
+
+    // if the pipeline starts or ends with a pipe symbol
+    if (numOfWords == 0 || strcmp(words[0], "|") == 0 || strcmp(words[numOfWords - 1], "|") == 0)
+    {
+        LOG_ERROR("Invalid Pipe Error: Number of pipes must be one less than the number of commands.!\n");
+        return false;
+    }
+
+    // if there are multiple input or output redirections
+    if (flagwCount > 1 || flagaCount > 1 || flagrCount > 1)
+    {
+        LOG_ERROR("Invalid Pipe Error: Multiple IO redirection operators!\n");
+        return false;
+    }
+
+    // if both output redirections are present
+    if (flagwCount > 0 && flagaCount > 0)
+    {
+        LOG_ERROR("Invalid Pipe Error: Both output redirections present!\n");
+        return false;
+    }
+
+    return true;
+}
+
+void handleCommand(struct Words *command)
+{
+    char **parsed = command->list;
+    bool tailCall = tailCallPending; // taken now, $(...) in the words must not inherit it
+    tailCallPending = false;
+    int substitutionMark = numOfSubstitutions; // <(...) words of this command are closed once it is done
+
+    if (isAssignment(parsed[0]))
+
+    {
+        bool onlyAssignments = true;
+
+        for (int i = 0; parsed[i][0] != '\0'; i++)
+
+        {
+            onlyAssignments = onlyAssignments && isAssignment(parsed[i]);
+        }
+
+        if (onlyAssignments) // NAME=value [NAME=value ...], values are expanded but never split
+
+        {
+            for (int i = 0; parsed[i][0] != '\0'; i++)
+
+            {
+                char *eq = strchr(parsed[i], '=');
+                char *expanded = expandWord(eq + 1, EXPAND_WORD);
+                char *value = malloc(strlen(expanded) + 1);
+
+                *eq = '\0';
+                removeQuotes(value, expanded, strlen(expanded));
+                setVariable(parsed[i], value);
+
+                free(value);
+                free(expanded);
+            }
+
+            if (!expansionError())
+
+            {
+                lastStatus = 0;
+            }
+
+            return;
+        }
+    }
+
+    expandParsed(command);
+    parsed = command->list;
+
+    if (parsed[0][0] == '\0' || expansionError())
+
+    {
+        closeSubstitutions(substitutionMark);
+        return; // the whole command expanded to nothing, or an expansion failed
+    }
+
+    if (strcmp(parsed[0], "exit") == 0)
+
+    {
+        outFlush();
+        exit(length(parsed) > 1 ? atoi(parsed[1]) : lastStatus); // a bare exit keeps the status of the previous command
+    }
+
+    lastStatus = 0; // builtins succeed unless they say otherwise below
+
+    if (strcmp(parsed[0], "true") == 0 || strcmp(parsed[0], ":") == 0)
+
+    {
+        // nothing to do, lastStatus is already 0
+    }
+
+    else if (strcmp(parsed[0], "false") == 0)
+
+    {
+        lastStatus = 1;
+    }
+
+    else if (strcmp(parsed[0], "test") == 0 || strcmp(parsed[0], "[") == 0)
+
+    {
+        lastStatus = builtinTest(parsed);
+    }
+
+    else if (strcmp(parsed[0], "read") == 0)
+
+    {
+        lastStatus = builtinRead(parsed);
+    }
+
+    else if (strcmp(parsed[0], "tee") == 0)
+
+    {
+        lastStatus = builtinTee(parsed);
+    }
+
+    else if (strcmp(parsed[0], "timeout") == 0)
+
+    {
+        lastStatus = builtinTimeout(parsed);
+    }
+
+    else if (strcmp(parsed[0], "stats") == 0)
+
+    {
+        lastStatus = builtinStats(parsed);
+    }
+
+    else if (strcmp(parsed[0], "hsearch") == 0)
+
+    {
+        lastStatus = builtinHsearch(parsed);
+    }
+
+    else if (strcmp(parsed[0], "wait") == 0)
+
+    {
+        lastStatus = builtinWait(parsed);
+    }
+
+    else if (strcmp(parsed[0], "source") == 0 || strcmp(parsed[0], ".") == 0)
+
+    {
+        lastStatus = builtinSource(parsed);
+    }
+
+    else if (strcmp(parsed[0], "grep") == 0 && isTextBuiltin(parsed)) // options beyond the builtins' fall through to the real tools
+
+    {
+        lastStatus = builtinGrep(parsed);
+    }
+
+    else if (strcmp(parsed[0], "wc") == 0 && isTextBuiltin(parsed))
+
+    {
+        lastStatus = builtinWc(parsed);
+    }
+
+    else if (strcmp(parsed[0], "cut") == 0 && isTextBuiltin(parsed))
+
+    {
+        lastStatus = builtinCut(parsed);
+    }
+
+    else if (strcmp(parsed[0], "uniq") == 0 && isTextBuiltin(parsed))
+
+    {
+        lastStatus = builtinUniq(parsed);
+    }
+
+    else if (strcmp(parsed[0], "sort") == 0 && isTextBuiltin(parsed))
+
+    {
+        lastStatus = builtinSort(parsed);
+    }
+
+    else if (strcmp(parsed[0], "shift") == 0)
+
+    {
+        int count = (length(parsed) > 1) ? atoi(parsed[1]) : 1;
+
+        if (count < 0 || count > numOfPositionalParams)
+
+        {
+            LOG_ERROR("Can't shift that many!\n");
+            lastStatus = 1;
+        }
+
+        else
+
+        {
+            for (int i = 0; i < count; i++)
+
+            {
+                free(positionalParams[i]);
+            }
+
+            memmove(positionalParams, positionalParams + count, (numOfPositionalParams - count) * sizeof(char *));
+            numOfPositionalParams -= count;
+        }
+    }
+
+    else if (strcmp(parsed[0], "pwd") == 0)
+    
+    {
+        char pwd[MAX_STRING_LENGTH] = "";
+        getcwd(pwd, MAX_STRING_LENGTH);
+        recordDirectory();
+        outPrintf("%s\n", pwd);
+    }
+
+    else if (strcmp(parsed[0], "cd") == 0)
+
+    {
+        if (length(parsed) > 2) // case where more than 1 argument is given
+
+        {
+            LOG_ERROR("Only 2 arguments allowed!\n");
+            lastStatus = 1;
+        }
+
+        if (length(parsed) == 1) //case where no argument is given, chdir to home dir 
+
+        {
+            lastStatus = (chdir("/home") == 0) ? lastStatus : 1;
+        }
+
+        else // standard case with 1 argument, chdir to new dir
+
+        {
+            lastStatus = (chdir(parsed[1]) == 0) ? lastStatus : 1;
+        }
+    }
+
+    else if (strcmp(parsed[0], "alias") == 0)
+
+    {
+        if (length(parsed) == 1) // no args given, list all aliases currently defined
+
+        {
+            printAliases();
+        }
+
+        else if (length(parsed) == 2) // only alias_name provided, list the expansion of that alias
+
+        {
+            if (aliasExists(parsed[1]))
+
+            {
+                struct Alias *alias = getAlias(parsed[1]);
+                outPrintf("%s='%s'\n", alias->pair[0], alias->pair[1]);
+            }
+
+            else
+
+            {
+                LOG_ERROR("Alias does not exist!\n");
+                lastStatus = 1;
+            }
+        }
+
+        else if (length(parsed) == 3)
+        
+        {
+            if (!aliasExists(parsed[1]))
+
+            {
+                addAlias(parsed[1], parsed[2]);
+            }
+
+            else 
+
+            {
+                struct Alias *alias = getAlias(parsed[1]);
+                strcpy(alias->pair[1], parsed[2]); //update the value of the existing alias pair.
+            }
+        }
+
+        else
+
+        {
+            LOG_ERROR("Invalid number of arguments!\n");
+            lastStatus = 1;
+        }
+    }
+
+    else if (strcmp(parsed[0], "unalias") == 0)
+
+    {
+        if (aliasExists(parsed[1]))
+
+        {
+            deleteAlias(parsed[1]);
+        }
+
+        else if (length(parsed) > 2)
+
+        {
+            LOG_ERROR("Invalid number of arguments!\n");
+            lastStatus = 1;
+        }
+
+        else
+
+        {
+            LOG_ERROR("Alias does not exist!\n");
+            lastStatus = 1;
+        }
+    }
+
+    else if (strcmp(parsed[0], "echo") == 0)
+
+    {
+        for (int i = 1; parsed[i][0] != '\0'; i++) // the list ends at the first empty entry, no need to length() it every time
+
+        {
+            char *word = wordValue(parsed[i]);
+
+            if (i > 1)
+
+            {
+                outWrite(" ", 1); // no trailing space, it would leak into $(echo ...)
+            }
+
+            outWriteRef(word, strlen(word)); // parsed outlives the flush at the end of handleCommand()
+        }
+
+        outWrite("\n", 1);
+    }
+
+    else if (strcmp(parsed[0], "history") == 0)
+
+    {
+        HIST_ENTRY **list = history_list();
+        int numOfHistEntries = history_length;
+
+        if (!list)
+
+        {
+            LOG_ERROR("No history!\n");
+            lastStatus = 1;
+        }
+
+        else 
+
+        {
+            if (length(parsed) == 1) // print all entries added to history.
+
+            {
+                for (int i = 0; i < numOfHistEntries; i++)
+
+                {
+                    outPrintf("%d %s\n", i + 1, list[i]->line);
+                }                
+            }
+
+            else if (length(parsed) == 2)
+
+            {
+                int numOfEntriesToPrint = atoi(parsed[1]);
+
+                if (numOfEntriesToPrint > numOfHistEntries || numOfEntriesToPrint < 0)
+
+                {
+                    LOG_ERROR("Invalid argument value!\n");
+                    lastStatus = 1;
+                }
+
+                else
+
+                {
+                    for (int i = 0; i < numOfEntriesToPrint; i++)
+
+                    {
+                        outPrintf("%d %s\n", i + 1, list[i]->line);
+                    }
+                }
+            }
+
+            else
+
+            {
+                LOG_ERROR("Invalid number of arguments!\n");
+                lastStatus = 1;
+            }
+        }
+    }
+
+    else
+
+    {
+        //handle external commands
+
+        outFlush(); // don't let the child inherit (and later re-flush) our pending output
+
+        if (tailCall) // nothing runs after this command, let it take over the shell's process instead of forking
+
+        {
+            execParsed(parsed);
+        }
+
+        int rc = spawnProcess();
+        long long started = spawnStarted();
+
+        if (rc < 0)
+
+        {
+            fprintf(stderr, "%s: fork: %s\n", shellName, strerror(errno));
+            lastStatus = 1;
+        }
+
+        else if (rc == 0) // forking a child process to handle execvp 
+
+        {
+            execParsed(parsed);
+        }
+
+        else
+
+        {
+            int status = 0;
+            struct rusage usage;
+            wait4(rc, &status, 0, &usage); // waiting for the child process to finish so the parent process can move forward
+            spawnExited(SPAWN_COMMAND, started, &usage);
+            setStatus(status);
+        }
+    }
+
+    outFlush(); // one write for everything the builtin printed
+    closeSubstitutions(substitutionMark);
+}
+
+void inputHandler(struct Words *command)
+{
+    char **parsed = command->list;
+
+    for (int i = 0; parsed[i][0] != '\0'; i++)
+
+    {
+        bool hereString = (strcmp(parsed[i], "<<<") == 0);
+        bool attached = (strncmp(parsed[i], "<<", 2) == 0 && parsed[i][2] != '\0' && parsed[i][2] != '<' && strcmp(parsed[i], "<<-") != 0); // <<EOF
+
+        if (!hereString && !attached && strcmp(parsed[i], "<<") != 0 && strcmp(parsed[i], "<<-") != 0)
+
+        {
+            continue;
+        }
+
+        int fd = -1;
+        int numOfTokens = (attached || parsed[i + 1][0] == '\0') ? 1 : 2;
+
+        if (hereString) // <<< word, the body is the expanded word plus a newline
+
+        {
+            char *expanded = expandWord(parsed[i + 1], EXPAND_WORD);
+            char *body = malloc(strlen(expanded) + 2);
+
+            removeQuotes(body, expanded, strlen(expanded));
+            strcat(body, "\n");
+            fd = heredocFd(body, strlen(body));
+
+            free(body);
+            free(expanded);
+        }
+
+        else
+
+        {
+            fd = heredocFd(heredocBody.data ? heredocBody.data : "", heredocBody.len);
+        }
+
+        dropWords(parsed, i, numOfTokens); // drop the operator (and its word) from the command
+
+        if (fd < 0)
+
+        {
+            return;
+        }
+
+        int in_backup = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0); // the rest of the command (and every child it forks) reads the body as stdin
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+
+        inputHandler(command);
+
+        dup2(in_backup, STDIN_FILENO);
+        close(in_backup);
+        return;
+    }
+
+    if (strcmp(parsed[0], "exec") == 0) // its redirections are permanent, it must not go through the forking paths below
+
+    {
+        lastStatus = builtinExec(parsed);
+        return;
+    }
+
+    if (strcmp(parsed[0], "coproc") == 0) // the worker's command is expanded and redirected in the worker
+
+    {
+        lastStatus = builtinCoproc(parsed);
+        return;
+    }
+
+    if (strcmp(parsed[0], "watch") == 0) // the command is expanded again on every run, so globs pick up new files
+
+    {
+        lastStatus = builtinWatch(parsed);
+        return;
+    }
+
+    long long expanding = profiling ? profileClock() : 0;
+
+    expandAlias(command);
+    parsed = command->list;
+
+    if (profiling)
+
+    {
+        profileExpansion(expanding);
+    }
+
+    for (int i = 1; parsed[i][0] != '\0'; i++) // >&N, 2>&1, <&N: a dup2() in the shell itself, undone after the command
+
+    {
+        int target = -1;
+        int source = -1;
+
+        if (!parseDupRedirect(parsed[i], &target, &source))
+
+        {
+            continue;
+        }
+
+        dropWords(parsed, i, 1); // drop the redirection from the command
+
+        outFlush(); // pending output belongs to the old fd
+        int backup = fcntl(target, F_DUPFD_CLOEXEC, 10);
+
+        if (source >= 0 && dup2(source, target) < 0)
+
+        {
+            fprintf(stderr, "%s: %d: %s\n", shellName, source, strerror(errno));
+
+            if (backup >= 0)
+
+            {
+                close(backup);
+            }
+
+            lastStatus = 2;
+            return;
+        }
+
+        if (source < 0)
+
+        {
+            close(target);
+        }
+
+        inputHandler(command);
+        outFlush();
+
+        if (backup >= 0)
+
+        {
+            dup2(backup, target);
+            close(backup);
+        }
+
+        else
+
+        {
+            close(target); // it wasn't open before the command
+        }
+
+        return;
+    }
+
+    int readIndex = getIndex("<", parsed, 0);
+
+    if (readIndex >= 0 && parsed[readIndex + 1][0] != '\0') // < file, the command (builtin or not) reads the file as stdin
+
+    {
+        int substitutionMark = numOfSubstitutions;
+        char *path = isProcessSubstitution(parsed[readIndex + 1]) ? substituteProcess(parsed[readIndex + 1]) : strdup(parsed[readIndex + 1]);
+        int fd = open(path, O_RDONLY);
+
+        free(path);
+        closeSubstitutions(substitutionMark); // < <(cmd), fd is now the pipe's only reader
+
+        if (fd < 0)
+
+        {
+            perror("ERR_FILE_NOT_FOUND");
+            lastStatus = 1;
+            return;
+        }
+
+        dropWords(parsed, readIndex, 2); // drop the operator and the file name from the command
+
+        int in_backup = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0); // close-on-exec, a tail-called command must not inherit it
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+
+        inputHandler(command);
+
+        dup2(in_backup, STDIN_FILENO);
+        close(in_backup);
+        return;
+    }
+
+    bool write_flag = false;
+    bool append_flag = false;
+
+    for (int i = 0; parsed[i][0] != '\0'; i++)
+
+    {
+        if (strcmp(parsed[i], ">") == 0)
+
+        {
+            write_flag = true;
+        }
+
+        if (strcmp(parsed[i], ">>") == 0)
+
+        {
+            append_flag = true;
+        }
+
+    }
+
+    if (write_flag == false && append_flag == false)
+    
+    {
+        handleCommand(command);
+    }
+
+    else
+
+    {
+        char* a = ">>";
+        char* w = ">";
+        int out_backup = dup(STDOUT_FILENO);
+
+        if (write_flag == true) //rationale: fork each process and call the commandhandler,
+
+        {
+            char *fileName = parsed[getIndex(w, parsed, 0) + 1];
+            long long before = 0; // the file's size once the command is done tells how much it wrote
+            outFlush();
+            int rc = spawnProcess();
+            long long started = spawnStarted();
+
+            if (rc < 0)
+
+            {
+                fprintf(stderr, "%s: fork: %s\n", shellName, strerror(errno));
+                lastStatus = 1;
+                close(out_backup);
+            }
+
+            else if (rc == 0) // forking a child process to handle execvp 
+
+            {
+                int index = getIndex(w, parsed, 0);
+                int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666); // open file in write only mode, create if it doesn't exist, truncate to replace if it does exist
+                dup2(fd, STDOUT_FILENO); // redirect stdout to the file
+                close(fd);
+
+                struct Words words = {NULL};
+                setWords(&words, parsed, index);
+                handleCommand(&words);
+                outFlush();
+                exit(lastStatus);
+            }
+
+            else
+
+            {
+                int status = 0;
+                struct rusage usage;
+                wait4(rc, &status, 0, &usage); // waiting for the child process to finish so the parent process can move forward
+                spawnExited(SPAWN_COMMAND, started, &usage);
+                STATS_ADD(redirectedBytes, (fileSize(fileName) > before) ? fileSize(fileName) - before : 0);
+                setStatus(status);
+                dup2(out_backup, STDOUT_FILENO);
+                close(out_backup);
+            }
+        }
+        
+        if (append_flag == true)
+
+        {
+            char *fileName = parsed[getIndex(a, parsed, 0) + 1];
+            long long before = fileSize(fileName); // the file's size once the command is done tells how much it wrote
+            outFlush();
+            int rc = spawnProcess();
+            long long started = spawnStarted();
+
+            if (rc < 0)
+
+            {
+                fprintf(stderr, "%s: fork: %s\n", shellName, strerror(errno));
+                lastStatus = 1;
+                close(out_backup);
+            }
+
+            else if (rc == 0) // forking a child process to handle execvp 
+
+            {
+                int index = getIndex(a, parsed, 0);
+                int fd = open(fileName, O_WRONLY | O_CREAT | O_APPEND, 0666); // open file in write only mode, create if it doesn't exist, append if it does exist
+                dup2(fd, STDOUT_FILENO); // redirect stdout to the file
+                close(fd);
+                
+                struct Words words = {NULL};
+                setWords(&words, parsed, index);
+                handleCommand(&words);
+                outFlush();
+                exit(lastStatus);
+            }
+
+            else
+
+            {
+                int status = 0;
+                struct rusage usage;
+                wait4(rc, &status, 0, &usage); // waiting for the child process to finish so the parent process can move forward
+                spawnExited(SPAWN_COMMAND, started, &usage);
+                STATS_ADD(redirectedBytes, (fileSize(fileName) > before) ? fileSize(fileName) - before : 0);
+                setStatus(status);
+                dup2(out_backup, STDOUT_FILENO);
+                close(out_backup);
+            }
+        }
+    }
+}
+
+bool parseDupRedirect(char *word, int *target, int *source)
+{
+    char *ptr = word;
+    long fd = -1;
+
+    if (isdigit((unsigned char) *ptr))
+
+    {
+        fd = strtol(ptr, &ptr, 10);
+    }
+
+    if ((*ptr != '>' && *ptr != '<') || ptr[1] != '&' || ptr[2] == '\0' || fd > INT_MAX)
+
+    {
+        return false;
+    }
+
+    *target = (fd >= 0) ? (int) fd : (*ptr == '>') ? STDOUT_FILENO : STDIN_FILENO;
+
+    if (strcmp(ptr + 2, "-") == 0)
+
+    {
+        *source = -1; // >&- closes the fd for the command
+        return true;
+    }
+
+    char *expanded = expandWord(ptr + 2, EXPAND_WORD); // >&$COPROC_1
+    char *end = expanded;
+    long value = isdigit((unsigned char) expanded[0]) ? strtol(expanded, &end, 10) : -1;
+    bool valid = value >= 0 && value <= INT_MAX && *end == '\0';
+
+    free(expanded);
+    *source = (int) value;
+    return valid;
+}
+
+void expandAlias(struct Words *command)
+{
+    char **parsed = command->list;
+
+    if (aliasExists(parsed[0]))
+
+    {
+        struct Alias *alias = getAlias(parsed[0]);
+        struct Buffer newCommand = {NULL, 0, 0};
+        STATS_ADD(aliasHits, 1);
+        bufferAppend(&newCommand, alias->pair[1], strlen(alias->pair[1]));
+        
+        for (int i = 1; parsed[i][0] != '\0'; i++) 
+        
+        {
+            bufferAppend(&newCommand, " ", 1);
+            bufferAppend(&newCommand, parsed[i], strlen(parsed[i]));
+        }
+        
+        parser(newCommand.data, command, false);
+        free(newCommand.data);
+    }
+}
+
+void expandParsed(struct Words *command)
+{
+    char **parsed = command->list;
+    bool plain = true;
+
+    for (int i = 0; parsed[i][0] != '\0' && plain; i++)
+
+    {
+        plain = (strpbrk(parsed[i], "$`'\"\\*?(") == NULL);
+    }
+
+    if (plain)
+
+    {
+        return; // nothing to glob, expand or unquote
+    }
+
+    char **fields = NULL;
+    int numOfFields = 0;
+    int fieldsCapacity = 0;
+
+    for (int i = 0; parsed[i][0] != '\0'; i++)
+
+    {
+        if (isProcessSubstitution(parsed[i]) || strcmp(parsed[i], EMPTY_WORD) == 0)
+
+        {
+            fields = appendField(fields, &numOfFields, &fieldsCapacity, isProcessSubstitution(parsed[i]) ? substituteProcess(parsed[i]) : strdup(parsed[i]));
+            continue;
+        }
+
+        char *expanded = expandWord(parsed[i], EXPAND_FIELDS); // unquoted results come back with their spaces bare and everything else escaped
+        char *end = expanded + strlen(expanded);
+        char *ptr = expanded;
+
+        while (ptr < end)
+
+        {
+            while (*ptr == ' ')
+
+            {
+                ptr++;
+            }
+
+            if (ptr >= end)
+
+            {
+                break;
+            }
+
+            char *fieldEnd = tokenEnd(ptr, end);
+            char *field = strndup(ptr, fieldEnd - ptr);
+            char *pattern = globPattern(field);
+            ptr = fieldEnd;
+
+            if (pattern != NULL)
+
+            {
+                long long expanding = profiling ? profileClock() : 0;
+                glob_t glob_result;
+
+                if (pattern[0] != '/')
+
+                {
+                    recordDirectory(); // a relative pattern matches other files in another directory
+                }
+
+                bool matched = (glob(pattern, GLOB_TILDE, NULL, &glob_result) == 0);
+                STATS_ADD(globExpansions, 1);
+
+                if (matched)
+
+                {
+                    STATS_ADD(globMatches, glob_result.gl_pathc);
+
+                    for (size_t j = 0; j < glob_result.gl_pathc; j++)
+
+                    {
+                        fields = appendField(fields, &numOfFields, &fieldsCapacity, strdup(glob_result.gl_pathv[j])); // file names are never split or unquoted again
+                    }
+                }
+
+                globfree(&glob_result);
+                free(pattern);
+
+                if (profiling)
+
+                {
+                    profileExpansion(expanding);
+                }
+
+                if (matched)
+
+                {
+                    free(field);
+                    continue;
+                }
+            }
+
+            char *unquoted = malloc(strlen(field) + 1);
+            removeQuotes(unquoted, field, strlen(field));
+            free(field);
+
+            if (unquoted[0] == '\0')
+
+            {
+                free(unquoted);
+                unquoted = strdup(EMPTY_WORD); // "" and '' are still an argument
+            }
+
+            fields = appendField(fields, &numOfFields, &fieldsCapacity, unquoted);
+        }
+
+        free(expanded);
+    }
+
+    setWords(command, fields, numOfFields);
+
+    for (int i = 0; i < numOfFields; i++)
+
+    {
+        free(fields[i]);
+    }
+
+    free(fields);
+}
+
+char **appendField(char **fields, int *numOfFields, int *capacity, char *field)
+{
+    if (*numOfFields == *capacity)
+
+    {
+        *capacity = (*capacity == 0) ? 16 : *capacity * 2;
+        fields = realloc(fields, *capacity * sizeof(char *));
+    }
+
+    fields[(*numOfFields)++] = field;
+    return fields;
+}
+
+char *globPattern(char *field)
+{
+    // a field is a pattern when it holds an unquoted, unescaped * or ?. Quoted and escaped characters
+    // are matched literally, so they keep (or get) a backslash in front and the quotes themselves go
+
+    struct Buffer pattern = {NULL, 0, 0};
+    bool wildcard = false;
+    char *ptr = field;
+
+    while (*ptr != '\0')
+
+    {
+        if (*ptr == '\\' && ptr[1] != '\0')
+
+        {
+            bufferAppend(&pattern, ptr, 2);
+            ptr += 2;
+        }
+
+        else if (*ptr == '\'' || *ptr == '\"')
+
+        {
+            char *close = (*ptr == '\'') ? strchr(ptr + 1, '\'') : closingQuote(ptr + 1);
+
+            if (close == NULL)
+
+            {
+                bufferAppend(&pattern, "\\", 1);
+                bufferAppend(&pattern, ptr++, 1);
+                continue;
+            }
+
+            char *inner = malloc(close - ptr);
+
+            if (*ptr == '\"')
+
+            {
+                unescapeDouble(inner, ptr + 1, close - ptr - 1);
+            }
+
+            else
+
+            {
+                memcpy(inner, ptr + 1, close - ptr - 1);
+                inner[close - ptr - 1] = '\0';
+            }
+
+            for (char *c = inner; *c != '\0'; c++)
+
+            {
+                bufferAppend(&pattern, "\\", 1);
+                bufferAppend(&pattern, c, 1);
+            }
+
+            free(inner);
+            ptr = close + 1;
+        }
+
+        else
+
+        {
+            wildcard = wildcard || *ptr == '*' || *ptr == '?';
+            bufferAppend(&pattern, ptr++, 1);
+        }
+    }
+
+    if (!wildcard)
+
+    {
+        free(pattern.data);
+        return NULL;
+    }
+
+    return pattern.data;
+}
+
+void replaceWildcards(struct Words *command) 
+{
+    char **parsed = command->list;
+    int count = length(parsed);
+    char **words = NULL; // parsed with the patterns that matched replaced, made when the first one does
+    bool *replaced = NULL;
+
+    for (int i = 0; i < count; i++) 
+    
+    {
+        if (strchr(parsed[i], '*') || strchr(parsed[i], '?')) 
+        
+        {
+            glob_t glob_result;
+            STATS_ADD(globExpansions, 1);
+        
+            if (glob(parsed[i], GLOB_TILDE, NULL, &glob_result) == 0) // glob found matches, replace the pattern with the matched filenames
+            
+            {
+                STATS_ADD(globMatches, glob_result.gl_pathc);
+                struct Buffer replacement = {NULL, 0, 0};
+            
+                for (unsigned int j = 0; j < glob_result.gl_pathc; j++) 
+                
+                {
+                    if (j > 0)
+
+                    {
+                        bufferAppend(&replacement, " ", 1);
+                    }
+
+                    bufferAppend(&replacement, glob_result.gl_pathv[j], strlen(glob_result.gl_pathv[j]));
+                }
+
+                if (words == NULL)
+
+                {
+                    words = malloc((count + 1) * sizeof(char *));
+                    replaced = calloc(count, sizeof(bool));
+                    memcpy(words, parsed, (count + 1) * sizeof(char *));
+                }
+
+                words[i] = replacement.data; // one word holding all the matches, so that the list stays aligned with the words it came from
+                replaced[i] = true;
+                globfree(&glob_result);
+            } 
+            
+            else 
+            
+            {
+                globfree(&glob_result); // no matches were found, leave the pattern as is
+            }
+        }
+    }
+
+    if (words != NULL)
+
+    {
+        setWords(command, words, count);
+
+        for (int i = 0; i < count; i++)
+
+        {
+            if (replaced[i])
+
+            {
+                free(words[i]);
+            }
         }
+
+        free(words);
+        free(replaced);
     }
+}
+
+void bufferAppend(struct Buffer *buf, const char *str, size_t len)
+{
+    if (buf->len + len + 1 > buf->cap)
 
-    // if the number of pipes is not one less than the number of commands
-    if (pipeCount != numOfCommands - 1)
     {
-        LOG_ERROR("Invalid Pipe Error: Number of pipes must be one less than the number of commands.!\n");
-        return false;
+        size_t newCap = buf->cap ? buf->cap : 256;
+
+        while (newCap < buf->len + len + 1)
+
+        {
+            newCap *= 2; // grow geometrically so that appending n bytes costs O(n) overall
+        }
+
+        buf->data = realloc(buf->data, newCap);
+        buf->cap = newCap;
     }
 
-    // if there are multiple input or output redirections
-    if (flagwCount > 1 || flagaCount > 1 || flagrCount > 1)
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+bool isAssignment(char *token)
+{
+    if (!(isalpha((unsigned char) token[0]) || token[0] == '_'))
+
     {
-        LOG_ERROR("Invalid Pipe Error: Multiple IO redirection operators!\n");
         return false;
     }
 
-    // if both output redirections are present
-    if (flagwCount > 0 && flagaCount > 0)
+    int i = 1;
+
+    while (isalnum((unsigned char) token[i]) || token[i] == '_')
+
     {
-        LOG_ERROR("Invalid Pipe Error: Both output redirections present!\n");
-        return false;
+        i++;
     }
 
-    return true;
+    return token[i] == '=';
 }
 
-void handleCommand(char parsed[500][500])
+char *getVariable(char *name)
 {
-    replaceWildcards(parsed);
+    static char special[32];
 
-    char newInput[1000] = "";
+    if (strcmp(name, "!") == 0 || strcmp(name, "$") == 0)
 
-    int i = 0;
-    
-    while (i < 500 && parsed[i][0] != '\0') 
     {
-        if (i > 0) 
-        
-        {
-            strcat(newInput, " "); // Add a space between words
-        }
-        
-        strcat(newInput, parsed[i]);
-        
-        i++;
+        recordProcessValue(); // a ~/.shellrc snapshot can't hand these to the next shell
     }
 
-    parser(newInput, parsed, true); //drop quotes now that we are about to execute command.
+    if (strcmp(name, "!") == 0)
 
-    if (strcmp(parsed[0], "exit") == 0)
+    {
+        snprintf(special, sizeof(special), "%d", (int) lastBackground);
+        return (lastBackground > 0) ? special : NULL; // unset until a job has been started
+    }
+
+    if (strcmp(name, "?") == 0 || strcmp(name, "#") == 0 || strcmp(name, "$") == 0)
 
     {
-        exit(0);
+        snprintf(special, sizeof(special), "%d", name[0] == '?' ? lastStatus : name[0] == '#' ? numOfPositionalParams : (int) getpid());
+        return special;
     }
 
-    else if (strcmp(parsed[0], "pwd") == 0)
-    
+    if (isdigit((unsigned char) name[0]))
+
     {
-        char pwd[MAX_STRING_LENGTH] = "";
-        getcwd(pwd, MAX_STRING_LENGTH);
-        printf("%s\n", pwd);
+        int index = atoi(name);
+        return (index == 0) ? shellName : (index <= numOfPositionalParams) ? positionalParams[index - 1] : NULL;
     }
 
-    else if (strcmp(parsed[0], "cd") == 0)
+    if (strcmp(name, "@") == 0 || strcmp(name, "*") == 0)
 
     {
-        if (length(parsed) > 2) // case where more than 1 argument is given
+        static struct Buffer all = {NULL, 0, 0};
+
+        all.len = 0;
+        bufferAppend(&all, "", 0);
+
+        for (int i = 0; i < numOfPositionalParams; i++)
 
         {
-            LOG_ERROR("Only 2 arguments allowed!\n");
+            bufferAppend(&all, positionalParams[i], strlen(positionalParams[i]));
+            bufferAppend(&all, (i < numOfPositionalParams - 1) ? " " : "", (i < numOfPositionalParams - 1) ? 1 : 0);
         }
 
-        if (length(parsed) == 1) //case where no argument is given, chdir to home dir 
+        return all.data;
+    }
+
+    for (int i = 0; i < numOfVariables; i++)
+
+    {
+        if (strcmp(variables[i].name, name) == 0)
 
         {
-            chdir("/home");
+            return variables[i].value;
         }
+    }
 
-        else // standard case with 1 argument, chdir to new dir
+    char *value = getenv(name); // fall back to the environment, e.g. $HOME or $PATH
+    recordEnvironment(name, value); // a ~/.shellrc snapshot is only valid while it has the same value
+    return value;
+}
+
+void setVariable(char *name, char *value)
+{
+    for (int i = 0; i < numOfVariables; i++)
+
+    {
+        if (strcmp(variables[i].name, name) == 0)
 
         {
-            chdir(parsed[1]);
+            free(variables[i].value);
+            variables[i].value = strdup(value);
+            return;
         }
     }
 
-    else if (strcmp(parsed[0], "alias") == 0)
+    if (numOfVariables == variablesCapacity)
 
     {
-        if (length(parsed) == 1) // no args given, list all aliases currently defined
+        variablesCapacity = variablesCapacity ? variablesCapacity * 2 : 16;
+        variables = realloc(variables, variablesCapacity * sizeof(struct Variable));
+    }
+
+    variables[numOfVariables].name = strdup(name);
+    variables[numOfVariables].value = strdup(value);
+    numOfVariables++;
+}
+
+char *expandWord(char *word, enum ExpandMode mode)
+{
+    // the result still holds the word's own quotes and escapes. Values are escaped as they go in, so that
+    // removing the quotes afterwards gives them back as they were instead of lexing them (see appendValue())
+
+    struct Buffer out = {NULL, 0, 0};
+    bool inDouble = false;
+    char *ptr = word;
+
+    while (*ptr != '\0')
+
+    {
+        char *value = NULL;
+        bool captured = false;
+
+        if (*ptr == '\\' && ptr[1] != '\0' && mode == EXPAND_HEREDOC)
 
         {
-            printAliases();
+            bufferAppend(&out, (strchr("\\$`", ptr[1]) != NULL) ? ptr + 1 : ptr, (strchr("\\$`", ptr[1]) != NULL) ? 1 : 2); // a heredoc body is never unquoted, only \$ \` and \\ are escapes
+            ptr += 2;
+            continue;
         }
 
-        else if (length(parsed) == 2) // only alias_name provided, list the expansion of that alias
+        if (*ptr == '\\' && ptr[1] != '\0')
 
         {
-            if (aliasExists(parsed[1]))
+            bufferAppend(&out, ptr, 2); // escapes are dropped later with the quotes
+            ptr += 2;
+            continue;
+        }
+
+        if ((*ptr == '\'' || *ptr == '"') && mode == EXPAND_HEREDOC)
+
+        {
+            bufferAppend(&out, ptr, 1); // quotes in a heredoc body are plain text
+            ptr++;
+            continue;
+        }
+
+        if (*ptr == '\'' && !inDouble)
+
+        {
+            char *close = strchr(ptr + 1, '\'');
+            char *end = close ? close + 1 : ptr + 1;
+            bufferAppend(&out, ptr, end - ptr); // nothing is expanded inside single quotes
+            ptr = end;
+            continue;
+        }
+
+        if (*ptr == '"')
+
+        {
+            inDouble = !inDouble;
+            bufferAppend(&out, ptr, 1);
+            ptr++;
+            continue;
+        }
+
+        if (*ptr == '$' && ptr[1] == '(' && ptr[2] == '(' && matchingParen(ptr + 2) + 1 == matchingParen(ptr + 1) && *(matchingParen(ptr + 1) - 1) == ')')
+
+        {
+            char *end = matchingParen(ptr + 1); // $(( expression )), evaluated in-process
+            char *inner = strndup(ptr + 3, end - ptr - 5);
+            char *expanded = expandWord(inner, EXPAND_WORD);
+            char *expression = malloc(strlen(expanded) + 1);
+            bool ok = true;
+
+            removeQuotes(expression, expanded, strlen(expanded));
+            int64_t result = evaluateArithmetic(expression, &ok);
+
+            value = malloc(32);
+            snprintf(value, 32, "%" PRId64, result);
+            captured = true;
+
+            if (!ok)
 
             {
-                struct Alias *alias = getAlias(parsed[1]);
-                printf("%s='%s'\n", alias->pair[0], alias->pair[1]);
+                value[0] = '\0';
+                expansionFailed = true;
             }
 
-            else
+            free(expression);
+            free(expanded);
+            free(inner);
+            ptr = end;
+        }
+
+        else if (*ptr == '$' && ptr[1] == '(')
+
+        {
+            char *end = matchingParen(ptr + 1);
+            int innerLen = (*(end - 1) == ')') ? end - ptr - 3 : end - ptr - 2;
+            char *inner = strndup(ptr + 2, innerLen);
+
+            value = captureCommand(inner);
+            captured = true;
+            free(inner);
+            ptr = end;
+        }
+
+        else if (*ptr == '`')
+
+        {
+            char *close = strchr(ptr + 1, '`');
+
+            if (close == NULL)
 
             {
-                LOG_ERROR("Alias does not exist!\n");
+                bufferAppend(&out, ptr, 1);
+                ptr++;
+                continue;
             }
+
+            char *inner = strndup(ptr + 1, close - ptr - 1);
+
+            value = captureCommand(inner);
+            captured = true;
+            free(inner);
+            ptr = close + 1;
         }
 
-        else if (length(parsed) == 3)
-        
+        else if (*ptr == '$' && (isalnum((unsigned char) ptr[1]) || strchr("_{?#@*$!", ptr[1]) != NULL) && ptr[1] != '\0')
+
         {
-            if (!aliasExists(parsed[1]))
+            int len = 0;
+            char *start = ptr + 1;
+            bool braces = (*start == '{');
+            bool length = false;
+
+            if (braces)
 
             {
-                addAlias(parsed[1], parsed[2]);
+                start++;
+                length = (*start == '#' && start[1] != '}'); // ${#name}, but ${#} is $#
+
+                if (length)
+
+                {
+                    start++;
+                }
             }
 
-            else 
+            if (*start != '\0' && (isdigit((unsigned char) *start) || strchr("?#@*$!", *start) != NULL))
 
             {
-                struct Alias *alias = getAlias(parsed[1]);
-                strcpy(alias->pair[1], parsed[2]); //update the value of the existing alias pair.
+                len = 1; // $1, $?, $#, $@, $*, $$, $! are a single character, only ${10} can be longer
+
+                while (braces && isdigit((unsigned char) *start) && isdigit((unsigned char) start[len]))
+
+                {
+                    len++;
+                }
+            }
+
+            else
+
+            {
+                while (isalnum((unsigned char) start[len]) || start[len] == '_')
+
+                {
+                    len++;
+                }
+            }
+
+            char *name = strndup(start, len);
+            ptr = start + len;
+
+            if (braces)
+
+            {
+                char *close = closingBrace(ptr);
+                char *spec = close ? strndup(ptr, close - ptr) : NULL;
+
+                value = expandParameter(name, spec, length, mode);
+                captured = true;
+                ptr = close ? close + 1 : ptr + strlen(ptr);
+                free(spec);
+            }
+
+            else
+
+            {
+                value = getVariable(name);
             }
+
+            free(name);
         }
 
         else
 
         {
-            LOG_ERROR("Invalid number of arguments!\n");
+            bufferAppend(&out, ptr, 1);
+            ptr++;
+            continue;
+        }
+
+        if (value != NULL)
+
+        {
+            appendValue(&out, value, mode, inDouble);
+        }
+
+        if (captured)
+
+        {
+            free(value);
         }
     }
 
-    else if (strcmp(parsed[0], "unalias") == 0)
+    if (out.data == NULL)
 
     {
-        if (aliasExists(parsed[1]))
+        return strdup("");
+    }
+
+    return out.data;
+}
+
+char *expandParameter(char *name, char *spec, bool length, enum ExpandMode mode)
+{
+    // spec is what follows the name inside the braces: nothing, or one of - = + ? (with or without a
+    // leading colon, which also treats an empty value as unset) and the word to use
+
+    bool colon = (spec != NULL && spec[0] == ':');
+    char op = (spec != NULL) ? spec[colon] : '\0';
+
+    if (spec == NULL || name[0] == '\0' || (spec[0] != '\0' && (length || op == '\0' || strchr("-=+?", op) == NULL)))
+
+    {
+        fprintf(stderr, "%s: ${%s%s%s}: bad substitution\n", shellName, length ? "#" : "", name, spec ? spec : "");
+        expansionFailed = true;
+        return NULL;
+    }
+
+    char *current = getVariable(name);
+    current = current ? strdup(current) : NULL; // $? and friends live in a buffer the word's own expansion reuses
+
+    if (length)
+
+    {
+        char *count = malloc(32);
+        snprintf(count, 32, "%zu", current ? strlen(current) : 0);
+        free(current);
+        return count;
+    }
+
+    bool set = (current != NULL && (!colon || current[0] != '\0'));
+
+    if (op == '\0' || (set && op != '+'))
+
+    {
+        return current;
+    }
+
+    free(current);
+
+    if (!set && op == '+')
+
+    {
+        return NULL;
+    }
+
+    char *word = expandWord(spec + colon + 1, (mode == EXPAND_HEREDOC) ? EXPAND_HEREDOC : EXPAND_WORD);
+
+    if (mode != EXPAND_HEREDOC)
+
+    {
+        char *unquoted = malloc(strlen(word) + 1);
+        removeQuotes(unquoted, word, strlen(word));
+        free(word);
+        word = unquoted;
+    }
+
+    if (op == '=' && !isalpha((unsigned char) name[0]) && name[0] != '_')
+
+    {
+        fprintf(stderr, "%s: %s: cannot assign in this way\n", shellName, name);
+        expansionFailed = true;
+        free(word);
+        return NULL;
+    }
+
+    if (op == '=')
+
+    {
+        setVariable(name, word);
+    }
+
+    if (op == '?')
+
+    {
+        fprintf(stderr, "%s: %s: %s\n", shellName, name, word[0] != '\0' ? word : "parameter not set");
+        expansionFailed = true;
+        free(word);
+        return NULL;
+    }
+
+    return word;
+}
+
+bool expansionError()
+{
+    if (!expansionFailed)
+
+    {
+        return false;
+    }
+
+    expansionFailed = false;
+    lastStatus = 2;
+
+    if (!interactiveMode && builtinOutput == NULL) // a script stops like with any other shell error, $(...) run in-process only fails its command
+
+    {
+        outFlush();
+        exit(lastStatus);
+    }
+
+    return true;
+}
+
+void appendValue(struct Buffer *out, char *value, enum ExpandMode mode, bool inDouble)
+{
+    if (mode == EXPAND_HEREDOC)
+
+    {
+        bufferAppend(out, value, strlen(value)); // the body is used as it is
+        return;
+    }
+
+    for (char *ptr = value; *ptr != '\0'; ptr++)
+
+    {
+        bool escape = false;
+
+        if (inDouble)
 
         {
-            deleteAlias(parsed[1]);
+            escape = (strchr("\\\"$`", *ptr) != NULL); // the only characters unescapeDouble() drops a backslash in front of
         }
 
-        else if (length(parsed) > 2)
+        else if (mode == EXPAND_WORD)
+
+        {
+            escape = (strchr("\\'\"", *ptr) != NULL);
+        }
+
+        else if (*ptr == ' ' || *ptr == '\n' || *ptr == '\t')
 
         {
-            LOG_ERROR("Invalid number of arguments!\n");
+            bufferAppend(out, " ", 1); // a field separator, the only thing left bare besides wildcards
+            continue;
         }
 
         else
 
         {
-            LOG_ERROR("Alias does not exist!\n");
+            escape = !isalnum((unsigned char) *ptr) && strchr("*?[", *ptr) == NULL;
         }
-    }
-
-    else if (strcmp(parsed[0], "echo") == 0)
 
-    {
-        if (length(parsed) == 1) // no args given, print a new line
+        if (escape)
 
         {
-            printf("\n");
+            bufferAppend(out, "\\", 1);
         }
 
-        else
+        bufferAppend(out, ptr, 1);
+    }
+}
 
-        {
-            for (int i = 1; i < length(parsed); i++)
+bool isCaptureSafe(char **parsed)
+{
+    // builtins that only print something can write straight into the capture buffer,
+    // anything that changes the shell's state (cd, exit, alias NAME VALUE, ...) still runs in a subshell
 
-            {
-                printf("%s ", parsed[i]);
-            }
+    if (countPipes(parsed) > 0 || getIndex(">", parsed, 0) != -1 || getIndex(">>", parsed, 0) != -1 || getIndex("<", parsed, 0) != -1)
 
-            printf("\n");
-        }
+    {
+        return false;
     }
 
-    else if (strcmp(parsed[0], "history") == 0)
+    for (int i = 1; parsed[i][0] != '\0'; i++)
 
     {
-        HIST_ENTRY **list = history_list();
-        int numOfHistEntries = history_length;
-
-        if (!list)
+        if (strstr(parsed[i], ">&") != NULL || strstr(parsed[i], "<&") != NULL) // echo x >&2 must not end up in the capture
 
         {
-            LOG_ERROR("No history!\n");
+            return false;
         }
+    }
 
-        else 
-
-        {
-            if (length(parsed) == 1) // print all entries added to history.
-
-            {
-                for (int i = 0; i < numOfHistEntries; i++)
-
-                {
-                    printf("%d %s\n", i + 1, list[i]->line);
-                }                
-            }
+    if (aliasExists(parsed[0]))
 
-            else if (length(parsed) == 2)
+    {
+        return false;
+    }
 
-            {
-                int numOfEntriesToPrint = atoi(parsed[1]);
+    return strcmp(parsed[0], "echo") == 0 || strcmp(parsed[0], "pwd") == 0 || strcmp(parsed[0], "true") == 0 || strcmp(parsed[0], "false") == 0 || strcmp(parsed[0], "history") == 0 || (strcmp(parsed[0], "alias") == 0 && length(parsed) <= 2);
+}
 
-                if (numOfEntriesToPrint > numOfHistEntries || numOfEntriesToPrint < 0)
+char *captureCommand(char *command)
+{
+    struct Words parsed = {NULL};
+    char *data = NULL;
+    size_t size = 0;
+    int status = COMPILE_OK;
+    struct Node *tree = compileSource(command, &status);
 
-                {
-                    LOG_ERROR("Invalid argument value!\n");
-                }
+    if (status != COMPILE_OK)
 
-                else
+    {
+        freeNode(tree);
+        lastStatus = 2;
+        return strdup("");
+    }
 
-                {
-                    for (int i = 0; i < numOfEntriesToPrint; i++)
+    bool simple = (tree != NULL && tree->next == NULL && tree->type == NODE_SIMPLE && !tree->pipeline && !tree->background && tree->heredoc == NULL);
+    setWords(&parsed, simple ? tree->words : NULL, simple ? tree->numOfWords : 0);
 
-                    {
-                        printf("%d %s\n", i + 1, list[i]->line);
-                    }
-                }
-            }
+    bool inProcess = (parsed.list[0][0] != '\0' && isCaptureSafe(parsed.list) && getFunction(parsed.list[0]) == NULL);
+    freeWords(&parsed);
 
-            else
+    if (inProcess)
 
-            {
-                LOG_ERROR("Invalid number of arguments!\n");
-            }
-        }
+    {
+        FILE *saved = builtinOutput;
+
+        outFlush(); // pending output belongs to the enclosing stream
+        builtinOutput = open_memstream(&data, &size);
+        executeList(tree);
+        outFlush();
+        fclose(builtinOutput);
+        builtinOutput = saved;
     }
 
     else
 
     {
-        //handle external commands
+        int fds[2];
 
-        int rc = fork();
+        if (pipe(fds) < 0)
+
+        {
+            perror("ERR_PIPE_FAILED");
+            return strdup("");
+        }
+
+        outFlush();
+        int rc = spawnProcess();
+        long long started = spawnStarted();
 
         if (rc < 0)
 
         {
-            fprintf(stderr, "fork failed\n");
-            exit(1);
+            perror("ERR_FORK_FAILED");
+            close(fds[PIPE_READ_END]);
+            close(fds[PIPE_WRITE_END]);
+            return strdup("");
         }
 
-        if (rc == 0) // forking a child process to handle execvp 
+        if (rc == 0)
 
         {
-            char* args[length(parsed) + 1];
+            close(fds[PIPE_READ_END]);
+            dup2(fds[PIPE_WRITE_END], STDOUT_FILENO);
+            close(fds[PIPE_WRITE_END]);
+
+            builtinOutput = NULL; // nested captures in the child write to the pipe like everything else
+            executeList(tree);
+            outFlush();
+            exit(lastStatus);
+        }
+
+        close(fds[PIPE_WRITE_END]);
+
+        struct Buffer out = {NULL, 0, 0};
+        char chunk[4096];
+        ssize_t n;
 
-            for (int i = 0; i < length(parsed); i++) 
+        while ((n = read(fds[PIPE_READ_END], chunk, sizeof(chunk))) != 0)
+
+        {
+            if (n < 0)
 
             {
-                args[i] = strdup(parsed[i]);
-            }
+                if (errno == EINTR)
 
-            args[length(parsed)] = NULL;
-            
-            execvp(args[0], args);
+                {
+                    continue;
+                }
+
+                break;
+            }
 
-            perror("ERR_EXECVP_FAILED");
-            exit(1);
+            bufferAppend(&out, chunk, n);
         }
 
-        else
+        close(fds[PIPE_READ_END]);
 
-        {
-            wait(NULL); // waiting for the child process to finish so the parent process can move forward
-        }
+        int waitStatus = 0;
+        struct rusage usage;
+        wait4(rc, &waitStatus, 0, &usage);
+        spawnExited(SPAWN_CAPTURE, started, &usage);
+        setStatus(waitStatus); // $? after x=$(cmd) is cmd's status
+
+        data = out.data;
+        size = out.len;
     }
-}
 
-void inputHandler(char parsed[500][500])
-{
-    if (aliasExists(parsed[0]))
+    freeNode(tree);
+
+    if (data == NULL)
 
     {
-        struct Alias *alias = getAlias(parsed[0]);
-        char newCommand[MAX_STRING_LENGTH] = "";
-        strcpy(newCommand, alias->pair[1]);
-        
-        for (int i = 1; i < length(parsed); i++) 
-        
-        {
-            strcat(newCommand, " ");
-            strcat(newCommand, parsed[i]);
-        }
-        
-        parser(newCommand, parsed, false);
+        return strdup("");
     }
 
-    bool write_flag = false;
-    bool append_flag = false;
-    bool read_flag = false;
+    while (size > 0 && data[size - 1] == '\n')
 
-    for (int i = 0; i < length(parsed); i++)
+    {
+        data[--size] = '\0'; // trailing newlines are never part of the substitution
+    }
+
+    return data;
+}
+
+bool isProcessSubstitution(char *word)
+{
+    if ((word[0] != '<' && word[0] != '>') || word[1] != '(')
 
     {
-        if (strcmp(parsed[i], ">") == 0)
+        return false;
+    }
 
-        {
-            write_flag = true;
-        }
+    char *end = matchingParen(word + 1);
+    return *end == '\0' && end[-1] == ')';
+}
 
-        if (strcmp(parsed[i], ">>") == 0)
+char *substituteProcess(char *word)
+{
+    bool input = (word[0] == '<'); // <(cmd): the command reads what cmd writes, >(cmd): cmd reads what the command writes
+    char *inner = strndup(word + 2, strlen(word) - 3);
+    int status = COMPILE_OK;
+    struct Node *tree = compileSource(inner, &status);
+    int fds[2];
 
-        {
-            append_flag = true;
-        }
+    free(inner);
 
-        if (strcmp(parsed[i], "<") == 0)
+    if (status != COMPILE_OK || pipe2(fds, O_CLOEXEC) < 0)
 
-        {
-            read_flag = true;
-        }
+    {
+        freeNode(tree);
+        lastStatus = 2;
+        return strdup("");
     }
 
-    if (write_flag == false && read_flag == false && append_flag == false)
-    
+    int theirs = input ? PIPE_WRITE_END : PIPE_READ_END;
+    outFlush();
+    int rc = spawnProcess();
+    spawnStarted(); // never reaped by the shell, only counted
+
+    if (rc < 0)
+
     {
-        handleCommand(parsed);
+        perror("ERR_FORK_FAILED");
+        close(fds[PIPE_READ_END]);
+        close(fds[PIPE_WRITE_END]);
+        freeNode(tree);
+        return strdup("");
     }
 
-    else
+    if (rc == 0)
 
     {
-        char* r = "<";
-        char* a = ">>";
-        char* w = ">";
-        int in_backup =  dup(STDIN_FILENO);
-        int out_backup = dup(STDOUT_FILENO);
+        closeSubstitutions(0); // a >(...) made before this one must see end of file when its command is done, not when this one is
+        dup2(fds[theirs], input ? STDOUT_FILENO : STDIN_FILENO);
+        close(fds[PIPE_READ_END]);
+        close(fds[PIPE_WRITE_END]);
+
+        builtinOutput = NULL;
+        executeList(tree);
+        outFlush();
+        exit(lastStatus);
+    }
 
-        if (write_flag == true) //rationale: fork each process and call the commandhandler,
+    freeNode(tree);
+    close(fds[theirs]);
 
-        {
-            int rc = fork();
+    int fd = fcntl(fds[1 - theirs], F_DUPFD_CLOEXEC, 10); // out of the way of 3>&1 style redirections
+    close(fds[1 - theirs]);
 
-            if (rc < 0)
+    if ((numOfSubstitutions & (numOfSubstitutions - 1)) == 0) // grow when the count hits a power of two
 
-            {
-                fprintf(stderr, "fork failed\n");
-                exit(1);
-            }
+    {
+        substitutionFds = realloc(substitutionFds, (numOfSubstitutions ? numOfSubstitutions * 2 : 1) * sizeof(int));
+    }
 
-            if (rc == 0) // forking a child process to handle execvp 
+    substitutionFds[numOfSubstitutions++] = fd;
 
-            {
-                int index = getIndex(w, parsed, 0);
-                char* fileName = parsed[index + 1];
-                int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666); // open file in write only mode, create if it doesn't exist, truncate to replace if it does exist
-                dup2(fd, STDOUT_FILENO); // redirect stdout to the file
-                close(fd);
+    char *path = malloc(32);
+    snprintf(path, 32, "/dev/fd/%d", fd);
+    return path;
+}
 
-                char command[index][500];
+void closeSubstitutions(int mark)
+{
+    while (numOfSubstitutions > mark)
 
-                for (int i = 0; i < index; i++)
+    {
+        close(substitutionFds[--numOfSubstitutions]); // the command is reaped later with the background jobs, it may still be running
+    }
+}
 
-                {
-                    strcpy(command[i], parsed[i]);
-                }
+int heredocFd(char *body, size_t len)
+{
+    // small bodies fit in an empty pipe without blocking, everything else goes into an anonymous
+    // memory backed file so that nothing is written to disk and there is no size limit
 
-                handleCommand(command);
-                exit(1);
-            }
+    int fds[2];
 
-            else
+    if (len > PIPE_BUF)
 
-            {
-                wait(NULL); // waiting for the child process to finish so the parent process can move forward
-                dup2(out_backup, STDOUT_FILENO);
-                close(out_backup);
-            }
-        }
-        
-        if (append_flag == true)
+    {
+        int fd = memfd_create("heredoc", MFD_CLOEXEC);
+
+        if (fd >= 0)
 
         {
-            int rc = fork();
+            size_t written = 0;
 
-            if (rc < 0)
+            while (written < len)
 
             {
-                fprintf(stderr, "fork failed\n");
-                exit(1);
-            }
+                ssize_t n = write(fd, body + written, len - written);
 
-            if (rc == 0) // forking a child process to handle execvp 
+                if (n < 0 && errno == EINTR)
 
-            {
-                int index = getIndex(a, parsed, 0);
-                char* fileName = parsed[index + 1];
-                int fd = open(fileName, O_WRONLY | O_CREAT | O_APPEND, 0666); // open file in write only mode, create if it doesn't exist, append if it does exist
-                dup2(fd, STDOUT_FILENO); // redirect stdout to the file
-                close(fd);
-                
-                char command[index][500];
+                {
+                    continue;
+                }
 
-                for (int i = 0; i < index; i++)
+                if (n <= 0)
 
                 {
-                    strcpy(command[i], parsed[i]);
+                    perror("ERR_HEREDOC_WRITE");
+                    close(fd);
+                    return -1;
                 }
 
-                handleCommand(command);
-                exit(1);
+                written += n;
             }
 
-            else
-
-            {
-                wait(NULL); // waiting for the child process to finish so the parent process can move forward
-                dup2(out_backup, STDOUT_FILENO);
-                close(out_backup);
-            }
+            lseek(fd, 0, SEEK_SET);
+            return fd;
         }
+    }
 
-        if (read_flag == true)
-
-        {
-            int rc = fork();
-
-            if (rc < 0)
+    if (pipe(fds) < 0)
 
-            {
-                fprintf(stderr, "fork failed\n");
-                exit(1);
-            }
+    {
+        perror("ERR_PIPE_FAILED");
+        return -1;
+    }
 
-            if (rc == 0) // forking a child process to handle execvp 
+    if (len <= PIPE_BUF)
 
-            {
+    {
+        if (len > 0 && write(fds[PIPE_WRITE_END], body, len) < 0)
 
-                int index = getIndex(r, parsed, 0);
-                char* fileName = parsed[index + 1];
-                //now i need to append each line from the file to the command array after parsing it.
+        {
+            perror("ERR_HEREDOC_WRITE");
+        }
+    }
 
-                FILE *f = fopen(fileName, "r");
+    else // no memfd support, feed the pipe from a child so that we never block on a full pipe
 
-                if (f == NULL) 
+    {
+        outFlush();
+        int rc = spawnProcess();
+        spawnStarted();
 
-                {
-                    perror("ERR_FILE_NOT_FOUND");
-                    exit(1);
-                }
+        if (rc < 0)
 
-                char line[MAX_STRING_LENGTH] = "";
+        {
+            perror("ERR_FORK_FAILED"); // the command reads an empty heredoc
+        }
 
-                while (fgets(line, sizeof(line), f) != NULL)
+        if (rc == 0)
 
-                {
-                    char command[index][500];
+        {
+            close(fds[PIPE_READ_END]);
 
-                    for (int i = 0; i < index; i++) 
+            size_t written = 0;
 
-                    {
-                        strcpy(command[i], parsed[i]);
-                    }
-                    
-                    char parsedLine[500][500] = {'\0'};
+            while (written < len)
 
-                    if (line == NULL)
+            {
+                ssize_t n = write(fds[PIPE_WRITE_END], body + written, len - written);
 
-                    {
-                        break;
-                    }
+                if (n <= 0)
 
-                    else
+                {
+                    break;
+                }
 
-                    {
-                        if (strlen(line) > 0 && line[strlen(line) - 1] == '\n')
-                            
-                        {
-                            line[strlen(line) - 1] = '\0';
-                        }
+                written += n;
+            }
 
-                        parser(line, parsedLine, false);
+            _exit(0);
+        }
+    }
 
-                        for (int i = 0; i < length(parsedLine); i++)
+    close(fds[PIPE_WRITE_END]);
+    return fds[PIPE_READ_END];
+}
 
-                        {
-                            strcpy(command[index + i], parsedLine[i]);
-                        }
+void setStatus(int waitStatus)
+{
+    if (WIFEXITED(waitStatus))
 
-                        handleCommand(command);
-                    }
-                }
-            }
+    {
+        lastStatus = WEXITSTATUS(waitStatus);
+    }
 
-            else
+    else if (WIFSIGNALED(waitStatus))
 
-            {
-                wait(NULL); // waiting for the child process to finish so the parent process can move forward
-                dup2(in_backup, STDIN_FILENO);
-                close(in_backup);
-            }
-        }
+    {
+        lastStatus = 128 + WTERMSIG(waitStatus); // same convention as other shells
     }
 }
 
-void replaceWildcards(char parsed[500][500]) 
+char *wordValue(char *token)
 {
-    for (int i = 0; i < 500 && parsed[i][0] != '\0'; i++) 
-    
+    return (strcmp(token, EMPTY_WORD) == 0) ? "" : token;
+}
+
+void execParsed(char **parsed)
+{
+    int count = length(parsed);
+    char **args = parsed; // rewritten in place, this never returns and the list can be longer than a stack array
+
+    for (int i = 0; i < count; i++)
+
     {
-        if (strchr(parsed[i], '*') || strchr(parsed[i], '?')) 
-        
-        {
-            glob_t glob_result;
-        
-            if (glob(parsed[i], GLOB_TILDE, NULL, &glob_result) == 0) // glob found matches, replace the pattern with the matched filenames
-            
-            {
-                char *replacement = NULL;
-                size_t length = 0;
-            
-                for (unsigned int j = 0; j < glob_result.gl_pathc; j++) 
-                
-                {
-                    length += strlen(glob_result.gl_pathv[j]) + 1; 
-                    replacement = realloc(replacement, length + 1); 
-                
-                    if (j == 0) 
-                    
-                    {
-                        strcpy(replacement, glob_result.gl_pathv[j]);
-                    }
-                    
-                    else
-                    
-                    {
-                        strcat(replacement, " ");
-                        strcat(replacement, glob_result.gl_pathv[j]);
-                    }
-                }
+        args[i] = wordValue(parsed[i]);
+    }
 
-                strcpy(parsed[i], replacement);
-                free(replacement);
-                globfree(&glob_result);
-            } 
-            
-            else 
-            
-            {
-                globfree(&glob_result); // no matches were found, leave the pattern as is
-            }
-        }
+    args[count] = NULL;
+
+    for (int i = 0; i < numOfSubstitutions; i++)
+
+    {
+        fcntl(substitutionFds[i], F_SETFD, 0); // the command opens these as /dev/fd/N, they must survive the exec
     }
+
+    execvp(args[0], args);
+
+    int error = errno;
+    STATS_ADD(execFailures, 1); // counted here, the exit status may be passed up through a redirection's child too
+    perror("ERR_EXECVP_FAILED");
+    exit((error == ENOENT) ? 127 : 126);
 }
@@ -0,0 +1,237 @@
+/**
+ * @file output.c
+ * @brief Gathers builtin output into one writev() per command. Short pieces are copied into an arena, long ones
+ * (echo arguments, history lines) are referenced in place, and the iovec list is built from both at flush time.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "output.h"
+#include "shell.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define COPY_THRESHOLD 256      // pieces shorter than this are cheaper to copy than to give their own iovec
+#define FLUSH_THRESHOLD 65536   // bytes queued before flushing early, bounds the memory a huge listing can take
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// ---- STRUCTS ----
+
+struct OutputPiece
+{
+    const char *ref;        // referenced piece, NULL for a piece stored in the arena
+    size_t offset;          // arena pieces: where the bytes start (the arena may move while it grows)
+    size_t len;
+};
+
+// ---- GLOBAL VARIABLES ----
+
+static struct Buffer arena = {NULL, 0, 0};
+static struct OutputPiece *pieces = NULL;
+static int numOfPieces = 0;
+static int piecesCapacity = 0;
+static size_t queuedBytes = 0;
+static unsigned long long totalBytes = 0;
+
+// ---- FUNCTION DECLARATIONS ----
+
+static void addPiece(const char *ref, size_t offset, size_t len); //appends a piece to the queue
+static void writeAll(struct iovec *iov, int count); //writev() that copes with short writes and EINTR
+
+void outWrite(const char *str, size_t len)
+{
+    if (len == 0)
+
+    {
+        return;
+    }
+
+    totalBytes += len;
+    struct OutputPiece *last = (numOfPieces > 0) ? &pieces[numOfPieces - 1] : NULL;
+
+    if (last != NULL && last->ref == NULL && last->offset + last->len == arena.len)
+
+    {
+        last->len += len; // consecutive copies share one iovec
+        queuedBytes += len;
+    }
+
+    else
+
+    {
+        addPiece(NULL, arena.len, len);
+    }
+
+    bufferAppend(&arena, str, len);
+
+    if (queuedBytes >= FLUSH_THRESHOLD)
+
+    {
+        outFlush();
+    }
+}
+
+void outWriteRef(const char *str, size_t len)
+{
+    if (len < COPY_THRESHOLD)
+
+    {
+        outWrite(str, len);
+        return;
+    }
+
+    totalBytes += len;
+    addPiece(str, 0, len);
+
+    if (queuedBytes >= FLUSH_THRESHOLD)
+
+    {
+        outFlush();
+    }
+}
+
+void outPrintf(const char *format, ...)
+{
+    char small[512];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+
+    if (len < 0)
+
+    {
+        return;
+    }
+
+    if ((size_t) len < sizeof(small))
+
+    {
+        outWrite(small, len);
+        return;
+    }
+
+    char *large = malloc(len + 1);
+
+    va_start(args, format);
+    vsnprintf(large, len + 1, format, args);
+    va_end(args);
+
+    outWrite(large, len);
+    free(large);
+}
+
+unsigned long long outTotal()
+{
+    return totalBytes;
+}
+
+void outFlush()
+{
+    fflush(stdout); // whatever went through stdio came first
+
+    if (numOfPieces == 0)
+
+    {
+        return;
+    }
+
+    if (builtinOutput != NULL) // capturing $(...) in-process
+
+    {
+        for (int i = 0; i < numOfPieces; i++)
+
+        {
+            fwrite(pieces[i].ref ? pieces[i].ref : arena.data + pieces[i].offset, 1, pieces[i].len, builtinOutput);
+        }
+    }
+
+    else
+
+    {
+        struct iovec iov[IOV_MAX];
+        int count = 0;
+
+        for (int i = 0; i < numOfPieces; i++)
+
+        {
+            iov[count].iov_base = (void *) (pieces[i].ref ? pieces[i].ref : arena.data + pieces[i].offset);
+            iov[count].iov_len = pieces[i].len;
+            count++;
+
+            if (count == IOV_MAX)
+
+            {
+                writeAll(iov, count);
+                count = 0;
+            }
+        }
+
+        writeAll(iov, count);
+    }
+
+    numOfPieces = 0;
+    queuedBytes = 0;
+    arena.len = 0;
+}
+
+static void addPiece(const char *ref, size_t offset, size_t len)
+{
+    if (numOfPieces == piecesCapacity)
+
+    {
+        piecesCapacity = piecesCapacity ? piecesCapacity * 2 : 64;
+        pieces = realloc(pieces, piecesCapacity * sizeof(struct OutputPiece));
+    }
+
+    pieces[numOfPieces].ref = ref;
+    pieces[numOfPieces].offset = offset;
+    pieces[numOfPieces].len = len;
+    numOfPieces++;
+    queuedBytes += len;
+}
+
+static void writeAll(struct iovec *iov, int count)
+{
+    while (count > 0)
+
+    {
+        ssize_t written = writev(STDOUT_FILENO, iov, count);
+
+        if (written < 0)
+
+        {
+            if (errno == EINTR)
+
+            {
+                continue;
+            }
+
+            return; // closed pipe, full disk, ...: the output is lost like it would be with stdio
+        }
+
+        while (count > 0 && (size_t) written >= iov->iov_len)
+
+        {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0)
+
+        {
+            iov->iov_base = (char *) iov->iov_base + written; // short write, resume mid piece
+            iov->iov_len -= written;
+        }
+    }
+}
@@ -0,0 +1,194 @@
+/**
+ * @file pipes.c
+ * @brief Pipe capacity (F_SETPIPE_SZ) and per-stage pipeline counters. The counters are read from the finished
+ * stage before it is reaped: /proc/PID/io for the bytes it read and wrote (children it waited for included) and
+ * wait4()'s rusage for its voluntary context switches, so measuring costs nothing while the pipeline runs.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#define _GNU_SOURCE // F_SETPIPE_SZ, F_GETPIPE_SZ
+
+#include "pipes.h"
+#include "shell.h"
+#include "spawn.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define DEFAULT_PIPE_MAX_SIZE 1048576 // the kernel's default for /proc/sys/fs/pipe-max-size
+
+// ---- FUNCTION DECLARATIONS ----
+
+static long pipeMaxSize(); //reads /proc/sys/fs/pipe-max-size once
+static void readIoCounters(pid_t pid, struct StageStats *stats); //fills the byte counters from /proc/PID/io
+
+long parsePipeSize(char *text)
+{
+    if (text == NULL || !isdigit((unsigned char) text[0]))
+
+    {
+        return 0;
+    }
+
+    char *end = NULL;
+    long long size = strtoll(text, &end, 10);
+
+    switch (toupper((unsigned char) *end))
+
+    {
+        case 'G': size *= 1024;   // fall through
+        case 'M': size *= 1024;   // fall through
+        case 'K': size *= 1024; end++; break;
+        default: break;
+    }
+
+    if (*end != '\0' && toupper((unsigned char) *end) != 'B') // 4M and 4MB are both fine
+
+    {
+        return 0;
+    }
+
+    return (size > pipeMaxSize()) ? pipeMaxSize() : (long) size;
+}
+
+long pipeSize(char *prefix)
+{
+    if (prefix != NULL)
+
+    {
+        char *expanded = expandWord(strchr(prefix, '=') + 1, EXPAND_WORD);
+        long size = parsePipeSize(expanded);
+        free(expanded);
+        return size;
+    }
+
+    return parsePipeSize(getVariable("PIPESIZE"));
+}
+
+long resizePipe(int fd, long size)
+{
+    if (size > 0)
+
+    {
+        fcntl(fd, F_SETPIPE_SZ, (int) size); // EPERM past the user's pipe page quota, the pipe keeps its old size
+    }
+
+    return fcntl(fd, F_GETPIPE_SZ);
+}
+
+bool isVerbose()
+{
+    char *verbose = getVariable("VERBOSE");
+    return verbose != NULL && verbose[0] != '\0' && strcmp(verbose, "0") != 0;
+}
+
+int waitStage(pid_t pid, struct StageStats *stats, struct rusage *usage)
+{
+    int status = 0;
+
+    memset(usage, 0, sizeof(struct rusage));
+
+    if (takeReapedStatus(pid, &status)) // reaped while fork() was short of process slots, its counters went with it
+
+    {
+        if (stats != NULL)
+
+        {
+            stats->readBytes = stats->writtenBytes = 0;
+            stats->stalls = 0;
+        }
+
+        return status;
+    }
+
+    if (stats == NULL)
+
+    {
+        wait4(pid, &status, 0, usage);
+        return status;
+    }
+
+    siginfo_t info;
+
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR) // exited but still readable in /proc
+
+    {
+    }
+
+    readIoCounters(pid, stats);
+
+    wait4(pid, &status, 0, usage);
+    stats->stalls = usage->ru_nvcsw;
+
+    return status;
+}
+
+void reportPipeline(struct StageStats *stats, int numOfStages, long size)
+{
+    fprintf(stderr, "pipeline: %d stages, pipe capacity %ld bytes\n", numOfStages, size);
+
+    for (int i = 0; i < numOfStages; i++)
+
+    {
+        fprintf(stderr, "  %d: %s: read %lld bytes, wrote %lld bytes, %ld stalls\n", i + 1, stats[i].name, stats[i].readBytes, stats[i].writtenBytes, stats[i].stalls);
+    }
+}
+
+static long pipeMaxSize()
+{
+    static long maxSize = 0;
+
+    if (maxSize == 0)
+
+    {
+        FILE *file = fopen("/proc/sys/fs/pipe-max-size", "r");
+
+        if (file == NULL || fscanf(file, "%ld", &maxSize) != 1 || maxSize <= 0)
+
+        {
+            maxSize = DEFAULT_PIPE_MAX_SIZE;
+        }
+
+        if (file != NULL)
+
+        {
+            fclose(file);
+        }
+    }
+
+    return maxSize;
+}
+
+static void readIoCounters(pid_t pid, struct StageStats *stats)
+{
+    char path[64];
+    char line[128];
+
+    stats->readBytes = 0;
+    stats->writtenBytes = 0;
+    snprintf(path, sizeof(path), "/proc/%d/io", (int) pid);
+
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+
+    {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+
+    {
+        sscanf(line, "rchar: %lld", &stats->readBytes);
+        sscanf(line, "wchar: %lld", &stats->writtenBytes);
+    }
+
+    fclose(file);
+}
@@ -0,0 +1,479 @@
+/**
+ * @file profile.c
+ * @brief Per-line script profiler. Commands push a frame when they start and pop it when they are done; the costs
+ * are global running totals that each frame takes a snapshot of, so a hook on a hot path is one addition and the
+ * per-line numbers are the differences between the snapshots. The folded stacks are kept in a hash table keyed by
+ * the stack text, which grows by one frame label per running command.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "profile.h"
+#include "shell.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_LABEL 60 // characters of a line's text used for its frame in the folded stacks and in the report
+
+// ---- STRUCTS ----
+
+struct LineProfile
+{
+    unsigned long long runs;
+    unsigned long long spawns;
+    long long parseNs;
+    long long expansionNs;
+    long long wallNs;
+    long long userUs;       // cpu time of the children reaped while the line ran
+    long long sysUs;
+    long maxRss;            // KiB, the largest of those children
+    int active;             // frames of this line on the stack, a recursive call is only counted by the outermost one
+};
+
+struct Frame
+{
+    int line;
+    long long started;
+    long long calleesNs;    // wall time of the frames it called, the rest is its own time in the folded stacks
+    unsigned long long spawns; // the running totals when the frame was pushed
+    long long expansionNs;
+    long long userUs;
+    long long sysUs;
+    long maxRss;            // largest child reaped since the frame was pushed
+    size_t stackLen;        // length of the folded stack without this frame
+};
+
+struct FoldedStack
+{
+    char *stack;            // NULL for an empty slot
+    long long ns;
+};
+
+// ---- GLOBAL VARIABLES ----
+
+bool profiling = false;
+
+static pid_t profiler = 0; // forked children keep a copy of everything, only the shell that started reports
+static char *scriptName = NULL;
+static char *outputPath = NULL;
+static char *source = NULL; // a copy of the script split into lines, for the labels
+static char **lineText = NULL; // lineText[1] is the first line
+static int numOfLines = 0;
+static struct LineProfile *lines = NULL; // indexed by line number, 0 collects commands of unknown lines
+static struct Frame *frames = NULL;
+static int numOfFrames = 0;
+static int framesCapacity = 0;
+static struct Buffer stack = {NULL, 0, 0}; // the folded stack of the running command: script;LINE: text;...
+static struct FoldedStack *folded = NULL;
+static size_t foldedCapacity = 0; // a power of two
+static size_t numOfFolded = 0;
+
+static long long startedAt = 0;
+static long long lexNs = 0;
+static long long topLevelNs = 0; // wall time of the frames at the bottom of the stack
+static long long *totalExpansionNs = NULL; // in a MAP_SHARED page, redirected commands and pipeline stages expand after their fork
+static long long totalUserUs = 0;
+static long long totalSysUs = 0;
+
+// ---- FUNCTION DECLARATIONS ----
+
+static void appendLabel(struct Buffer *out, int line, bool folded); //appends a line's label, "LINE: text", without semicolons for the folded stacks
+static void addFolded(const char *text, long long ns); //adds ns to a stack in the hash table, inserting it if it is new
+static int compareStacks(const void *a, const void *b); //orders folded stacks by their text
+static int compareLines(const void *a, const void *b); //orders line numbers by wall time, most expensive first
+static void writeFolded(); //writes the folded stacks to outputPath
+static void printReport(long long total); //prints the per-line table on stderr, total is the script's wall time
+static void finishProfile(); //pops the frames still running and reports, registered with atexit()
+
+void startProfile(char *script, char *output)
+{
+    const char *base = strrchr(script, '/') ? strrchr(script, '/') + 1 : script;
+
+    totalExpansionNs = mmap(NULL, sizeof(long long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (totalExpansionNs == MAP_FAILED)
+
+    {
+        static long long privateExpansionNs = 0; // children's expansions go uncounted
+        totalExpansionNs = &privateExpansionNs;
+    }
+
+    profiling = true;
+    profiler = getpid();
+    startedAt = profileClock();
+    scriptName = strdup(script);
+
+    if (output != NULL)
+
+    {
+        outputPath = strdup(output);
+    }
+
+    else
+
+    {
+        outputPath = malloc(strlen(base) + sizeof(".folded"));
+        sprintf(outputPath, "%s.folded", base);
+    }
+
+    source = readFile(script); // launchScriptMode() reads its own copy, this one is cut into lines
+    numOfLines = 1;
+
+    for (char *ptr = strchr(source, '\n'); ptr != NULL; ptr = strchr(ptr + 1, '\n'))
+
+    {
+        numOfLines++;
+    }
+
+    lineText = malloc((numOfLines + 1) * sizeof(char *));
+    lines = calloc(numOfLines + 1, sizeof(struct LineProfile));
+    lineText[0] = "?";
+    lineText[1] = source;
+
+    for (int i = 2; i <= numOfLines; i++)
+
+    {
+        char *newline = strchr(lineText[i - 1], '\n');
+        *newline = '\0';
+        lineText[i] = newline + 1;
+    }
+
+    for (const char *ptr = base; *ptr != '\0'; ptr++) // the root frame
+
+    {
+        bufferAppend(&stack, *ptr == ';' ? "," : ptr, 1);
+    }
+
+    bufferAppend(&stack, "", 0);
+    atexit(finishProfile);
+}
+
+long long profileClock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void profileParse(int line, long long started)
+{
+    long long elapsed = profileClock() - started;
+
+    if (line <= 0 || line > numOfLines)
+
+    {
+        lexNs += elapsed;
+        return;
+    }
+
+    lines[line].parseNs += elapsed;
+}
+
+void profileExpansion(long long started)
+{
+    __atomic_fetch_add(totalExpansionNs, profileClock() - started, __ATOMIC_RELAXED);
+}
+
+void profileChild(struct rusage *usage)
+{
+    totalUserUs += usage->ru_utime.tv_sec * 1000000LL + usage->ru_utime.tv_usec;
+    totalSysUs += usage->ru_stime.tv_sec * 1000000LL + usage->ru_stime.tv_usec;
+
+    if (numOfFrames > 0 && usage->ru_maxrss > frames[numOfFrames - 1].maxRss)
+
+    {
+        frames[numOfFrames - 1].maxRss = usage->ru_maxrss;
+    }
+}
+
+void profileEnter(int line)
+{
+    if (line < 0 || line > numOfLines)
+
+    {
+        line = 0;
+    }
+
+    if (numOfFrames == framesCapacity)
+
+    {
+        framesCapacity = framesCapacity ? framesCapacity * 2 : 32;
+        frames = realloc(frames, framesCapacity * sizeof(struct Frame));
+    }
+
+    struct Frame *frame = &frames[numOfFrames++];
+
+    frame->line = line;
+    frame->calleesNs = 0;
+    frame->spawns = shellStats->spawns;
+    frame->expansionNs = *totalExpansionNs;
+    frame->userUs = totalUserUs;
+    frame->sysUs = totalSysUs;
+    frame->maxRss = 0;
+    frame->stackLen = stack.len;
+
+    bufferAppend(&stack, ";", 1);
+    appendLabel(&stack, line, true);
+    lines[line].active++;
+    frame->started = profileClock(); // last, so the bookkeeping above isn't charged to the command
+}
+
+void profileLeave()
+{
+    long long ended = profileClock();
+
+    if (numOfFrames == 0)
+
+    {
+        return;
+    }
+
+    struct Frame *frame = &frames[--numOfFrames];
+    struct LineProfile *line = &lines[frame->line];
+    long long wall = ended - frame->started;
+
+    line->runs++;
+
+    if (--line->active == 0) // the outermost call of a recursion already covers the inner ones
+
+    {
+        line->wallNs += wall;
+        line->spawns += shellStats->spawns - frame->spawns;
+        line->expansionNs += *totalExpansionNs - frame->expansionNs;
+        line->userUs += totalUserUs - frame->userUs;
+        line->sysUs += totalSysUs - frame->sysUs;
+    }
+
+    if (frame->maxRss > line->maxRss)
+
+    {
+        line->maxRss = frame->maxRss;
+    }
+
+    addFolded(stack.data, wall - frame->calleesNs);
+    stack.len = frame->stackLen;
+    stack.data[stack.len] = '\0';
+
+    if (numOfFrames > 0)
+
+    {
+        struct Frame *caller = &frames[numOfFrames - 1];
+        caller->calleesNs += wall;
+        caller->maxRss = (frame->maxRss > caller->maxRss) ? frame->maxRss : caller->maxRss;
+    }
+
+    else
+
+    {
+        topLevelNs += wall;
+    }
+}
+
+static void appendLabel(struct Buffer *out, int line, bool folded)
+{
+    char label[MAX_LABEL + 16];
+    const char *text = lineText[line];
+    int len = 0;
+
+    while (*text == ' ' || *text == '\t')
+
+    {
+        text++;
+    }
+
+    len = snprintf(label, sizeof(label), "%d: %.*s", line, MAX_LABEL, text);
+    len = (len < (int) sizeof(label)) ? len : (int) sizeof(label) - 1;
+
+    while (len > 0 && (label[len - 1] == ' ' || label[len - 1] == '\t' || label[len - 1] == '\r'))
+
+    {
+        len--;
+    }
+
+    for (int i = 0; i < len; i++)
+
+    {
+        if ((label[i] == ';' && folded) || label[i] == '\t')
+
+        {
+            label[i] = (label[i] == ';') ? ',' : ' '; // ; separates frames
+        }
+    }
+
+    bufferAppend(out, label, len);
+}
+
+static void addFolded(const char *text, long long ns)
+{
+    if (numOfFolded * 2 >= foldedCapacity) // rehash at half full
+
+    {
+        size_t oldCapacity = foldedCapacity;
+        struct FoldedStack *old = folded;
+
+        foldedCapacity = foldedCapacity ? foldedCapacity * 2 : 256;
+        folded = calloc(foldedCapacity, sizeof(struct FoldedStack));
+        numOfFolded = 0;
+
+        for (size_t i = 0; i < oldCapacity; i++)
+
+        {
+            if (old[i].stack != NULL)
+
+            {
+                addFolded(old[i].stack, old[i].ns);
+                free(old[i].stack);
+            }
+        }
+
+        free(old);
+    }
+
+    unsigned long long hash = 14695981039346656037ULL; // FNV-1a
+
+    for (const char *ptr = text; *ptr != '\0'; ptr++)
+
+    {
+        hash = (hash ^ (unsigned char) *ptr) * 1099511628211ULL;
+    }
+
+    size_t slot = hash & (foldedCapacity - 1);
+
+    while (folded[slot].stack != NULL && strcmp(folded[slot].stack, text) != 0)
+
+    {
+        slot = (slot + 1) & (foldedCapacity - 1);
+    }
+
+    if (folded[slot].stack == NULL)
+
+    {
+        folded[slot].stack = strdup(text);
+        numOfFolded++;
+    }
+
+    folded[slot].ns += ns;
+}
+
+static int compareStacks(const void *a, const void *b)
+{
+    return strcmp(((const struct FoldedStack *) a)->stack, ((const struct FoldedStack *) b)->stack);
+}
+
+static int compareLines(const void *a, const void *b)
+{
+    const struct LineProfile *x = &lines[*(const int *) a];
+    const struct LineProfile *y = &lines[*(const int *) b];
+
+    if (x->wallNs != y->wallNs)
+
+    {
+        return (x->wallNs < y->wallNs) ? 1 : -1;
+    }
+
+    return *(const int *) a - *(const int *) b;
+}
+
+static void writeFolded()
+{
+    FILE *file = fopen(outputPath, "w");
+
+    if (file == NULL)
+
+    {
+        perror(outputPath);
+        return;
+    }
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < foldedCapacity; i++) // packed to the front and sorted, so two profiles can be diffed
+
+    {
+        if (folded[i].stack != NULL)
+
+        {
+            folded[count++] = folded[i];
+        }
+    }
+
+    qsort(folded, count, sizeof(struct FoldedStack), compareStacks);
+
+    for (size_t i = 0; i < count; i++)
+
+    {
+        fprintf(file, "%s %lld\n", folded[i].stack, folded[i].ns / 1000); // flamegraph.pl wants whole numbers, microseconds
+    }
+
+    fclose(file);
+    fprintf(stderr, "folded stacks written to %s\n", outputPath);
+}
+
+static void printReport(long long total)
+{
+    int *order = malloc((numOfLines + 1) * sizeof(int));
+    int count = 0;
+
+    for (int i = 0; i <= numOfLines; i++)
+
+    {
+        if (lines[i].runs > 0 || lines[i].parseNs > 0)
+
+        {
+            order[count++] = i;
+        }
+    }
+
+    qsort(order, count, sizeof(int), compareLines);
+
+    fprintf(stderr, "profile of %s: %.3f s wall, %llu processes, %.3f s user and %.3f s sys in children, %.3f ms lexing\n",
+            scriptName, total / 1e9, shellStats->spawns, totalUserUs / 1e6, totalSysUs / 1e6, lexNs / 1e6);
+    fprintf(stderr, "%5s %8s %11s %9s %9s %7s %10s %10s %8s  %s\n", "line", "runs", "wall ms", "parse ms", "expand ms",
+            "spawns", "user ms", "sys ms", "rss KiB", "command");
+
+    for (int i = 0; i < count; i++)
+
+    {
+        struct LineProfile *line = &lines[order[i]];
+        struct Buffer label = {NULL, 0, 0};
+        char *text = NULL;
+
+        appendLabel(&label, order[i], false);
+        bufferAppend(&label, "", 0);
+        text = strchr(label.data, ' ');
+
+        fprintf(stderr, "%5d %8llu %11.3f %9.3f %9.3f %7llu %10.3f %10.3f %8ld  %s\n", order[i], line->runs,
+                line->wallNs / 1e6, line->parseNs / 1e6, line->expansionNs / 1e6, line->spawns, line->userUs / 1e3,
+                line->sysUs / 1e3, line->maxRss, text ? text + 1 : "");
+        free(label.data);
+    }
+
+    free(order);
+}
+
+static void finishProfile()
+{
+    if (getpid() != profiler)
+
+    {
+        return;
+    }
+
+    while (numOfFrames > 0) // exit ran in the middle of a command, or of a function
+
+    {
+        profileLeave();
+    }
+
+    long long total = profileClock() - startedAt;
+
+    addFolded(stack.data, total - topLevelNs); // the shell's own time, lexing, parsing and the script's bookkeeping
+    printReport(total);
+    writeFolded();
+    profiling = false;
+}
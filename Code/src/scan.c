@@ -0,0 +1,614 @@
+/**
+ * @file scan.c
+ * @brief SIMD scanning kernels. Every kernel compares a whole vector of input bytes at once and turns the result
+ * into a bit mask with movemask, so finding, counting and word boundaries are bit operations on 16 or 32 bytes at
+ * a time. The fixed-string search compares the needle's first and last bytes at every position of a vector and
+ * only memcmp()s the positions where both match. findAny() compares every vector with each byte of the set and
+ * ORs the results; without SIMD it does the same eight bytes at a time in a 64-bit word (SWAR). The AVX2 versions are compiled with a target attribute, so the
+ * binary runs on any x86-64 and only uses them when cpuid says they are there.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#define _GNU_SOURCE // memmem(), memrchr()
+
+#include "scan.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+// ---- STRUCTS ----
+
+struct ScanKernels
+{
+    const char *name;
+    const char *(*findByte)(const char *data, size_t len, char c);
+    const char *(*findEither)(const char *data, size_t len, char a, char b);
+    size_t (*countByte)(const char *data, size_t len, char c);
+    size_t (*countWords)(const char *data, size_t len, bool *inWord);
+    const char *(*findString)(const char *data, size_t len, const char *needle, size_t needleLen);
+    const char *(*findAny)(const char *data, size_t len, const char *set, size_t setLen);
+};
+
+// ---- FUNCTION DECLARATIONS ----
+
+static void selectKernels(); //picks the kernels for this CPU
+static bool isSpace(unsigned char c); //the bytes wc and isspace() in the C locale treat as white space
+static const char *findByteScalar(const char *data, size_t len, char c);
+static const char *findEitherScalar(const char *data, size_t len, char a, char b);
+static size_t countByteScalar(const char *data, size_t len, char c);
+static size_t countWordsScalar(const char *data, size_t len, bool *inWord);
+static const char *findStringScalar(const char *data, size_t len, const char *needle, size_t needleLen);
+static const char *findAnyScalar(const char *data, size_t len, const char *set, size_t setLen);
+
+// ---- GLOBAL VARIABLES ----
+
+static struct ScanKernels kernels = {NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+
+static const struct ScanKernels scalarKernels = {
+    "scalar", findByteScalar, findEitherScalar, countByteScalar, countWordsScalar, findStringScalar, findAnyScalar
+};
+
+const char *findByte(const char *data, size_t len, char c)
+{
+    if (kernels.name == NULL)
+
+    {
+        selectKernels();
+    }
+
+    return kernels.findByte(data, len, c);
+}
+
+const char *findEither(const char *data, size_t len, char a, char b)
+{
+    if (kernels.name == NULL)
+
+    {
+        selectKernels();
+    }
+
+    return kernels.findEither(data, len, a, b);
+}
+
+size_t countByte(const char *data, size_t len, char c)
+{
+    if (kernels.name == NULL)
+
+    {
+        selectKernels();
+    }
+
+    return kernels.countByte(data, len, c);
+}
+
+size_t countWords(const char *data, size_t len, bool *inWord)
+{
+    if (kernels.name == NULL)
+
+    {
+        selectKernels();
+    }
+
+    return kernels.countWords(data, len, inWord);
+}
+
+const char *findString(const char *data, size_t len, const char *needle, size_t needleLen)
+{
+    if (needleLen == 0)
+
+    {
+        return data; // the empty string is everywhere
+    }
+
+    if (needleLen > len)
+
+    {
+        return NULL;
+    }
+
+    if (kernels.name == NULL)
+
+    {
+        selectKernels();
+    }
+
+    return kernels.findString(data, len, needle, needleLen);
+}
+
+const char *findAny(const char *data, size_t len, const char *set)
+{
+    size_t setLen = strlen(set);
+
+    if (setLen > MAX_FIND_SET)
+
+    {
+        setLen = MAX_FIND_SET;
+    }
+
+    if (kernels.name == NULL)
+
+    {
+        selectKernels();
+    }
+
+    return kernels.findAny(data, len, set, setLen);
+}
+
+const char *scanLevel()
+{
+    if (kernels.name == NULL)
+
+    {
+        selectKernels();
+    }
+
+    return kernels.name;
+}
+
+// ---- SCALAR ----
+
+static bool isSpace(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static const char *findByteScalar(const char *data, size_t len, char c)
+{
+    return memchr(data, c, len);
+}
+
+static const char *findEitherScalar(const char *data, size_t len, char a, char b)
+{
+    for (size_t i = 0; i < len; i++)
+
+    {
+        if (data[i] == a || data[i] == b)
+
+        {
+            return data + i;
+        }
+    }
+
+    return NULL;
+}
+
+static size_t countByteScalar(const char *data, size_t len, char c)
+{
+    size_t count = 0;
+
+    for (const char *ptr = memchr(data, c, len); ptr != NULL; ptr = memchr(ptr + 1, c, data + len - ptr - 1))
+
+    {
+        count++;
+    }
+
+    return count;
+}
+
+static size_t countWordsScalar(const char *data, size_t len, bool *inWord)
+{
+    size_t count = 0;
+    bool word = *inWord;
+
+    for (size_t i = 0; i < len; i++)
+
+    {
+        bool space = isSpace((unsigned char) data[i]);
+        count += (!space && !word);
+        word = !space;
+    }
+
+    *inWord = word;
+    return count;
+}
+
+static const char *findStringScalar(const char *data, size_t len, const char *needle, size_t needleLen)
+{
+    return memmem(data, len, needle, needleLen);
+}
+
+static const char *findAnyScalar(const char *data, size_t len, const char *set, size_t setLen)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8)
+
+    {
+        uint64_t word;
+        uint64_t hits = 0;
+
+        memcpy(&word, data + i, 8);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word); // the first byte has to be the lowest
+#endif
+
+        for (size_t k = 0; k < setLen; k++)
+
+        {
+            // a byte of x is zero where word holds set[k]; borrows only flag bytes above a real match, so the
+            // lowest flagged byte is exact
+            uint64_t x = word ^ (ones * (unsigned char) set[k]);
+            hits |= (x - ones) & ~x & highs;
+        }
+
+        if (hits != 0)
+
+        {
+            return data + i + __builtin_ctzll(hits) / 8;
+        }
+    }
+
+    for (; i < len; i++)
+
+    {
+        if (memchr(set, data[i], setLen) != NULL)
+
+        {
+            return data + i;
+        }
+    }
+
+    return NULL;
+}
+
+#ifdef SCAN_X86
+
+// ---- SSE2 ----
+
+static const char *findByteSse2(const char *data, size_t len, char c)
+{
+    __m128i wanted = _mm_set1_epi8(c);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+
+    {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + i)), wanted));
+
+        if (mask != 0)
+
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+
+    return findByteScalar(data + i, len - i, c);
+}
+
+static const char *findEitherSse2(const char *data, size_t len, char a, char b)
+{
+    __m128i first = _mm_set1_epi8(a);
+    __m128i second = _mm_set1_epi8(b);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *) (data + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, second)));
+
+        if (mask != 0)
+
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+
+    return findEitherScalar(data + i, len - i, a, b);
+}
+
+static size_t countByteSse2(const char *data, size_t len, char c)
+{
+    __m128i wanted = _mm_set1_epi8(c);
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i + 16 <= len)
+
+    {
+        // matches are -1 per byte lane, summed in the lanes for up to 255 blocks before they could overflow
+        __m128i lanes = _mm_setzero_si128();
+        size_t end = (len - i) / 16 > 255 ? i + 255 * 16 : i + (len - i) / 16 * 16;
+
+        for (; i < end; i += 16)
+
+        {
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + i)), wanted));
+        }
+
+        __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+        count += (size_t) _mm_cvtsi128_si32(sums) + (size_t) _mm_extract_epi16(sums, 4);
+    }
+
+    return count + countByteScalar(data + i, len - i, c);
+}
+
+static unsigned spaceMaskSse2(__m128i block)
+{
+    __m128i shifted = _mm_sub_epi8(block, _mm_set1_epi8('\t')); // \t .. \r become 0 .. 4
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    return _mm_movemask_epi8(_mm_or_si128(control, _mm_cmpeq_epi8(block, _mm_set1_epi8(' '))));
+}
+
+static size_t countWordsSse2(const char *data, size_t len, bool *inWord)
+{
+    unsigned previous = *inWord ? 0 : 1; // whether the byte before the block was white space
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+
+    {
+        unsigned spaces = spaceMaskSse2(_mm_loadu_si128((const __m128i *) (data + i)));
+        unsigned starts = ~spaces & ((spaces << 1) | previous) & 0xFFFF; // a word starts after white space
+        count += __builtin_popcount(starts);
+        previous = (spaces >> 15) & 1;
+    }
+
+    *inWord = !previous;
+    return count + countWordsScalar(data + i, len - i, inWord);
+}
+
+static const char *findStringSse2(const char *data, size_t len, const char *needle, size_t needleLen)
+{
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needleLen - 1]);
+    size_t i = 0;
+
+    for (; i + needleLen - 1 + 16 <= len; i += 16)
+
+    {
+        __m128i head = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + i)), first);
+        __m128i tail = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + i + needleLen - 1)), last);
+
+        for (unsigned mask = _mm_movemask_epi8(_mm_and_si128(head, tail)); mask != 0; mask &= mask - 1)
+
+        {
+            const char *candidate = data + i + __builtin_ctz(mask);
+
+            if (needleLen <= 2 || memcmp(candidate + 1, needle + 1, needleLen - 2) == 0)
+
+            {
+                return candidate;
+            }
+        }
+    }
+
+    return findStringScalar(data + i, len - i, needle, needleLen);
+}
+
+static const char *findAnySse2(const char *data, size_t len, const char *set, size_t setLen)
+{
+    __m128i wanted[MAX_FIND_SET];
+    size_t i = 0;
+
+    for (size_t k = 0; k < setLen; k++)
+
+    {
+        wanted[k] = _mm_set1_epi8(set[k]);
+    }
+
+    for (; i + 16 <= len; i += 16)
+
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i hits = _mm_setzero_si128();
+
+        for (size_t k = 0; k < setLen; k++)
+
+        {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, wanted[k]));
+        }
+
+        unsigned mask = _mm_movemask_epi8(hits);
+
+        if (mask != 0)
+
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+
+    return findAnyScalar(data + i, len - i, set, setLen);
+}
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2")))
+static const char *findByteAvx2(const char *data, size_t len, char c)
+{
+    __m256i wanted = _mm256_set1_epi8(c);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+
+    {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (data + i)), wanted));
+
+        if (mask != 0)
+
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+
+    return findByteSse2(data + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+static const char *findEitherAvx2(const char *data, size_t len, char a, char b)
+{
+    __m256i first = _mm256_set1_epi8(a);
+    __m256i second = _mm256_set1_epi8(b);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, first), _mm256_cmpeq_epi8(block, second)));
+
+        if (mask != 0)
+
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+
+    return findEitherSse2(data + i, len - i, a, b);
+}
+
+__attribute__((target("avx2")))
+static size_t countByteAvx2(const char *data, size_t len, char c)
+{
+    __m256i wanted = _mm256_set1_epi8(c);
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i + 32 <= len)
+
+    {
+        __m256i lanes = _mm256_setzero_si256();
+        size_t end = (len - i) / 32 > 255 ? i + 255 * 32 : i + (len - i) / 32 * 32;
+
+        for (; i < end; i += 32)
+
+        {
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (data + i)), wanted));
+        }
+
+        __m256i sums = _mm256_sad_epu8(lanes, _mm256_setzero_si256());
+        count += (size_t) _mm256_extract_epi64(sums, 0) + (size_t) _mm256_extract_epi64(sums, 1) +
+                 (size_t) _mm256_extract_epi64(sums, 2) + (size_t) _mm256_extract_epi64(sums, 3);
+    }
+
+    return count + countByteSse2(data + i, len - i, c);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t countWordsAvx2(const char *data, size_t len, bool *inWord)
+{
+    uint32_t previous = *inWord ? 0 : 1;
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i shifted = _mm256_sub_epi8(block, _mm256_set1_epi8('\t'));
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+        uint32_t spaces = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(control, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '))));
+        uint32_t starts = ~spaces & ((spaces << 1) | previous);
+
+        count += __builtin_popcount(starts);
+        previous = spaces >> 31;
+    }
+
+    *inWord = !previous;
+    return count + countWordsSse2(data + i, len - i, inWord);
+}
+
+__attribute__((target("avx2")))
+static const char *findStringAvx2(const char *data, size_t len, const char *needle, size_t needleLen)
+{
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[needleLen - 1]);
+    size_t i = 0;
+
+    for (; i + needleLen - 1 + 32 <= len; i += 32)
+
+    {
+        __m256i head = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (data + i)), first);
+        __m256i tail = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (data + i + needleLen - 1)), last);
+
+        for (unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(head, tail)); mask != 0; mask &= mask - 1)
+
+        {
+            const char *candidate = data + i + __builtin_ctz(mask);
+
+            if (needleLen <= 2 || memcmp(candidate + 1, needle + 1, needleLen - 2) == 0)
+
+            {
+                return candidate;
+            }
+        }
+    }
+
+    return findStringSse2(data + i, len - i, needle, needleLen);
+}
+
+__attribute__((target("avx2")))
+static const char *findAnyAvx2(const char *data, size_t len, const char *set, size_t setLen)
+{
+    __m256i wanted[MAX_FIND_SET];
+    size_t i = 0;
+
+    for (size_t k = 0; k < setLen; k++)
+
+    {
+        wanted[k] = _mm256_set1_epi8(set[k]);
+    }
+
+    for (; i + 32 <= len; i += 32)
+
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i hits = _mm256_setzero_si256();
+
+        for (size_t k = 0; k < setLen; k++)
+
+        {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, wanted[k]));
+        }
+
+        unsigned mask = _mm256_movemask_epi8(hits);
+
+        if (mask != 0)
+
+        {
+            return data + i + __builtin_ctz(mask);
+        }
+    }
+
+    return findAnySse2(data + i, len - i, set, setLen);
+}
+
+static const struct ScanKernels sse2Kernels = {
+    "sse2", findByteSse2, findEitherSse2, countByteSse2, countWordsSse2, findStringSse2, findAnySse2
+};
+
+static const struct ScanKernels avx2Kernels = {
+    "avx2", findByteAvx2, findEitherAvx2, countByteAvx2, countWordsAvx2, findStringAvx2, findAnyAvx2
+};
+
+#endif // SCAN_X86
+
+static void selectKernels()
+{
+    kernels = scalarKernels;
+
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2"))
+
+    {
+        kernels = sse2Kernels;
+    }
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+
+    {
+        kernels = avx2Kernels;
+    }
+#endif
+}
@@ -0,0 +1,2304 @@
+/**
+ * @file script.c
+ * @brief Lexer, parser and tree walking executor for the shell language. Source is compiled once into a syntax tree,
+ * so loops and functions re-run the tree instead of re-lexing their text on every iteration.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#define _GNU_SOURCE // pipe2()
+
+#include "shell.h"
+#include "script.h"
+#include "output.h"
+#include "pipes.h"
+#include "stats.h"
+#include "historyindex.h"
+#include "spawn.h"
+#include "scan.h"
+#include "profile.h"
+#include "startup.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/wait.h>
+
+#define MAX_FINISHED_JOBS 1024 // exit statuses of background jobs kept for wait PID
+
+// ---- STRUCTS ----
+
+enum TokenType
+{
+    TOKEN_WORD,
+    TOKEN_NEWLINE,
+    TOKEN_SEMI,
+    TOKEN_DSEMI,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_PIPE,
+    TOKEN_BACKGROUND,
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
+    TOKEN_EOF
+};
+
+struct Token
+{
+    enum TokenType type;
+    char *text;             // TOKEN_WORD: the word as written, quotes included
+    char *heredoc;          // << operators: the body collected from the lines after the command
+    bool heredocLiteral;
+    int start;              // offsets into the source, used to add complete commands to the history
+    int end;
+    int line;               // line of the source the token starts on, for the profiler
+};
+
+struct PendingHeredoc
+{
+    int token;              // index of the token the body belongs to
+    char delimiter[500];
+    bool stripTabs;         // <<- strips leading tabs from the body and the delimiter line
+    bool literal;
+};
+
+struct FinishedJob
+{
+    pid_t pid;
+    int waitStatus;         // kept for a later wait PID
+};
+
+struct Parser
+{
+    struct Token *tokens;
+    int numOfTokens;
+    int pos;
+    int status;             // COMPILE_OK until something goes wrong
+};
+
+// ---- GLOBAL VARIABLES ----
+
+struct Function *functions = NULL;
+int numOfFunctions = 0;
+int functionsCapacity = 0;
+pid_t lastBackground = 0;
+struct FinishedJob *finishedJobs = NULL; // background jobs reapBackground() collected and no wait has asked for yet
+int numOfFinishedJobs = 0;
+int finishedJobsCapacity = 0;
+
+int loopDepth = 0;          // number of loops currently executing, bounds break / continue
+int functionDepth = 0;      // number of functions currently executing, return is ignored outside of them
+int breakLevels = 0;        // pending break N
+int continueLevels = 0;     // pending continue N
+bool returning = false;     // pending return
+int sourceDepth = 0;        // runSource() calls in progress, more than one while a script runs source FILE
+
+// ---- FUNCTION DECLARATIONS ----
+
+static char *wordEnd(char *ptr, char *limit); //returns pointer to the first character after the word starting at ptr, limit is the end of the source
+static int lexSource(char *source, struct Token **out, int *count); //splits source into tokens, collecting heredoc bodies
+static void freeTokens(struct Token *tokens, int count); //releases the tokens returned by lexSource()
+static struct Token *peek(struct Parser *p); //returns the current token
+static bool isWord(struct Parser *p, const char *word); //checks if the current token is the given (reserved) word
+static bool isTerminator(struct Token *token); //checks if a token is a reserved word that ends a compound list
+static void skipNewlines(struct Parser *p); //skips over newline tokens
+static void syntaxError(struct Parser *p); //flags a syntax error (or an incomplete command at end of input)
+static bool expectWord(struct Parser *p, const char *word); //consumes the given reserved word or flags an error
+static struct Node *newNode(enum NodeType type); //allocates a zeroed node with one reference
+static void addWord(char ***words, int *count, char *word); //appends a copy of word to a growable array of words
+static struct Node *parseComplete(struct Parser *p); //parses one complete command (up to a newline) at the top level
+static struct Node *parseCompoundList(struct Parser *p); //parses commands until a terminating reserved word, ) or ;;
+static struct Node *parseAndOr(struct Parser *p); //parses pipelines joined by && and ||
+static struct Node *parsePipeline(struct Parser *p); //parses commands joined by |
+static struct Node *parseCommand(struct Parser *p); //parses a simple or compound command
+static struct Node *parseSimple(struct Parser *p); //parses the words of a simple command
+static struct Node *parseIf(struct Parser *p); //parses if / elif ... fi
+static struct Node *parseLoop(struct Parser *p); //parses while / until ... done
+static struct Node *parseFor(struct Parser *p); //parses for NAME [in words] ... done
+static struct Node *parseCase(struct Parser *p); //parses case WORD in ... esac
+static void parseRedirects(struct Parser *p, struct Node *node); //collects redirections that follow a compound command
+static void skipToNextLine(struct Parser *p); //error recovery, drops the rest of the current line
+static void fillParsed(struct Node *node, struct Words *parsed); //copies the words of a simple command into a word list
+static void executeSimple(struct Node *node); //executes a simple command (or a pipeline of them)
+static void executeStages(struct Node *stages); //executes a pipeline that contains compound commands
+static void callFunction(struct Function *function, struct Node *node); //runs a shell function with the command's words as $1, $2, ...
+static void defineFunction(char *name, struct Node *body); //adds a function to the table, replacing an existing one
+static void appendFunction(char *name, struct Node *body); //adds a function to the table without looking for one of the same name
+static bool loopControl(); //checks if a break, continue or return is pending
+static bool applyRedirects(struct Node *node, int backups[2], long long *written); //applies the redirections of a compound command
+static void restoreRedirects(int backups[2], long long written); //undoes applyRedirects(), counting what was written to a redirected stdout
+static void reapBackground(); //collects background jobs that have exited
+static bool hasChildren(); //checks if any child (background job) is still running
+static void saveNode(struct Buffer *out, struct Node *node); //appends a node and everything below and after it to a snapshot
+static struct Node *loadNode(struct SnapshotReader *in); //reads back a node written by saveNode()
+
+// ---- LEXER ----
+
+static char *wordEnd(char *ptr, char *limit)
+{
+    char *start = ptr;
+
+    while (ptr < limit)
+
+    {
+        ptr = (char *) findAny(ptr, limit - ptr, " \t\n;&|()\\'\"`$<>"); // the rest can't end a word or open a quote
+
+        if (ptr == NULL)
+
+        {
+            return limit;
+        }
+
+        if (strchr(" \t\n;&|()", *ptr) != NULL && !(*ptr == '&' && ptr > start && (ptr[-1] == '>' || ptr[-1] == '<')))
+
+        {
+            break; // >&2 and <&0 are single words
+        }
+
+        if (*ptr == '\\' && ptr[1] != '\0')
+
+        {
+            ptr += 2; // escaped character, never a delimiter
+        }
+
+        else if (*ptr == '\'' || *ptr == '"' || *ptr == '`')
+
+        {
+            char *close = (*ptr == '"') ? closingQuote(ptr + 1) : ptr + 1; // closingQuote() steps over $(...) and `...`
+
+            while (close != NULL && *ptr != '"' && *close != '\0' && *close != *ptr)
+
+            {
+                close += (*close == '\\' && *ptr != '\'' && close[1] != '\0') ? 2 : 1;
+            }
+
+            ptr = (close != NULL && *close != '\0') ? close + 1 : ptr + 1; // an unmatched quote is just a regular character
+        }
+
+        else if ((*ptr == '$' || *ptr == '<' || *ptr == '>') && ptr[1] == '(')
+
+        {
+            ptr = matchingParen(ptr + 1); // $(...), <(...) and >(...)
+        }
+
+        else if (*ptr == '$' && ptr[1] == '{')
+
+        {
+            char *close = closingBrace(ptr + 2);
+            ptr = close ? close + 1 : ptr + 2;
+        }
+
+        else
+
+        {
+            ptr++;
+        }
+    }
+
+    return ptr;
+}
+
+static int lexSource(char *source, struct Token **out, int *count)
+{
+    struct Token *tokens = NULL;
+    int numOfTokens = 0;
+    int capacity = 0;
+    struct PendingHeredoc *pending = NULL; // grown like tokens, a line may open any number of heredocs
+    int numOfPending = 0;
+    int pendingCapacity = 0;
+    int status = COMPILE_OK;
+    char *ptr = source;
+    char *limit = source + strlen(source);
+    char *counted = source; // newlines before this have been counted into line
+    int line = 1;
+
+    while (1)
+
+    {
+        while (*ptr == ' ' || *ptr == '\t' || (*ptr == '\\' && ptr[1] == '\n'))
+
+        {
+            ptr += (*ptr == '\\') ? 2 : 1; // a backslash-newline joins two lines
+        }
+
+        if (*ptr == '#')
+
+        {
+            while (*ptr != '\0' && *ptr != '\n')
+
+            {
+                ptr++; // comment until the end of the line
+            }
+        }
+
+        if (numOfTokens == capacity)
+
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            tokens = realloc(tokens, capacity * sizeof(struct Token));
+        }
+
+        struct Token *token = &tokens[numOfTokens];
+        memset(token, 0, sizeof(struct Token));
+        token->start = ptr - source;
+
+        for (char *newline = memchr(counted, '\n', ptr - counted); newline != NULL; newline = memchr(newline + 1, '\n', ptr - newline - 1))
+
+        {
+            line++; // heredoc bodies the lexer skipped over included
+        }
+
+        counted = ptr;
+        token->line = line;
+
+        if (*ptr == '\0')
+
+        {
+            token->type = TOKEN_EOF;
+            token->end = token->start;
+            numOfTokens++;
+            break;
+        }
+
+        if (*ptr == '\n')
+
+        {
+            token->type = TOKEN_NEWLINE;
+            ptr++;
+
+            for (int i = 0; i < numOfPending; i++) // heredoc bodies start on the line after the command
+
+            {
+                struct Buffer body = {NULL, 0, 0};
+                bool closed = false;
+
+                bufferAppend(&body, "", 0);
+
+                while (*ptr != '\0')
+
+                {
+                    char *end = strchr(ptr, '\n');
+                    char *text = ptr;
+
+                    if (end == NULL)
+
+                    {
+                        end = ptr + strlen(ptr);
+                    }
+
+                    while (pending[i].stripTabs && *text == '\t' && text < end)
+
+                    {
+                        text++;
+                    }
+
+                    ptr = (*end == '\n') ? end + 1 : end;
+
+                    if ((size_t) (end - text) == strlen(pending[i].delimiter) && strncmp(text, pending[i].delimiter, end - text) == 0)
+
+                    {
+                        closed = true;
+                        break;
+                    }
+
+                    bufferAppend(&body, text, end - text);
+                    bufferAppend(&body, "\n", 1);
+                }
+
+                if (!closed)
+
+                {
+                    status = COMPILE_INCOMPLETE; // the body runs until the end of input
+                }
+
+                tokens[pending[i].token].heredoc = body.data;
+                tokens[pending[i].token].heredocLiteral = pending[i].literal;
+            }
+
+            numOfPending = 0;
+        }
+
+        else if (strncmp(ptr, ";;", 2) == 0 || strncmp(ptr, "&&", 2) == 0 || strncmp(ptr, "||", 2) == 0)
+
+        {
+            token->type = (*ptr == ';') ? TOKEN_DSEMI : (*ptr == '&') ? TOKEN_AND : TOKEN_OR;
+            ptr += 2;
+        }
+
+        else if (strchr(";&|()", *ptr) != NULL)
+
+        {
+            token->type = (*ptr == ';') ? TOKEN_SEMI : (*ptr == '&') ? TOKEN_BACKGROUND : (*ptr == '|') ? TOKEN_PIPE : (*ptr == '(') ? TOKEN_LPAREN : TOKEN_RPAREN;
+            ptr++;
+        }
+
+        else
+
+        {
+            char *end = wordEnd(ptr, limit);
+            char *word = NULL;
+
+            token->type = TOKEN_WORD;
+            token->text = strndup(ptr, end - ptr);
+            ptr = end;
+
+            struct Token *prev = (numOfTokens > 0) ? &tokens[numOfTokens - 1] : NULL;
+
+            if (numOfPending == pendingCapacity)
+
+            {
+                pendingCapacity = pendingCapacity ? pendingCapacity * 2 : 4;
+                pending = realloc(pending, pendingCapacity * sizeof(struct PendingHeredoc));
+            }
+
+            if (prev != NULL && prev->type == TOKEN_WORD && (strcmp(prev->text, "<<") == 0 || strcmp(prev->text, "<<-") == 0))
+
+            {
+                word = token->text; // << EOF
+                pending[numOfPending].token = numOfTokens - 1;
+                pending[numOfPending].stripTabs = (prev->text[2] == '-');
+            }
+
+            else if (strncmp(token->text, "<<", 2) == 0 && token->text[2] != '<' && token->text[2] != '\0' && strcmp(token->text, "<<-") != 0)
+
+            {
+                pending[numOfPending].token = numOfTokens; // <<EOF
+                pending[numOfPending].stripTabs = (token->text[2] == '-');
+                word = token->text + (pending[numOfPending].stripTabs ? 3 : 2);
+            }
+
+            if (word != NULL)
+
+            {
+                int len = strlen(word);
+
+                if (len > 499)
+
+                {
+                    len = 499;
+                }
+
+                // a quoted delimiter (<<'EOF') means the body is taken literally
+                pending[numOfPending].literal = (strpbrk(word, "'\"\\") != NULL);
+                removeQuotes(pending[numOfPending].delimiter, word, len);
+                numOfPending++;
+            }
+        }
+
+        token->end = ptr - source;
+        numOfTokens++;
+    }
+
+    if (numOfPending > 0)
+
+    {
+        status = COMPILE_INCOMPLETE; // the command line itself hasn't ended yet
+    }
+
+    free(pending);
+    *out = tokens;
+    *count = numOfTokens;
+    return status;
+}
+
+static void freeTokens(struct Token *tokens, int count)
+{
+    for (int i = 0; i < count; i++)
+
+    {
+        free(tokens[i].text);
+        free(tokens[i].heredoc);
+    }
+
+    free(tokens);
+}
+
+// ---- PARSER ----
+
+static struct Token *peek(struct Parser *p)
+{
+    return &p->tokens[p->pos];
+}
+
+static bool isWord(struct Parser *p, const char *word)
+{
+    struct Token *token = peek(p);
+    return token->type == TOKEN_WORD && strcmp(token->text, word) == 0;
+}
+
+static bool isTerminator(struct Token *token)
+{
+    static const char *words[] = {"then", "elif", "else", "fi", "do", "done", "esac", "}", NULL};
+
+    if (token->type != TOKEN_WORD)
+
+    {
+        return false;
+    }
+
+    for (int i = 0; words[i] != NULL; i++)
+
+    {
+        if (strcmp(token->text, words[i]) == 0)
+
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void skipNewlines(struct Parser *p)
+{
+    while (peek(p)->type == TOKEN_NEWLINE)
+
+    {
+        p->pos++;
+    }
+}
+
+static void syntaxError(struct Parser *p)
+{
+    static const char *names[] = {"", "newline", ";", ";;", "&&", "||", "|", "&", "(", ")", "end of file"};
+    struct Token *token = peek(p);
+
+    if (p->status != COMPILE_OK)
+
+    {
+        return; // only report the first problem
+    }
+
+    if (token->type == TOKEN_EOF)
+
+    {
+        p->status = COMPILE_INCOMPLETE; // more input could still make this valid
+        return;
+    }
+
+    p->status = COMPILE_ERROR;
+    LOG_ERROR("Syntax error near unexpected token '%s'\n", token->type == TOKEN_WORD ? token->text : names[token->type]);
+}
+
+static bool expectWord(struct Parser *p, const char *word)
+{
+    if (p->status == COMPILE_OK && isWord(p, word))
+
+    {
+        p->pos++;
+        return true;
+    }
+
+    syntaxError(p);
+    return false;
+}
+
+static struct Node *newNode(enum NodeType type)
+{
+    struct Node *node = calloc(1, sizeof(struct Node));
+
+    node->type = type;
+    node->refs = 1;
+    return node;
+}
+
+static void addWord(char ***words, int *count, char *word)
+{
+    if ((*count & (*count - 1)) == 0) // grow when the count hits a power of two
+
+    {
+        *words = realloc(*words, (*count ? *count * 2 : 1) * sizeof(char *));
+    }
+
+    (*words)[(*count)++] = strdup(word);
+}
+
+static struct Node *parseComplete(struct Parser *p)
+{
+    struct Node *head = NULL;
+    struct Node **tail = &head;
+
+    while (p->status == COMPILE_OK)
+
+    {
+        struct Node *node = parseAndOr(p);
+
+        if (node == NULL)
+
+        {
+            break;
+        }
+
+        *tail = node;
+        tail = &node->next;
+
+        struct Token *token = peek(p);
+
+        if (token->type == TOKEN_SEMI || token->type == TOKEN_BACKGROUND)
+
+        {
+            node->background = (token->type == TOKEN_BACKGROUND);
+            p->pos++;
+
+            if (peek(p)->type == TOKEN_NEWLINE || peek(p)->type == TOKEN_EOF)
+
+            {
+                skipNewlines(p);
+                break;
+            }
+        }
+
+        else if (token->type == TOKEN_NEWLINE)
+
+        {
+            p->pos++;
+            break;
+        }
+
+        else if (token->type == TOKEN_EOF)
+
+        {
+            break;
+        }
+
+        else
+
+        {
+            syntaxError(p);
+        }
+    }
+
+    return head;
+}
+
+static struct Node *parseCompoundList(struct Parser *p)
+{
+    struct Node *head = NULL;
+    struct Node **tail = &head;
+
+    while (p->status == COMPILE_OK)
+
+    {
+        skipNewlines(p);
+
+        struct Token *token = peek(p);
+
+        if (token->type == TOKEN_EOF)
+
+        {
+            p->status = COMPILE_INCOMPLETE;
+            break;
+        }
+
+        if (isTerminator(token) || token->type == TOKEN_RPAREN || token->type == TOKEN_DSEMI)
+
+        {
+            break;
+        }
+
+        struct Node *node = parseAndOr(p);
+
+        if (node == NULL)
+
+        {
+            break;
+        }
+
+        *tail = node;
+        tail = &node->next;
+        token = peek(p);
+
+        if (token->type == TOKEN_SEMI || token->type == TOKEN_NEWLINE || token->type == TOKEN_BACKGROUND)
+
+        {
+            node->background = (token->type == TOKEN_BACKGROUND);
+            p->pos++;
+        }
+
+        else if (!isTerminator(token) && token->type != TOKEN_RPAREN && token->type != TOKEN_DSEMI)
+
+        {
+            syntaxError(p);
+        }
+    }
+
+    return head;
+}
+
+static struct Node *parseAndOr(struct Parser *p)
+{
+    struct Node *node = parsePipeline(p);
+
+    while (node != NULL && p->status == COMPILE_OK && (peek(p)->type == TOKEN_AND || peek(p)->type == TOKEN_OR))
+
+    {
+        struct Node *parent = newNode(peek(p)->type == TOKEN_AND ? NODE_AND : NODE_OR);
+
+        p->pos++;
+        skipNewlines(p);
+
+        parent->first = node;
+        parent->second = parsePipeline(p);
+        node = parent;
+    }
+
+    return node;
+}
+
+static struct Node *parsePipeline(struct Parser *p)
+{
+    bool negate = false;
+
+    if (isWord(p, "!"))
+
+    {
+        negate = true;
+        p->pos++;
+    }
+
+    int line = peek(p)->line;
+    struct Node *head = parseCommand(p);
+    struct Node *last = head;
+    bool allSimple = (head != NULL && head->type == NODE_SIMPLE);
+    int numOfStages = 1;
+
+    while (last != NULL && p->status == COMPILE_OK && peek(p)->type == TOKEN_PIPE)
+
+    {
+        p->pos++;
+        skipNewlines(p);
+
+        last->next = parseCommand(p);
+        last = last->next;
+        allSimple = allSimple && last != NULL && last->type == NODE_SIMPLE;
+        numOfStages++;
+    }
+
+    if (numOfStages > 1 && allSimple) // the common case, hand the whole thing to executePipeline()
+
+    {
+        struct Node *node = newNode(NODE_SIMPLE);
+
+        node->pipeline = true;
+        node->line = line;
+
+        for (struct Node *stage = head; stage != NULL; stage = stage->next)
+
+        {
+            if (stage != head)
+
+            {
+                addWord(&node->words, &node->numOfWords, "|");
+            }
+
+            for (int i = 0; i < stage->numOfWords; i++)
+
+            {
+                addWord(&node->words, &node->numOfWords, stage->words[i]);
+            }
+
+            if (stage->heredoc != NULL && node->heredoc == NULL)
+
+            {
+                node->heredoc = strdup(stage->heredoc);
+                node->heredocLiteral = stage->heredocLiteral;
+            }
+        }
+
+        freeNode(head);
+        head = node;
+    }
+
+    else if (numOfStages > 1)
+
+    {
+        struct Node *node = newNode(NODE_PIPELINE);
+        node->first = head;
+        node->line = line;
+        head = node;
+    }
+
+    if (negate && head != NULL)
+
+    {
+        struct Node *node = newNode(NODE_NOT);
+        node->first = head;
+        head = node;
+    }
+
+    return head;
+}
+
+static struct Node *parseCommand(struct Parser *p)
+{
+    struct Token *token = peek(p);
+    struct Node *node = NULL;
+
+    if (p->status != COMPILE_OK)
+
+    {
+        return NULL;
+    }
+
+    if (token->type == TOKEN_LPAREN)
+
+    {
+        p->pos++;
+        node = newNode(NODE_SUBSHELL);
+        node->first = parseCompoundList(p);
+
+        if (p->status == COMPILE_OK && peek(p)->type == TOKEN_RPAREN)
+
+        {
+            p->pos++;
+        }
+
+        else
+
+        {
+            syntaxError(p);
+        }
+    }
+
+    else if (token->type != TOKEN_WORD || isTerminator(token))
+
+    {
+        syntaxError(p);
+        return NULL;
+    }
+
+    else if (isWord(p, "if"))
+
+    {
+        node = parseIf(p);
+    }
+
+    else if (isWord(p, "while") || isWord(p, "until"))
+
+    {
+        node = parseLoop(p);
+    }
+
+    else if (isWord(p, "for"))
+
+    {
+        node = parseFor(p);
+    }
+
+    else if (isWord(p, "case"))
+
+    {
+        node = parseCase(p);
+    }
+
+    else if (isWord(p, "{"))
+
+    {
+        p->pos++;
+        node = newNode(NODE_GROUP);
+        node->first = parseCompoundList(p);
+        expectWord(p, "}");
+    }
+
+    else if (isWord(p, "function") || (p->tokens[p->pos + 1].type == TOKEN_LPAREN && p->pos + 2 < p->numOfTokens && p->tokens[p->pos + 2].type == TOKEN_RPAREN))
+
+    {
+        if (isWord(p, "function"))
+
+        {
+            p->pos++;
+
+            if (peek(p)->type != TOKEN_WORD)
+
+            {
+                syntaxError(p);
+                return NULL;
+            }
+        }
+
+        node = newNode(NODE_FUNCTION);
+        node->name = strdup(peek(p)->text);
+        p->pos++;
+
+        if (peek(p)->type == TOKEN_LPAREN && p->tokens[p->pos + 1].type == TOKEN_RPAREN)
+
+        {
+            p->pos += 2;
+        }
+
+        skipNewlines(p);
+        node->first = parseCommand(p);
+        return node;
+    }
+
+    else
+
+    {
+        return parseSimple(p);
+    }
+
+    parseRedirects(p, node);
+    return node;
+}
+
+static struct Node *parseSimple(struct Parser *p)
+{
+    struct Node *node = newNode(NODE_SIMPLE);
+
+    node->line = peek(p)->line;
+
+    while (peek(p)->type == TOKEN_WORD)
+
+    {
+        struct Token *token = peek(p);
+
+        addWord(&node->words, &node->numOfWords, token->text);
+
+        if (token->heredoc != NULL)
+
+        {
+            free(node->heredoc); // like any input redirection, the last one wins
+            node->heredoc = strdup(token->heredoc);
+            node->heredocLiteral = token->heredocLiteral;
+        }
+
+        p->pos++;
+    }
+
+    return node;
+}
+
+static struct Node *parseIf(struct Parser *p)
+{
+    struct Node *node = newNode(NODE_IF);
+
+    p->pos++; // if / elif
+    node->first = parseCompoundList(p);
+
+    if (!expectWord(p, "then"))
+
+    {
+        return node;
+    }
+
+    node->second = parseCompoundList(p);
+
+    if (isWord(p, "elif"))
+
+    {
+        node->third = parseIf(p); // the nested if consumes the closing fi
+    }
+
+    else
+
+    {
+        if (isWord(p, "else"))
+
+        {
+            p->pos++;
+            node->third = parseCompoundList(p);
+        }
+
+        expectWord(p, "fi");
+    }
+
+    return node;
+}
+
+static struct Node *parseLoop(struct Parser *p)
+{
+    struct Node *node = newNode(isWord(p, "while") ? NODE_WHILE : NODE_UNTIL);
+
+    p->pos++;
+    node->first = parseCompoundList(p);
+
+    if (expectWord(p, "do"))
+
+    {
+        node->second = parseCompoundList(p);
+        expectWord(p, "done");
+    }
+
+    return node;
+}
+
+static struct Node *parseFor(struct Parser *p)
+{
+    struct Node *node = newNode(NODE_FOR);
+
+    p->pos++;
+
+    if (peek(p)->type != TOKEN_WORD)
+
+    {
+        syntaxError(p);
+        return node;
+    }
+
+    node->name = strdup(peek(p)->text);
+    p->pos++;
+    skipNewlines(p);
+
+    if (isWord(p, "in"))
+
+    {
+        p->pos++;
+
+        while (peek(p)->type == TOKEN_WORD)
+
+        {
+            addWord(&node->words, &node->numOfWords, peek(p)->text);
+            p->pos++;
+        }
+    }
+
+    else
+
+    {
+        node->numOfWords = -1; // for NAME; do ... iterates over the positional parameters
+    }
+
+    if (peek(p)->type == TOKEN_SEMI || peek(p)->type == TOKEN_NEWLINE)
+
+    {
+        p->pos++;
+    }
+
+    skipNewlines(p);
+
+    if (expectWord(p, "do"))
+
+    {
+        node->first = parseCompoundList(p);
+        expectWord(p, "done");
+    }
+
+    return node;
+}
+
+static struct Node *parseCase(struct Parser *p)
+{
+    struct Node *node = newNode(NODE_CASE);
+    struct Node **tail = &node->first;
+
+    p->pos++;
+
+    if (peek(p)->type != TOKEN_WORD)
+
+    {
+        syntaxError(p);
+        return node;
+    }
+
+    node->name = strdup(peek(p)->text);
+    p->pos++;
+    skipNewlines(p);
+
+    if (!expectWord(p, "in"))
+
+    {
+        return node;
+    }
+
+    while (p->status == COMPILE_OK)
+
+    {
+        skipNewlines(p);
+
+        if (isWord(p, "esac"))
+
+        {
+            p->pos++;
+            break;
+        }
+
+        struct Node *item = newNode(NODE_CASE_ITEM);
+        *tail = item;
+        tail = &item->next;
+
+        if (peek(p)->type == TOKEN_LPAREN)
+
+        {
+            p->pos++;
+        }
+
+        while (p->status == COMPILE_OK)
+
+        {
+            if (peek(p)->type != TOKEN_WORD)
+
+            {
+                syntaxError(p);
+                break;
+            }
+
+            addWord(&item->words, &item->numOfWords, peek(p)->text);
+            p->pos++;
+
+            if (peek(p)->type != TOKEN_PIPE)
+
+            {
+                break;
+            }
+
+            p->pos++;
+        }
+
+        if (p->status != COMPILE_OK || peek(p)->type != TOKEN_RPAREN)
+
+        {
+            syntaxError(p);
+            break;
+        }
+
+        p->pos++;
+        item->first = parseCompoundList(p);
+
+        if (peek(p)->type == TOKEN_DSEMI)
+
+        {
+            p->pos++;
+        }
+
+        else if (!isWord(p, "esac"))
+
+        {
+            syntaxError(p);
+        }
+    }
+
+    return node;
+}
+
+static void parseRedirects(struct Parser *p, struct Node *node)
+{
+    while (p->status == COMPILE_OK && (isWord(p, ">") || isWord(p, ">>") || isWord(p, "<")) && p->tokens[p->pos + 1].type == TOKEN_WORD)
+
+    {
+        addWord(&node->redirects, &node->numOfRedirects, peek(p)->text);
+        addWord(&node->redirects, &node->numOfRedirects, p->tokens[p->pos + 1].text);
+        p->pos += 2;
+    }
+}
+
+static void skipToNextLine(struct Parser *p)
+{
+    while (peek(p)->type != TOKEN_NEWLINE && peek(p)->type != TOKEN_EOF)
+
+    {
+        p->pos++;
+    }
+
+    skipNewlines(p);
+    p->status = COMPILE_OK;
+}
+
+int checkComplete(char *source)
+{
+    struct Token *tokens = NULL;
+    int numOfTokens = 0;
+    int status = lexSource(source, &tokens, &numOfTokens);
+    struct Parser p = {tokens, numOfTokens, 0, COMPILE_OK};
+
+    while (status == COMPILE_OK && p.status == COMPILE_OK)
+
+    {
+        skipNewlines(&p);
+
+        if (peek(&p)->type == TOKEN_EOF)
+
+        {
+            break;
+        }
+
+        freeNode(parseComplete(&p));
+    }
+
+    freeTokens(tokens, numOfTokens);
+    return (status != COMPILE_OK) ? status : p.status;
+}
+
+struct Node *compileSource(char *source, int *status)
+{
+    struct Token *tokens = NULL;
+    int numOfTokens = 0;
+    struct Node *head = NULL;
+    struct Node **tail = &head;
+
+    lexSource(source, &tokens, &numOfTokens); // an unterminated heredoc simply runs until the end of input
+
+    for (int i = 0; i < numOfTokens; i++)
+
+    {
+        tokens[i].line = 0; // $(...) and <(...) bodies, the profiler charges them to the line they are on
+    }
+
+    struct Parser p = {tokens, numOfTokens, 0, COMPILE_OK};
+
+    while (p.status == COMPILE_OK)
+
+    {
+        skipNewlines(&p);
+
+        if (peek(&p)->type == TOKEN_EOF)
+
+        {
+            break;
+        }
+
+        *tail = parseComplete(&p);
+
+        while (*tail != NULL)
+
+        {
+            tail = &(*tail)->next;
+        }
+    }
+
+    if (p.status == COMPILE_INCOMPLETE)
+
+    {
+        LOG_ERROR("Syntax error: unexpected end of file\n");
+    }
+
+    freeTokens(tokens, numOfTokens);
+    *status = p.status;
+    return head;
+}
+
+void runSource(char *source, bool addToHistory)
+{
+    struct Token *tokens = NULL;
+    int numOfTokens = 0;
+
+    long long lexed = profiling ? profileClock() : 0;
+
+    sourceDepth++;
+    lexSource(source, &tokens, &numOfTokens);
+    STATS_ADD(tokens, numOfTokens - 1); // not the end of file marker
+    STATS_ADD(lines, 1);
+
+    for (char *line = strchr(source, '\n'); line != NULL && line[1] != '\0'; line = strchr(line + 1, '\n'))
+
+    {
+        STATS_ADD(lines, 1);
+    }
+
+    struct Parser p = {tokens, numOfTokens, 0, COMPILE_OK};
+
+    if (profiling)
+
+    {
+        profileParse(0, lexed);
+    }
+
+    while (1)
+
+    {
+        skipNewlines(&p);
+
+        if (peek(&p)->type == TOKEN_EOF)
+
+        {
+            break;
+        }
+
+        int first = p.pos;
+        long long parsing = profiling ? profileClock() : 0;
+        struct Node *node = parseComplete(&p);
+
+        if (profiling)
+
+        {
+            profileParse(tokens[first].line, parsing);
+        }
+
+        if (p.status == COMPILE_ERROR)
+
+        {
+            freeNode(node);
+            skipToNextLine(&p); // carry on with the next line, like the line based loop used to
+            continue;
+        }
+
+        if (p.status == COMPILE_INCOMPLETE)
+
+        {
+            LOG_ERROR("Syntax error: unexpected end of file\n");
+            freeNode(node);
+            break;
+        }
+
+        if (addToHistory)
+
+        {
+            int last = p.pos - 1;
+
+            while (last > first && (tokens[last].type == TOKEN_NEWLINE || tokens[last].type == TOKEN_EOF))
+
+            {
+                last--;
+            }
+
+            char *text = strndup(source + tokens[first].start, tokens[last].end - tokens[first].start);
+            addHistoryEntry(text);
+            free(text);
+        }
+
+        skipNewlines(&p);
+        bool lastCommand = !interactiveMode && sourceDepth == 1 && peek(&p)->type == TOKEN_EOF; // not the end of a sourced file
+
+        for (struct Node *item = node; item != NULL && !loopControl(); item = item->next)
+
+        {
+            // the final simple command of a script may replace the shell (see handleCommand()), unless
+            // background jobs are still running and need the shell to stay around for them, or the
+            // counters or the profile still have to be written when the script is done
+
+            if (lastCommand && item->next == NULL && item->type == NODE_SIMPLE && !item->pipeline && !item->background)
+
+            {
+                reapBackground();
+                tailCallPending = !hasChildren() && !isExporting() && !profiling;
+            }
+
+            executeNode(item);
+            tailCallPending = false;
+        }
+
+        freeNode(node);
+        reapBackground();
+        exportStats(); // a no-op unless STATS_FILE is set and STATS_INTERVAL has passed
+
+        breakLevels = 0; // break / continue / return outside of a loop or function do nothing
+        continueLevels = 0;
+        returning = false;
+    }
+
+    freeTokens(tokens, numOfTokens);
+    sourceDepth--;
+}
+
+void freeNode(struct Node *node)
+{
+    while (node != NULL)
+
+    {
+        struct Node *next = node->next;
+
+        if (--node->refs > 0)
+
+        {
+            node = next; // still owned by the function table
+            continue;
+        }
+
+        for (int i = 0; i < node->numOfWords; i++)
+
+        {
+            free(node->words[i]);
+        }
+
+        for (int i = 0; i < node->numOfRedirects; i++)
+
+        {
+            free(node->redirects[i]);
+        }
+
+        free(node->words);
+        free(node->redirects);
+        free(node->heredoc);
+        free(node->name);
+        freeNode(node->first);
+        freeNode(node->second);
+        freeNode(node->third);
+        free(node);
+
+        node = next;
+    }
+}
+
+// ---- EXECUTOR ----
+
+static bool loopControl()
+{
+    return breakLevels > 0 || continueLevels > 0 || returning;
+}
+
+void executeList(struct Node *list)
+{
+    for (struct Node *node = list; node != NULL && !loopControl(); node = node->next)
+
+    {
+        executeNode(node);
+    }
+}
+
+void executeNode(struct Node *node)
+{
+    int backups[2] = {-1, -1};
+    long long written = -1; // offset the redirected stdout started at, see restoreRedirects()
+
+    if (node->background)
+
+    {
+        outFlush();
+        int rc = spawnProcess();
+        spawnStarted(); // reaped by reapBackground(), only counted
+
+        if (rc < 0)
+
+        {
+            perror("ERR_FORK_FAILED");
+        }
+
+        if (rc == 0)
+
+        {
+            node->background = false;
+            executeNode(node);
+            outFlush();
+            exit(lastStatus);
+        }
+
+        lastBackground = (rc > 0) ? rc : lastBackground;
+        lastStatus = 0;
+        return;
+    }
+
+    if (node->numOfRedirects > 0 && !applyRedirects(node, backups, &written))
+
+    {
+        lastStatus = 1;
+        return;
+    }
+
+    bool profiled = profiling && node->line > 0 && (node->type == NODE_SIMPLE || node->type == NODE_PIPELINE);
+
+    if (profiled)
+
+    {
+        profileEnter(node->line);
+    }
+
+    switch (node->type)
+
+    {
+        case NODE_SIMPLE:
+            executeSimple(node);
+            break;
+
+        case NODE_PIPELINE:
+            executeStages(node->first);
+            break;
+
+        case NODE_AND:
+        case NODE_OR:
+            executeNode(node->first);
+
+            if (!loopControl() && (lastStatus == 0) == (node->type == NODE_AND))
+
+            {
+                executeNode(node->second);
+            }
+
+            break;
+
+        case NODE_NOT:
+            executeNode(node->first);
+            lastStatus = !lastStatus;
+            break;
+
+        case NODE_IF:
+            executeList(node->first);
+
+            if (loopControl())
+
+            {
+                break;
+            }
+
+            if (lastStatus == 0)
+
+            {
+                executeList(node->second);
+            }
+
+            else if (node->third != NULL)
+
+            {
+                executeList(node->third);
+            }
+
+            else
+
+            {
+                lastStatus = 0;
+            }
+
+            break;
+
+        case NODE_WHILE:
+        case NODE_UNTIL:
+        {
+            int status = 0;
+
+            loopDepth++;
+
+            while (1)
+
+            {
+                executeList(node->first);
+
+                if (loopControl() || (lastStatus == 0) != (node->type == NODE_WHILE))
+
+                {
+                    break;
+                }
+
+                executeList(node->second);
+                status = lastStatus;
+
+                if (breakLevels > 0)
+
+                {
+                    breakLevels--;
+                    break;
+                }
+
+                if (continueLevels > 0 && --continueLevels > 0)
+
+                {
+                    break; // continue N, the enclosing loop takes it from here
+                }
+
+                if (returning)
+
+                {
+                    break;
+                }
+            }
+
+            loopDepth--;
+            lastStatus = status;
+            break;
+        }
+
+        case NODE_FOR:
+        {
+            struct Words items = {NULL};
+            int numOfItems = 0;
+
+            if (node->numOfWords < 0)
+
+            {
+                setWords(&items, positionalParams, numOfPositionalParams);
+            }
+
+            else
+
+            {
+                fillParsed(node, &items);
+                expandParsed(&items); // items are expanded once, before the first iteration
+            }
+
+            if (expansionError())
+
+            {
+                freeWords(&items);
+                break;
+            }
+
+            char **parsed = items.list;
+            numOfItems = length(parsed);
+
+            lastStatus = 0;
+            loopDepth++;
+
+            for (int i = 0; i < numOfItems; i++)
+
+            {
+                setVariable(node->name, wordValue(parsed[i]));
+                executeList(node->first);
+
+                if (breakLevels > 0)
+
+                {
+                    breakLevels--;
+                    break;
+                }
+
+                if (continueLevels > 0 && --continueLevels > 0)
+
+                {
+                    break;
+                }
+
+                if (returning)
+
+                {
+                    break;
+                }
+            }
+
+            freeWords(&items);
+            loopDepth--;
+            break;
+        }
+
+        case NODE_CASE:
+        {
+            char *expanded = expandWord(node->name, EXPAND_WORD);
+            char *word = malloc(strlen(expanded) + 1);
+            bool matched = false;
+
+            removeQuotes(word, expanded, strlen(expanded));
+
+            if (expansionError())
+
+            {
+                free(word);
+                free(expanded);
+                break;
+            }
+
+            lastStatus = 0;
+
+            for (struct Node *item = node->first; item != NULL && !matched; item = item->next)
+
+            {
+                for (int i = 0; i < item->numOfWords && !matched; i++)
+
+                {
+                    char *pattern = expandWord(item->words[i], EXPAND_WORD);
+                    char *unquoted = malloc(strlen(pattern) + 1);
+
+                    removeQuotes(unquoted, pattern, strlen(pattern));
+                    matched = (fnmatch(unquoted, word, 0) == 0);
+
+                    free(unquoted);
+                    free(pattern);
+                }
+
+                if (matched)
+
+                {
+                    executeList(item->first);
+                }
+            }
+
+            free(word);
+            free(expanded);
+            break;
+        }
+
+        case NODE_GROUP:
+            executeList(node->first);
+            break;
+
+        case NODE_SUBSHELL:
+        {
+            outFlush();
+            int rc = spawnProcess();
+            long long started = spawnStarted();
+
+            if (rc < 0)
+
+            {
+                perror("ERR_FORK_FAILED");
+                lastStatus = 1;
+                break;
+            }
+
+            if (rc == 0)
+
+            {
+                executeList(node->first);
+                outFlush();
+                exit(lastStatus);
+            }
+
+            int status = 0;
+            struct rusage usage;
+            wait4(rc, &status, 0, &usage);
+            spawnExited(SPAWN_SUBSHELL, started, &usage);
+            setStatus(status);
+            break;
+        }
+
+        case NODE_FUNCTION:
+            defineFunction(node->name, node->first);
+            lastStatus = 0;
+            break;
+
+        case NODE_CASE_ITEM:
+            break;
+    }
+
+    if (profiled)
+
+    {
+        profileLeave();
+    }
+
+    if (node->numOfRedirects > 0)
+
+    {
+        restoreRedirects(backups, written);
+    }
+}
+
+static void fillParsed(struct Node *node, struct Words *parsed)
+{
+    setWords(parsed, node->words, node->numOfWords); // a copy, the command takes its words apart while it runs
+}
+
+static void executeSimple(struct Node *node)
+{
+    struct Words parsed = {NULL};
+    char *name = node->words[0];
+
+    if (node->heredoc != NULL)
+
+    {
+        heredocBody.len = 0;
+        bufferAppend(&heredocBody, "", 0);
+
+        if (node->heredocLiteral)
+
+        {
+            bufferAppend(&heredocBody, node->heredoc, strlen(node->heredoc));
+        }
+
+        else
+
+        {
+            char *expanded = expandWord(node->heredoc, EXPAND_HEREDOC);
+            bufferAppend(&heredocBody, expanded, strlen(expanded));
+            free(expanded);
+        }
+    }
+
+    if (!node->pipeline)
+
+    {
+        if (strcmp(name, "break") == 0 || strcmp(name, "continue") == 0)
+
+        {
+            int levels = (node->numOfWords > 1) ? atoi(node->words[1]) : 1;
+
+            if (levels > loopDepth)
+
+            {
+                levels = loopDepth;
+            }
+
+            if (levels < 1 && loopDepth > 0)
+
+            {
+                levels = 1;
+            }
+
+            if (name[0] == 'b')
+
+            {
+                breakLevels = levels;
+            }
+
+            else
+
+            {
+                continueLevels = levels;
+            }
+
+            lastStatus = 0;
+            return;
+        }
+
+        if (strcmp(name, "return") == 0)
+
+        {
+            if (node->numOfWords > 1)
+
+            {
+                char *expanded = expandWord(node->words[1], EXPAND_WORD);
+                lastStatus = atoi(expanded);
+                free(expanded);
+            }
+
+            returning = (functionDepth > 0);
+            return;
+        }
+
+        struct Function *function = getFunction(name);
+
+        if (function != NULL)
+
+        {
+            tailCallPending = false; // the function body runs commands of its own, the shell has to stay
+            callFunction(function, node);
+            return;
+        }
+    }
+
+    if (node->pipeline)
+
+    {
+        executePipeline(node->words, node->numOfWords); // the stages are the lexed words between the | separators, nothing is parsed again
+        return;
+    }
+
+    fillParsed(node, &parsed);
+    inputHandler(&parsed);
+    freeWords(&parsed);
+}
+
+static void executeStages(struct Node *stages)
+{
+    int prevRead = -1;
+    int numOfStages = 0;
+    int capacity = 0;
+    int *pids = NULL;
+    long long *started = NULL;
+    long size = pipeSize(NULL);
+    long pipeBytes = 0;
+    bool verbose = isVerbose();
+    bool forkFailed = false;
+    struct StageStats *stats = NULL;
+
+    beginPipeline();
+
+    for (struct Node *stage = stages; stage != NULL; stage = stage->next)
+
+    {
+        int fds[2] = {-1, -1};
+
+        if (stage->next != NULL && pipe2(fds, O_CLOEXEC) < 0)
+
+        {
+            perror("ERR_PIPE_FAILED");
+            break;
+        }
+
+        if (stage->next != NULL)
+
+        {
+            long bytes = resizePipe(fds[PIPE_WRITE_END], size);
+            pipeBytes = pipeBytes ? pipeBytes : bytes;
+        }
+
+        outFlush();
+        int rc = spawnProcess();
+        long long forkTime = spawnStarted();
+
+        if (rc < 0)
+
+        {
+            perror("ERR_FORK_FAILED");
+            forkFailed = true;
+            close(fds[PIPE_READ_END]);
+            close(fds[PIPE_WRITE_END]);
+            break;
+        }
+
+        if (rc == 0)
+
+        {
+            if (prevRead != -1)
+
+            {
+                dup2(prevRead, STDIN_FILENO);
+                close(prevRead);
+            }
+
+            if (fds[PIPE_WRITE_END] != -1)
+
+            {
+                dup2(fds[PIPE_WRITE_END], STDOUT_FILENO);
+                close(fds[PIPE_WRITE_END]);
+                close(fds[PIPE_READ_END]);
+            }
+
+            executeNode(stage);
+            outFlush();
+            exit(lastStatus);
+        }
+
+        if (prevRead != -1)
+
+        {
+            close(prevRead);
+        }
+
+        if (fds[PIPE_WRITE_END] != -1)
+
+        {
+            close(fds[PIPE_WRITE_END]);
+        }
+
+        prevRead = fds[PIPE_READ_END];
+
+        if (numOfStages == capacity)
+
+        {
+            capacity = capacity ? capacity * 2 : 8;
+            pids = realloc(pids, capacity * sizeof(int));
+            started = realloc(started, capacity * sizeof(long long));
+            stats = verbose ? realloc(stats, capacity * sizeof(struct StageStats)) : NULL;
+        }
+
+        if (verbose)
+
+        {
+            stats[numOfStages].name = (stage->type == NODE_SIMPLE) ? stage->words[0] : "(compound command)";
+        }
+
+        STATS_ADD(pipelineStages, 1);
+        started[numOfStages] = forkTime;
+        pids[numOfStages++] = rc;
+    }
+
+    endPipeline();
+
+    if (prevRead != -1)
+
+    {
+        close(prevRead);
+    }
+
+    for (int i = 0; i < numOfStages; i++)
+
+    {
+        struct rusage usage;
+        int status = waitStage(pids[i], verbose ? &stats[i] : NULL, &usage);
+        spawnExited(SPAWN_STAGE, started[i], &usage);
+
+        if (i == numOfStages - 1)
+
+        {
+            setStatus(status); // a pipeline's status is the status of its last command
+        }
+    }
+
+    if (forkFailed)
+
+    {
+        lastStatus = 1;
+    }
+
+    if (verbose)
+
+    {
+        reportPipeline(stats, numOfStages, pipeBytes);
+    }
+
+    free(pids);
+    free(started);
+    free(stats);
+}
+
+struct Function *getFunction(char *name)
+{
+    for (int i = 0; i < numOfFunctions; i++)
+
+    {
+        if (strcmp(functions[i].name, name) == 0)
+
+        {
+            return &functions[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void defineFunction(char *name, struct Node *body)
+{
+    struct Function *function = getFunction(name);
+
+    if (body == NULL)
+
+    {
+        return;
+    }
+
+    body->refs++; // the body outlives the tree it was parsed in
+
+    if (function != NULL)
+
+    {
+        freeNode(function->body);
+        function->body = body;
+        return;
+    }
+
+    appendFunction(name, body);
+}
+
+static void appendFunction(char *name, struct Node *body)
+{
+    if (numOfFunctions == functionsCapacity)
+
+    {
+        functionsCapacity = functionsCapacity ? functionsCapacity * 2 : 16;
+        functions = realloc(functions, functionsCapacity * sizeof(struct Function));
+    }
+
+    strncpy(functions[numOfFunctions].name, name, sizeof(functions[numOfFunctions].name) - 1);
+    functions[numOfFunctions].name[sizeof(functions[numOfFunctions].name) - 1] = '\0';
+    functions[numOfFunctions].body = body;
+    numOfFunctions++;
+}
+
+static void callFunction(struct Function *function, struct Node *node)
+{
+    struct Words words = {NULL};
+    char **savedParams = positionalParams;
+    int savedCount = numOfPositionalParams;
+    struct Node *body = function->body;
+
+    fillParsed(node, &words);
+    expandParsed(&words);
+
+    if (expansionError())
+
+    {
+        freeWords(&words);
+        return;
+    }
+
+    char **parsed = words.list;
+    int count = length(parsed) - 1;
+    positionalParams = malloc((count > 0 ? count : 1) * sizeof(char *));
+    numOfPositionalParams = count;
+
+    for (int i = 0; i < count; i++)
+
+    {
+        positionalParams[i] = strdup(wordValue(parsed[i + 1]));
+    }
+
+    freeWords(&words);
+
+    body->refs++; // keep the body alive even if the function redefines itself
+    functionDepth++;
+    executeNode(body);
+    functionDepth--;
+    returning = false;
+    freeNode(body);
+
+    for (int i = 0; i < count; i++)
+
+    {
+        free(positionalParams[i]);
+    }
+
+    free(positionalParams);
+    positionalParams = savedParams;
+    numOfPositionalParams = savedCount;
+}
+
+static bool applyRedirects(struct Node *node, int backups[2], long long *written)
+{
+    for (int i = 0; i + 1 < node->numOfRedirects; i += 2)
+
+    {
+        char *op = node->redirects[i];
+        int substitutionMark = numOfSubstitutions;
+        char *expanded = isProcessSubstitution(node->redirects[i + 1]) ? substituteProcess(node->redirects[i + 1]) : expandWord(node->redirects[i + 1], EXPAND_WORD);
+        char *target = malloc(strlen(expanded) + 1);
+        int which = (strcmp(op, "<") == 0) ? STDIN_FILENO : STDOUT_FILENO;
+        int flags = (which == STDIN_FILENO) ? O_RDONLY : (O_WRONLY | O_CREAT | (strcmp(op, ">>") == 0 ? O_APPEND : O_TRUNC));
+
+        removeQuotes(target, expanded, strlen(expanded));
+        int fd = open(target, flags, 0666);
+
+        free(target);
+        free(expanded);
+        closeSubstitutions(substitutionMark); // done < <(cmd), fd is now the pipe's only end on our side
+
+        if (fd < 0)
+
+        {
+            perror("ERR_FILE_OPEN");
+            restoreRedirects(backups, *written);
+            return false;
+        }
+
+        outFlush(); // anything buffered so far belongs to the old stdout
+
+        if (backups[which] == -1)
+
+        {
+            backups[which] = dup(which);
+        }
+
+        if (which == STDOUT_FILENO)
+
+        {
+            *written = lseek(fd, 0, SEEK_END); // where >> starts writing, 0 for >, -1 for a pipe or a terminal
+        }
+
+        dup2(fd, which);
+        close(fd);
+    }
+
+    return true;
+}
+
+static void restoreRedirects(int backups[2], long long written)
+{
+    outFlush();
+
+    if (backups[STDOUT_FILENO] != -1 && written >= 0) // children share the file offset, their writes are included
+
+    {
+        long long end = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+        STATS_ADD(redirectedBytes, (end > written) ? end - written : 0);
+    }
+
+    for (int which = 0; which < 2; which++)
+
+    {
+        if (backups[which] != -1)
+
+        {
+            dup2(backups[which], which);
+            close(backups[which]);
+            backups[which] = -1;
+        }
+    }
+}
+
+static void reapBackground()
+{
+    int waitStatus = 0;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &waitStatus, WNOHANG)) > 0)
+
+    {
+        if (numOfFinishedJobs == MAX_FINISHED_JOBS)
+
+        {
+            numOfFinishedJobs--; // the oldest statuses go first, like CHILD_MAX in other shells
+            memmove(finishedJobs, finishedJobs + 1, numOfFinishedJobs * sizeof(struct FinishedJob));
+        }
+
+        if (numOfFinishedJobs == finishedJobsCapacity)
+
+        {
+            finishedJobsCapacity = finishedJobsCapacity ? finishedJobsCapacity * 2 : 16;
+            finishedJobs = realloc(finishedJobs, finishedJobsCapacity * sizeof(struct FinishedJob));
+        }
+
+        finishedJobs[numOfFinishedJobs].pid = pid;
+        finishedJobs[numOfFinishedJobs].waitStatus = waitStatus;
+        numOfFinishedJobs++;
+    }
+}
+
+int builtinWait(char **parsed)
+{
+    int status = 0;
+
+    outFlush();
+
+    if (parsed[1][0] == '\0')
+
+    {
+        while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+
+        {
+            // every job, until waitpid() fails with ECHILD
+        }
+
+        numOfFinishedJobs = 0;
+        return 0;
+    }
+
+    for (int i = 1; parsed[i][0] != '\0'; i++)
+
+    {
+        char *end = NULL;
+        long pid = strtol(parsed[i], &end, 10);
+        int waitStatus = 0;
+        pid_t rc = -1;
+
+        if (*end != '\0' || pid <= 0)
+
+        {
+            fprintf(stderr, "%s: wait: %s: not a pid\n", shellName, parsed[i]);
+            status = 2;
+            continue;
+        }
+
+        for (int j = 0; j < numOfFinishedJobs && rc < 0; j++)
+
+        {
+            if (finishedJobs[j].pid == pid)
+
+            {
+                rc = pid; // reaped between two commands already
+                waitStatus = finishedJobs[j].waitStatus;
+                finishedJobs[j] = finishedJobs[--numOfFinishedJobs];
+            }
+        }
+
+        if (rc < 0 && takeReapedStatus(pid, &waitStatus))
+
+        {
+            rc = pid; // the spawn governor reaped it to free its process slot while fork() was failing
+        }
+
+        while (rc < 0 && (rc = waitpid(pid, &waitStatus, 0)) < 0 && errno == EINTR)
+
+        {
+            // interrupted, wait again
+        }
+
+        if (rc < 0)
+
+        {
+            status = 127; // not a child, or already waited for
+            continue;
+        }
+
+        setStatus(waitStatus);
+        status = lastStatus;
+    }
+
+    return status;
+}
+
+static bool hasChildren()
+{
+    siginfo_t info;
+    info.si_pid = 0;
+
+    return waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0; // fails with ECHILD once there are none
+}
+
+// ---- SNAPSHOTS ----
+
+void saveFunctions(struct Buffer *out)
+{
+    for (int i = 0; i < numOfFunctions; i++)
+
+    {
+        putString(out, functions[i].name);
+        saveNode(out, functions[i].body);
+    }
+}
+
+bool loadFunctions(struct SnapshotReader *in, int count)
+{
+    for (int i = 0; i < count && !in->failed; i++)
+
+    {
+        const char *name = takeString(in);
+        struct Node *body = loadNode(in);
+
+        if (name == NULL || body == NULL || in->failed)
+
+        {
+            freeNode(body);
+            break;
+        }
+
+        appendFunction((char *) name, body); // the table takes the reference loadNode() returned
+    }
+
+    return !in->failed;
+}
+
+static void saveNode(struct Buffer *out, struct Node *node)
+{
+    putInt(out, node != NULL);
+
+    if (node == NULL)
+
+    {
+        return;
+    }
+
+    putInt(out, node->type);
+    putInt(out, node->pipeline | node->heredocLiteral << 1 | node->background << 2);
+    putInt(out, node->line);
+    putInt(out, node->numOfWords);
+
+    for (int i = 0; i < node->numOfWords; i++)
+
+    {
+        putString(out, node->words[i]);
+    }
+
+    putInt(out, node->numOfRedirects);
+
+    for (int i = 0; i < node->numOfRedirects; i++)
+
+    {
+        putString(out, node->redirects[i]);
+    }
+
+    putString(out, node->heredoc);
+    putString(out, node->name);
+    saveNode(out, node->first);
+    saveNode(out, node->second);
+    saveNode(out, node->third);
+    saveNode(out, node->next);
+}
+
+static struct Node *loadNode(struct SnapshotReader *in)
+{
+    if (takeInt(in) != 1)
+
+    {
+        return NULL;
+    }
+
+    long long type = takeInt(in);
+
+    if (type < NODE_SIMPLE || type > NODE_FUNCTION)
+
+    {
+        in->failed = true;
+        return NULL;
+    }
+
+    struct Node *node = newNode((enum NodeType) type);
+    long long flags = takeInt(in);
+
+    node->pipeline = flags & 1;
+    node->heredocLiteral = flags & 2;
+    node->background = flags & 4;
+    node->line = (int) takeInt(in);
+
+    for (long long i = takeInt(in); i > 0 && !in->failed; i--)
+
+    {
+        const char *word = takeString(in);
+        addWord(&node->words, &node->numOfWords, (char *) (word ? word : ""));
+    }
+
+    for (long long i = takeInt(in); i > 0 && !in->failed; i--)
+
+    {
+        const char *redirect = takeString(in);
+        addWord(&node->redirects, &node->numOfRedirects, (char *) (redirect ? redirect : ""));
+    }
+
+    const char *heredoc = takeString(in);
+    const char *name = takeString(in);
+
+    node->heredoc = heredoc ? strdup(heredoc) : NULL;
+    node->name = name ? strdup(name) : NULL;
+    node->first = loadNode(in);
+    node->second = loadNode(in);
+    node->third = loadNode(in);
+    node->next = loadNode(in);
+
+    return node;
+}
@@ -0,0 +1,251 @@
+/**
+ * @file spawn.c
+ * @brief The spawn governor. Children are reaped in many places (pipelines, subshells, reapBackground()), so
+ * instead of being told about every reap the governor keeps the pids it forked and, only when they reach the
+ * limit, asks the kernel which of them have exited with waitid(WNOWAIT), which leaves the exit status for whoever
+ * reaps them. A pipeline is admitted as a unit: its first stage waits for a slot, the stages after it don't count
+ * their own pipeline's stages against the limit, since those can only exit once the later stages run. A child that
+ * still doesn't get a slot within SLOT_WAIT_MAX_NS is started anyway, the slots may be held by something that
+ * waits on it in another way.
+ * Zombies count against RLIMIT_NPROC too, and the stages of a pipeline are reaped in order only once the last one
+ * has started, so when fork() fails with EAGAIN the governor does reap its exited children and keeps their wait
+ * statuses for waitStage() and builtinWait(); every other wait in the shell follows its fork() with no fork() in between.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "spawn.h"
+#include "shell.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define SPAWN_LIMIT_DEFAULT 256             // children running at once when SPAWN_LIMIT isn't set, 0 lifts the cap
+#define SPAWN_RETRIES 10                    // fork() attempts after EAGAIN or ENOMEM before giving up, about a second in all
+#define BACKOFF_START_NS 1000000LL          // first wait, doubled every time
+#define BACKOFF_MAX_NS 256000000LL
+#define SLOT_WAIT_MAX_NS 2000000000LL        // longest a fork() waits for a slot before it goes ahead over the limit
+#define MAX_REAPED 1024                     // statuses kept for children reaped early, nobody asks for those of background jobs
+
+// ---- STRUCTS ----
+
+struct ReapedChild
+{
+    pid_t pid;
+    int status;
+};
+
+// ---- GLOBAL VARIABLES ----
+
+static pid_t *children = NULL;  // forked by this process and not yet seen to exit
+static int numOfChildren = 0;
+static int childrenCapacity = 0;
+
+static int pipelineChildren = 0; // the last entries of children: stages of the pipeline being started
+static bool inPipeline = false;
+
+static struct ReapedChild reaped[MAX_REAPED]; // a ring, the oldest status is dropped when it is full
+static int numOfReaped = 0;
+static int nextReaped = 0;
+
+// ---- FUNCTION DECLARATIONS ----
+
+static int spawnLimit(); //SPAWN_LIMIT, or the default if it isn't a number
+static void pruneChildren(); //forgets the children that have exited (or were reaped)
+static void reapChildren(); //reaps the children that have exited to free their process slots, keeping their statuses
+static void backoff(long long ns); //sleeps for ns
+
+pid_t spawnProcess()
+{
+    int limit = spawnLimit();
+
+    if (limit > 0 && numOfChildren - pipelineChildren >= limit)
+
+    {
+        pruneChildren();
+    }
+
+    if (limit > 0 && numOfChildren - pipelineChildren >= limit)
+
+    {
+        long long waited = 0;
+        long long wait = BACKOFF_START_NS;
+
+        STATS_ADD(spawnThrottles, 1);
+
+        while (numOfChildren - pipelineChildren >= limit && waited < SLOT_WAIT_MAX_NS)
+
+        {
+            backoff(wait);
+            waited += wait;
+            wait = (wait * 2 > BACKOFF_MAX_NS) ? BACKOFF_MAX_NS : wait * 2;
+            pruneChildren();
+        }
+    }
+
+    pid_t pid = fork();
+    long long wait = BACKOFF_START_NS;
+
+    for (int attempt = 0; pid < 0 && (errno == EAGAIN || errno == ENOMEM) && attempt < SPAWN_RETRIES; attempt++)
+
+    {
+        STATS_ADD(spawnRetries, 1); // out of processes or memory for now, give the system a moment
+        backoff(wait);
+        reapChildren();
+        wait = (wait * 2 > BACKOFF_MAX_NS) ? BACKOFF_MAX_NS : wait * 2;
+        pid = fork();
+    }
+
+    if (pid < 0)
+
+    {
+        STATS_ADD(spawnFailures, 1);
+        return -1;
+    }
+
+    if (pid == 0)
+
+    {
+        numOfChildren = 0; // the child's children are its own
+        numOfReaped = nextReaped = 0;
+        pipelineChildren = 0;
+        inPipeline = false;
+        return 0;
+    }
+
+    STATS_ADD(spawns, 1); // here and not in spawnStarted(), which both sides of the fork call
+    int stale = 0;
+    takeReapedStatus(pid, &stale); // a status kept for an earlier child with the same pid is nobody's anymore
+
+    if (numOfChildren == childrenCapacity)
+
+    {
+        pruneChildren(); // without a limit nothing else keeps the list short
+    }
+
+    if (numOfChildren == childrenCapacity)
+
+    {
+        childrenCapacity = childrenCapacity ? childrenCapacity * 2 : 64;
+        children = realloc(children, childrenCapacity * sizeof(pid_t));
+    }
+
+    children[numOfChildren++] = pid;
+    pipelineChildren += inPipeline;
+    return pid;
+}
+
+void beginPipeline()
+{
+    inPipeline = true;
+    pipelineChildren = 0;
+}
+
+void endPipeline()
+{
+    inPipeline = false;
+    pipelineChildren = 0; // the stages count against the limit like any child again
+}
+
+bool takeReapedStatus(pid_t pid, int *status)
+{
+    for (int i = 0; i < numOfReaped; i++)
+
+    {
+        if (reaped[i].pid == pid)
+
+        {
+            *status = reaped[i].status;
+            reaped[i] = reaped[--numOfReaped]; // the ring only needs its order while filling
+            nextReaped = numOfReaped % MAX_REAPED;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int spawnLimit()
+{
+    char *value = getVariable("SPAWN_LIMIT");
+    char *end = NULL;
+    long limit = (value != NULL && *value != '\0') ? strtol(value, &end, 10) : -1;
+
+    return (end == NULL || *end != '\0' || limit < 0 || limit > 1000000) ? SPAWN_LIMIT_DEFAULT : (int) limit;
+}
+
+static void pruneChildren()
+{
+    int kept = 0;
+    int ownStart = numOfChildren - pipelineChildren;
+
+    for (int i = 0; i < numOfChildren; i++)
+
+    {
+        siginfo_t info;
+        info.si_pid = 0;
+        int saved = errno;
+
+        // a zombie reports itself without being reaped, ECHILD means it was reaped already
+        bool running = waitid(P_PID, children[i], &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == 0;
+        errno = saved;
+
+        if (running)
+
+        {
+            children[kept++] = children[i];
+        }
+
+        else if (i >= ownStart)
+
+        {
+            pipelineChildren--; // a stage of the pipeline being started exited early
+        }
+    }
+
+    numOfChildren = kept;
+}
+
+static void reapChildren()
+{
+    int kept = 0;
+    int ownStart = numOfChildren - pipelineChildren;
+
+    for (int i = 0; i < numOfChildren; i++)
+
+    {
+        int status = 0;
+        int saved = errno;
+        pid_t pid = waitpid(children[i], &status, WNOHANG);
+        errno = saved;
+
+        if (pid == children[i])
+
+        {
+            reaped[nextReaped] = (struct ReapedChild) {pid, status};
+            nextReaped = (nextReaped + 1) % MAX_REAPED;
+            numOfReaped += (numOfReaped < MAX_REAPED);
+        }
+
+        else if (pid == 0)
+
+        {
+            children[kept++] = children[i];
+            continue;
+        }
+
+        pipelineChildren -= (i >= ownStart); // no longer in the list either way
+    }
+
+    numOfChildren = kept;
+}
+
+static void backoff(long long ns)
+{
+    struct timespec ts = {ns / 1000000000LL, ns % 1000000000LL};
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
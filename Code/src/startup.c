@@ -0,0 +1,613 @@
+/**
+ * @file startup.c
+ * @brief `source`, ~/.shellrc and its snapshot. A snapshot is a header followed by the files the state came from,
+ * the environment variables, file tests and working directory the rc file's result depended on, and then the aliases, variables and functions, all as 8 byte numbers and length-prefixed, null terminated
+ * strings, so it can be checked and read in place from the mapping without a parser.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "startup.h"
+#include "shell.h"
+#include "script.h"
+#include "output.h"
+#include "stats.h"
+#include "builtins.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RC_FILE ".shellrc" // in $HOME
+#define SNAPSHOT_SUFFIX ".snapshot" // the snapshot sits next to the rc file
+#define SNAPSHOT_MAGIC "SHELLSNP" // first 8 bytes of every snapshot
+#define SNAPSHOT_HEADER 64 // magic, version, size and the five counts
+#define CWD_DEPENDENCY "cwd" // the op of the dependency on the working directory, its name is the directory
+
+// ---- STRUCTS ----
+
+struct SourcedFile
+{
+    char *path;             // absolute, the next shell may start in another directory
+    long long size;
+    long long mtimeSec;
+    long long mtimeNsec;
+};
+
+struct Dependency
+{
+    char *op;               // NULL for an environment variable, CWD_DEPENDENCY, otherwise the test operator (-f, -d, -nt, ...)
+    char *name;             // the variable, the working directory, or the file tested
+    char *value;            // the variable's value (NULL if unset), or the second file of -nt, -ot and -ef
+    bool result;            // what the test returned
+};
+
+// ---- GLOBAL VARIABLES ----
+
+static bool recording = false; // the rc file is running, every file it sources goes into the snapshot
+static bool perProcess = false; // the rc file read $$ or $!, a snapshot would hand the next shell this one's values
+static struct SourcedFile *sourced = NULL;
+static int numOfSourced = 0;
+static int sourcedCapacity = 0;
+static struct Dependency *dependencies = NULL;
+static int numOfDependencies = 0;
+static int dependenciesCapacity = 0;
+
+// ---- FUNCTION DECLARATIONS ----
+
+static void recordFile(const char *path, struct stat *st); //adds a file the rc file read to the list the snapshot is checked against
+static bool filesUnchanged(struct SnapshotReader *in, long long count); //checks the files recorded in a snapshot against the disk
+static void addDependency(const char *op, const char *name, const char *value, bool result); //notes something outside the files read that the rc file's result depends on
+static bool dependenciesUnchanged(struct SnapshotReader *in, long long count); //checks the environment and file tests recorded in a snapshot
+static void clearRecording(); //forgets the files and dependencies recorded while the rc file ran
+static bool restoreSnapshot(const char *path); //maps a snapshot and restores its state if it is still valid
+static void writeSnapshot(const char *path); //saves the aliases, variables and functions, through a temporary file and rename()
+
+int builtinSource(char **parsed)
+{
+    struct stat st;
+
+    if (parsed[1][0] == '\0')
+
+    {
+        fprintf(stderr, "%s: %s: filename argument required\n", shellName, parsed[0]);
+        return 2;
+    }
+
+    bool readable = (stat(parsed[1], &st) == 0 && access(parsed[1], R_OK) == 0);
+
+    if (readable && S_ISDIR(st.st_mode))
+
+    {
+        readable = false;
+        errno = EISDIR;
+    }
+
+    if (!readable)
+
+    {
+        fprintf(stderr, "%s: %s: cannot open %s: %s\n", shellName, parsed[0], parsed[1], strerror(errno));
+        return 1;
+    }
+
+    if (recording)
+
+    {
+        recordFile(parsed[1], &st); // before reading it, a later change must make the snapshot stale
+
+        if (parsed[1][0] != '/')
+
+        {
+            recordDirectory(); // another directory has another file of that name
+        }
+    }
+
+    char *source = readFile(parsed[1]);
+
+    lastStatus = 0;
+    runSource(source, false);
+    free(source);
+
+    return lastStatus;
+}
+
+void loadStartupFile()
+{
+    char *home = getenv("HOME");
+    char rc[PATH_MAX];
+    char snapshot[PATH_MAX + sizeof(SNAPSHOT_SUFFIX)];
+    struct stat st;
+
+    if (home == NULL || home[0] == '\0' || snprintf(rc, sizeof(rc), "%s/%s", home, RC_FILE) >= (int) sizeof(rc))
+
+    {
+        return;
+    }
+
+    snprintf(snapshot, sizeof(snapshot), "%s%s", rc, SNAPSHOT_SUFFIX);
+
+    if (stat(rc, &st) < 0 || !S_ISREG(st.st_mode))
+
+    {
+        return;
+    }
+
+    if (numOfAliases == 0 && numOfVariables == 0 && numOfFunctions == 0 && restoreSnapshot(snapshot)) // see restoreSnapshot() for why they must be empty
+
+    {
+        return;
+    }
+
+    unsigned long long spawns = shellStats->spawns;
+    unsigned long long written = outTotal();
+    char *cwd = getcwd(NULL, 0);
+    char *source = NULL;
+
+    recording = true;
+    perProcess = false;
+    clearRecording();
+    recordFile(rc, &st);
+    source = readFile(rc);
+    runSource(source, false);
+    recording = false;
+    outFlush();
+
+    char *after = getcwd(NULL, 0);
+
+    if (shellStats->spawns == spawns && outTotal() == written && !perProcess && cwd != NULL && after != NULL && strcmp(cwd, after) == 0)
+
+    {
+        writeSnapshot(snapshot);
+    }
+
+    else
+
+    {
+        unlink(snapshot); // it would skip effects of the rc file that only running it has
+    }
+
+    clearRecording();
+    free(source);
+    free(cwd);
+    free(after);
+}
+
+void recordEnvironment(const char *name, const char *value)
+{
+    if (!recording)
+
+    {
+        return;
+    }
+
+    for (int i = 0; i < numOfDependencies; i++)
+
+    {
+        if (dependencies[i].op == NULL && strcmp(dependencies[i].name, name) == 0)
+
+        {
+            return; // looked up before, and it can't have changed since
+        }
+    }
+
+    addDependency(NULL, name, value, false);
+}
+
+void recordProbe(const char *op, const char *left, const char *right, bool result)
+{
+    if (recording)
+
+    {
+        addDependency(op, left, right, result);
+
+        if (left[0] != '/' || (right != NULL && right[0] != '/'))
+
+        {
+            recordDirectory(); // a relative path names another file in another directory
+        }
+    }
+}
+
+void recordDirectory()
+{
+    if (!recording)
+
+    {
+        return;
+    }
+
+    for (int i = 0; i < numOfDependencies; i++)
+
+    {
+        if (dependencies[i].op != NULL && strcmp(dependencies[i].op, CWD_DEPENDENCY) == 0)
+
+        {
+            return;
+        }
+    }
+
+    char *cwd = getcwd(NULL, 0);
+
+    if (cwd == NULL)
+
+    {
+        perProcess = true; // nothing to check a later start against
+        return;
+    }
+
+    addDependency(CWD_DEPENDENCY, cwd, NULL, false);
+    free(cwd);
+}
+
+void recordProcessValue()
+{
+    if (recording)
+
+    {
+        perProcess = true;
+    }
+}
+
+void putInt(struct Buffer *out, long long value)
+{
+    bufferAppend(out, (const char *) &value, sizeof(value));
+}
+
+void putString(struct Buffer *out, const char *str)
+{
+    if (str == NULL)
+
+    {
+        putInt(out, -1);
+        return;
+    }
+
+    putInt(out, (long long) strlen(str));
+    bufferAppend(out, str, strlen(str) + 1); // the terminator too, so strings can be used in place
+}
+
+long long takeInt(struct SnapshotReader *in)
+{
+    long long value = 0;
+
+    if (in->failed || in->end - in->ptr < (long) sizeof(value))
+
+    {
+        in->failed = true;
+        return 0;
+    }
+
+    memcpy(&value, in->ptr, sizeof(value)); // the mapping gives no alignment guarantee for the fields
+    in->ptr += sizeof(value);
+    return value;
+}
+
+const char *takeString(struct SnapshotReader *in)
+{
+    long long len = takeInt(in);
+
+    if (len == -1 && !in->failed)
+
+    {
+        return NULL;
+    }
+
+    if (in->failed || len < 0 || len >= in->end - in->ptr || in->ptr[len] != '\0')
+
+    {
+        in->failed = true;
+        return NULL;
+    }
+
+    const char *str = in->ptr;
+    in->ptr += len + 1;
+    return str;
+}
+
+static void recordFile(const char *path, struct stat *st)
+{
+    if (numOfSourced == sourcedCapacity)
+
+    {
+        sourcedCapacity = sourcedCapacity ? sourcedCapacity * 2 : 8;
+        sourced = realloc(sourced, sourcedCapacity * sizeof(struct SourcedFile));
+    }
+
+    char *absolute = realpath(path, NULL);
+
+    sourced[numOfSourced].path = absolute ? absolute : strdup(path);
+    sourced[numOfSourced].size = st->st_size;
+    sourced[numOfSourced].mtimeSec = st->st_mtim.tv_sec;
+    sourced[numOfSourced].mtimeNsec = st->st_mtim.tv_nsec;
+    numOfSourced++;
+}
+
+static bool filesUnchanged(struct SnapshotReader *in, long long count)
+{
+    bool unchanged = (count > 0);
+
+    for (long long i = 0; i < count && unchanged && !in->failed; i++)
+
+    {
+        const char *path = takeString(in);
+        long long size = takeInt(in);
+        long long mtimeSec = takeInt(in);
+        long long mtimeNsec = takeInt(in);
+        struct stat st;
+
+        unchanged = path != NULL && stat(path, &st) == 0 && st.st_size == size && st.st_mtim.tv_sec == mtimeSec && st.st_mtim.tv_nsec == mtimeNsec;
+    }
+
+    return unchanged && !in->failed;
+}
+
+static void addDependency(const char *op, const char *name, const char *value, bool result)
+{
+    if (numOfDependencies == dependenciesCapacity)
+
+    {
+        dependenciesCapacity = dependenciesCapacity ? dependenciesCapacity * 2 : 8;
+        dependencies = realloc(dependencies, dependenciesCapacity * sizeof(struct Dependency));
+    }
+
+    dependencies[numOfDependencies].op = op ? strdup(op) : NULL;
+    dependencies[numOfDependencies].name = strdup(name);
+    dependencies[numOfDependencies].value = value ? strdup(value) : NULL;
+    dependencies[numOfDependencies].result = result;
+    numOfDependencies++;
+}
+
+static bool dependenciesUnchanged(struct SnapshotReader *in, long long count)
+{
+    bool unchanged = (count >= 0);
+
+    for (long long i = 0; i < count && unchanged && !in->failed; i++)
+
+    {
+        const char *op = takeString(in);
+        const char *name = takeString(in);
+        const char *value = takeString(in);
+        bool result = takeInt(in);
+
+        if (in->failed || name == NULL)
+
+        {
+            return false;
+        }
+
+        if (op == NULL)
+
+        {
+            const char *now = getenv(name);
+            unchanged = (now == NULL) ? value == NULL : value != NULL && strcmp(now, value) == 0;
+        }
+
+        else if (strcmp(op, CWD_DEPENDENCY) == 0)
+
+        {
+            char *cwd = getcwd(NULL, 0);
+            unchanged = cwd != NULL && strcmp(cwd, name) == 0;
+            free(cwd);
+        }
+
+        else
+
+        {
+            unchanged = probeFile(op, name, value) == result;
+        }
+    }
+
+    return unchanged && !in->failed;
+}
+
+static void clearRecording()
+{
+    for (int i = 0; i < numOfSourced; i++)
+
+    {
+        free(sourced[i].path);
+    }
+
+    for (int i = 0; i < numOfDependencies; i++)
+
+    {
+        free(dependencies[i].op);
+        free(dependencies[i].name);
+        free(dependencies[i].value);
+    }
+
+    numOfSourced = 0;
+    numOfDependencies = 0;
+}
+
+static bool restoreSnapshot(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if (fd < 0)
+
+    {
+        return false;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < SNAPSHOT_HEADER)
+
+    {
+        close(fd);
+        return false;
+    }
+
+    const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+
+    {
+        return false;
+    }
+
+    struct SnapshotReader in = {map + strlen(SNAPSHOT_MAGIC), map + st.st_size, false};
+    bool valid = memcmp(map, SNAPSHOT_MAGIC, strlen(SNAPSHOT_MAGIC)) == 0;
+
+    valid = valid && takeInt(&in) == SNAPSHOT_VERSION;
+    valid = valid && takeInt(&in) == (long long) st.st_size; // a snapshot cut short by a full disk is never used
+
+    long long numOfFiles = takeInt(&in);
+    long long dependencyCount = takeInt(&in);
+    long long aliasCount = takeInt(&in);
+    long long variableCount = takeInt(&in);
+    long long functionCount = takeInt(&in);
+
+    valid = valid && filesUnchanged(&in, numOfFiles);
+    valid = valid && dependenciesUnchanged(&in, dependencyCount);
+    valid = valid && aliasCount >= 0 && aliasCount <= st.st_size / 16 && variableCount >= 0 && variableCount <= st.st_size / 16; // two strings take at least 16 bytes
+
+    // the tables are empty and the names in a snapshot are unique, so the entries are appended without the
+    // lookups addAlias() and setVariable() make, which would be quadratic in the number of entries
+
+    if (valid)
+
+    {
+        aliasesCapacity = numOfAliases + aliasCount;
+        aliases = realloc(aliases, (aliasesCapacity ? aliasesCapacity : 1) * sizeof(struct Alias));
+        variablesCapacity = numOfVariables + variableCount;
+        variables = realloc(variables, (variablesCapacity ? variablesCapacity : 1) * sizeof(struct Variable));
+    }
+
+    for (long long i = 0; valid && i < aliasCount && !in.failed; i++)
+
+    {
+        const char *name = takeString(&in);
+        const char *value = takeString(&in);
+
+        if (name == NULL || value == NULL || strlen(name) >= sizeof(aliases[0].pair[0]) || strlen(value) >= sizeof(aliases[0].pair[1]))
+
+        {
+            in.failed = true;
+            break;
+        }
+
+        strcpy(aliases[numOfAliases].pair[0], name);
+        strcpy(aliases[numOfAliases].pair[1], value);
+        numOfAliases++;
+    }
+
+    for (long long i = 0; valid && i < variableCount && !in.failed; i++)
+
+    {
+        const char *name = takeString(&in);
+        const char *value = takeString(&in);
+
+        if (name == NULL || value == NULL)
+
+        {
+            in.failed = true;
+            break;
+        }
+
+        variables[numOfVariables].name = strdup(name);
+        variables[numOfVariables].value = strdup(value);
+        numOfVariables++;
+    }
+
+    valid = valid && loadFunctions(&in, functionCount) && !in.failed; // damaged after all, the rc file runs and sets everything again
+
+    munmap((void *) map, st.st_size);
+    return valid;
+}
+
+static void writeSnapshot(const char *path)
+{
+    struct Buffer out = {NULL, 0, 0};
+    char temporary[PATH_MAX + 32];
+
+    bufferAppend(&out, SNAPSHOT_MAGIC, strlen(SNAPSHOT_MAGIC));
+    putInt(&out, SNAPSHOT_VERSION);
+    putInt(&out, 0); // the size, filled in below
+    putInt(&out, numOfSourced);
+    putInt(&out, numOfDependencies);
+    putInt(&out, numOfAliases);
+    putInt(&out, numOfVariables);
+    putInt(&out, numOfFunctions);
+
+    for (int i = 0; i < numOfSourced; i++)
+
+    {
+        putString(&out, sourced[i].path);
+        putInt(&out, sourced[i].size);
+        putInt(&out, sourced[i].mtimeSec);
+        putInt(&out, sourced[i].mtimeNsec);
+    }
+
+    for (int i = 0; i < numOfDependencies; i++)
+
+    {
+        putString(&out, dependencies[i].op);
+        putString(&out, dependencies[i].name);
+        putString(&out, dependencies[i].value);
+        putInt(&out, dependencies[i].result);
+    }
+
+    for (int i = 0; i < numOfAliases; i++)
+
+    {
+        putString(&out, aliases[i].pair[0]);
+        putString(&out, aliases[i].pair[1]);
+    }
+
+    for (int i = 0; i < numOfVariables; i++)
+
+    {
+        putString(&out, variables[i].name);
+        putString(&out, variables[i].value);
+    }
+
+    saveFunctions(&out);
+
+    long long size = (long long) out.len;
+    memcpy(out.data + strlen(SNAPSHOT_MAGIC) + sizeof(long long), &size, sizeof(size));
+
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int) getpid()); // another shell starting now must never map half a snapshot
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    size_t done = 0;
+
+    while (fd >= 0 && done < out.len)
+
+    {
+        ssize_t n = write(fd, out.data + done, out.len - done);
+
+        if (n < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (n <= 0)
+
+        {
+            break;
+        }
+
+        done += n;
+    }
+
+    if (fd >= 0 && close(fd) == 0 && done == out.len)
+
+    {
+        rename(temporary, path);
+    }
+
+    else
+
+    {
+        unlink(temporary); // no snapshot, the rc file simply runs again next time
+    }
+
+    free(out.data);
+}
@@ -0,0 +1,281 @@
+/**
+ * @file stats.c
+ * @brief Runtime counters and spawn latency histograms, printed by the `stats` builtin and exported in Prometheus
+ * text format. Counting is one relaxed atomic add on the hot paths, all of the formatting happens when they are read.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#include "stats.h"
+#include "shell.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define STATS_INTERVAL_DEFAULT 15 // seconds between two exports when STATS_INTERVAL isn't set
+
+// ---- GLOBAL VARIABLES ----
+
+static struct ShellStats privateStats; // for the parser benchmark and anything else that never calls initStats()
+struct ShellStats *shellStats = &privateStats;
+
+// upper bounds of the latency buckets, in ns: 0.5 ms to 10 s
+static const long long bucketBounds[NUM_LATENCY_BUCKETS] = {
+    500000LL, 1000000LL, 2500000LL, 5000000LL, 10000000LL, 25000000LL, 50000000LL,
+    100000000LL, 250000000LL, 500000000LL, 1000000000LL, 2500000000LL, 5000000000LL, 10000000000LL
+};
+
+static const char *kindNames[NUM_SPAWN_KINDS] = {"command", "stage", "subshell", "capture"};
+
+static long long lastExport = 0; // monotonic ns of the last write to STATS_FILE
+static pid_t exporter = 0; // the shell that registered the exit hook, its forked children must not export too
+
+// ---- FUNCTION DECLARATIONS ----
+
+static long long now(); //CLOCK_MONOTONIC in ns
+static void appendf(struct Buffer *out, const char *format, ...) __attribute__((format(printf, 2, 3))); //printf onto a buffer
+static void appendCounter(struct Buffer *out, const char *name, const char *help, unsigned long long value, bool prometheus); //one counter line
+static double quantile(struct Histogram *histogram, double q); //upper bound (in ms) of the bucket holding the q-th quantile
+static void writeStats(char *path); //writes the Prometheus text to path through a temporary file and rename()
+static void exportAtExit(); //final export, registered with atexit()
+
+void initStats()
+{
+    void *page = mmap(NULL, sizeof(struct ShellStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (page != MAP_FAILED)
+
+    {
+        memcpy(page, &privateStats, sizeof(struct ShellStats));
+        shellStats = page;
+    }
+}
+
+long long spawnStarted()
+{
+    return now();
+}
+
+void spawnExited(enum SpawnKind kind, long long started, struct rusage *usage)
+{
+    struct Histogram *histogram = &shellStats->latency[kind];
+    long long elapsed = now() - started;
+    int bucket = 0;
+
+    while (bucket < NUM_LATENCY_BUCKETS && elapsed > bucketBounds[bucket])
+
+    {
+        bucket++;
+    }
+
+    __atomic_fetch_add(&histogram->buckets[bucket], 1, __ATOMIC_RELAXED); // a subshell reaps its own children
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sumNs, elapsed, __ATOMIC_RELAXED);
+
+    if (profiling)
+
+    {
+        profileChild(usage);
+    }
+}
+
+long long fileSize(const char *path)
+{
+    struct stat st;
+    return (stat(path, &st) == 0 && S_ISREG(st.st_mode)) ? (long long) st.st_size : 0;
+}
+
+void formatStats(struct Buffer *out, bool prometheus)
+{
+    appendCounter(out, "lines_parsed", "Input lines handed to the parser.", shellStats->lines, prometheus);
+    appendCounter(out, "tokens", "Tokens produced by the lexer.", shellStats->tokens, prometheus);
+    appendCounter(out, "alias_hits", "Commands whose name was an alias.", shellStats->aliasHits, prometheus);
+    appendCounter(out, "glob_expansions", "Words containing a wildcard.", shellStats->globExpansions, prometheus);
+    appendCounter(out, "glob_matches", "File names wildcards expanded to.", shellStats->globMatches, prometheus);
+    appendCounter(out, "spawns", "Child processes forked.", shellStats->spawns, prometheus);
+    appendCounter(out, "spawn_throttles", "Forks that waited for a SPAWN_LIMIT slot.", shellStats->spawnThrottles, prometheus);
+    appendCounter(out, "spawn_retries", "fork() calls retried after EAGAIN or ENOMEM.", shellStats->spawnRetries, prometheus);
+    appendCounter(out, "spawn_failures", "Forks given up on after backing off.", shellStats->spawnFailures, prometheus);
+    appendCounter(out, "exec_failures", "Commands execvp() failed to start.", shellStats->execFailures, prometheus);
+    appendCounter(out, "pipeline_stages", "Pipeline stages started.", shellStats->pipelineStages, prometheus);
+    appendCounter(out, "redirected_bytes", "Bytes written to files through > and >>.", shellStats->redirectedBytes, prometheus);
+
+    if (prometheus)
+
+    {
+        appendf(out, "# HELP shell_spawn_duration_seconds Time from fork() to the shell reaping the child.\n");
+        appendf(out, "# TYPE shell_spawn_duration_seconds histogram\n");
+    }
+
+    for (int kind = 0; kind < NUM_SPAWN_KINDS; kind++)
+
+    {
+        struct Histogram *histogram = &shellStats->latency[kind];
+
+        if (!prometheus)
+
+        {
+            if (histogram->count > 0)
+
+            {
+                appendf(out, "%-18s%llu reaped, mean %.3f ms, p50 <= %g ms, p90 <= %g ms, p99 <= %g ms\n", kindNames[kind], histogram->count,
+                    histogram->sumNs / 1e6 / histogram->count, quantile(histogram, 0.5), quantile(histogram, 0.9), quantile(histogram, 0.99));
+            }
+
+            continue;
+        }
+
+        unsigned long long cumulative = 0;
+
+        for (int i = 0; i < NUM_LATENCY_BUCKETS; i++)
+
+        {
+            cumulative += histogram->buckets[i];
+            appendf(out, "shell_spawn_duration_seconds_bucket{kind=\"%s\",le=\"%g\"} %llu\n", kindNames[kind], bucketBounds[i] / 1e9, cumulative);
+        }
+
+        appendf(out, "shell_spawn_duration_seconds_bucket{kind=\"%s\",le=\"+Inf\"} %llu\n", kindNames[kind], histogram->count);
+        appendf(out, "shell_spawn_duration_seconds_sum{kind=\"%s\"} %.9f\n", kindNames[kind], histogram->sumNs / 1e9);
+        appendf(out, "shell_spawn_duration_seconds_count{kind=\"%s\"} %llu\n", kindNames[kind], histogram->count);
+    }
+}
+
+bool isExporting()
+{
+    char *path = getVariable("STATS_FILE");
+    return path != NULL && path[0] != '\0';
+}
+
+void exportStats()
+{
+    if (!isExporting())
+
+    {
+        return;
+    }
+
+    char *interval = getVariable("STATS_INTERVAL");
+    long long seconds = (interval != NULL && atoll(interval) > 0) ? atoll(interval) : STATS_INTERVAL_DEFAULT;
+    long long time = now();
+
+    if (lastExport != 0 && time - lastExport < seconds * 1000000000LL)
+
+    {
+        return;
+    }
+
+    if (exporter == 0)
+
+    {
+        exporter = getpid();
+        atexit(exportAtExit);
+    }
+
+    lastExport = time;
+    writeStats(getVariable("STATS_FILE"));
+}
+
+static long long now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void appendf(struct Buffer *out, const char *format, ...)
+{
+    char line[512];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    bufferAppend(out, line, (len < (int) sizeof(line)) ? (size_t) len : sizeof(line) - 1);
+}
+
+static void appendCounter(struct Buffer *out, const char *name, const char *help, unsigned long long value, bool prometheus)
+{
+    if (prometheus)
+
+    {
+        appendf(out, "# HELP shell_%s_total %s\n# TYPE shell_%s_total counter\nshell_%s_total %llu\n", name, help, name, name, value);
+        return;
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s", name);
+
+    for (char *ptr = label; *ptr != '\0'; ptr++)
+
+    {
+        *ptr = (*ptr == '_') ? ' ' : *ptr; // lines_parsed -> lines parsed
+    }
+
+    appendf(out, "%-18s%llu\n", label, value);
+}
+
+static double quantile(struct Histogram *histogram, double q)
+{
+    unsigned long long rank = (unsigned long long) (q * histogram->count + 0.999999); // ceil, the q-th child in order of lifetime
+    unsigned long long seen = 0;
+
+    for (int i = 0; i < NUM_LATENCY_BUCKETS; i++)
+
+    {
+        seen += histogram->buckets[i];
+
+        if (seen >= rank)
+
+        {
+            return bucketBounds[i] / 1e6;
+        }
+    }
+
+    return INFINITY; // slower than the last bound
+}
+
+static void writeStats(char *path)
+{
+    struct Buffer text = {NULL, 0, 0};
+    char temporary[4096];
+
+    formatStats(&text, true);
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int) getpid()); // the collector must never see a half written file
+
+    FILE *file = fopen(temporary, "w");
+
+    if (file == NULL)
+
+    {
+        free(text.data);
+        return;
+    }
+
+    bool written = fwrite(text.data, 1, text.len, file) == text.len;
+    written = (fclose(file) == 0) && written;
+
+    if (!written || rename(temporary, path) != 0)
+
+    {
+        unlink(temporary);
+    }
+
+    free(text.data);
+}
+
+static void exportAtExit()
+{
+    if (getpid() == exporter && isExporting())
+
+    {
+        writeStats(getVariable("STATS_FILE"));
+    }
+}
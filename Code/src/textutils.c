@@ -0,0 +1,1985 @@
+/**
+ * @file textutils.c
+ * @brief grep -F, wc, cut, uniq and sort as builtins. Input comes in blocks that end at a line boundary: a regular
+ * file is mmap()ed and is one block, a pipe is read TEXT_BLOCK_SIZE bytes at a time and the unfinished last line is
+ * carried over to the next block. Output points into the block (outWriteRef()) and is flushed before the block is
+ * replaced, so selected lines go from the input buffer to stdout without being copied.
+ * sort gathers lines until they outgrow its memory budget, sorts them with one merge sort per core and a parallel
+ * merge of the pieces, and spills the sorted run to an unlinked temporary file; the runs are mmap()ed back and
+ * merged with a heap at the end.
+ * @version 0.1
+ * @date 2026-10-18
+ */
+
+#define _GNU_SOURCE // memrchr()
+
+#include "textutils.h"
+#include "builtins.h"
+#include "shell.h"
+#include "output.h"
+#include "scan.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define TEXT_BLOCK_SIZE (1 << 20)  // bytes read from a pipe at a time
+#define MAX_CUT_FIELDS 499         // cut lists naming a higher field are left to the real cut
+#define MAX_SORT_KEYS 8            // sort given more -k options than this is left to the real sort
+#define MAX_SORT_RUNS 64           // spilled runs merged at once, more are first merged into a single run
+#define MAX_SORT_THREADS 32
+#define SORT_PARALLEL_LINES 65536  // fewer lines than this are sorted by the calling thread alone
+#define SORT_MEMORY_SHARE 4        // without -S a run may take 1/SORT_MEMORY_SHARE of physical memory
+#define INSERTION_SORT_LINES 16    // merge sort hands ranges this short to an insertion sort
+
+// ---- STRUCTS ----
+
+struct TextOptions
+{
+    bool flags[128];        // option letters that were given
+    char *values[128];      // arguments of the options that take one (cut -d, -f)
+    char *pattern;          // grep's PATTERN
+    char **words;           // the command
+    int firstOperand;       // index in words of the first file name
+    int numOfOperands;
+    char *keys[MAX_SORT_KEYS]; // sort -k, which may be repeated
+    int numOfKeys;
+};
+
+struct TextInput
+{
+    const char *name;       // as given, NULL for stdin
+    int fd;
+    char *data;             // the mapped file, or the read buffer
+    size_t len;             // data[0 .. len) is the current block
+    size_t pending;         // read buffer: bytes after the block (an unfinished line), moved to the front next time
+    size_t cap;
+    size_t mapLen;          // mapped inputs: length of the mapping, which starts mapOffset bytes before data
+    size_t mapOffset;
+    bool mapped;
+    bool done;
+};
+
+struct FieldList
+{
+    bool wanted[MAX_CUT_FIELDS + 1];
+    int last;               // highest field named explicitly
+    int from;               // N- ranges: every field from here on, INT_MAX if there is none
+};
+
+struct SortKey
+{
+    int startField;         // POS1, both zero-based
+    int startChar;
+    int endField;           // POS2, zero-based, -1 if the key runs to the end of the line
+    int endChar;            // one-based, 0 for the end of the field
+    bool numeric;
+    bool reverse;
+};
+
+struct SortSpec
+{
+    struct SortKey keys[MAX_SORT_KEYS]; // the whole line if no -k was given
+    int numOfKeys;
+    int tab;                // -t, -1 for fields separated by blanks
+    bool reverse;           // -r also reverses the last-resort comparison of whole lines
+    bool unique;
+    size_t budget;          // bytes of lines (and their records) gathered before a run is spilled
+};
+
+struct SortLine
+{
+    const char *text;       // without the newline
+    size_t len;
+    uint64_t prefix;        // the first key reduced to an integer that orders the same way, ties need a full comparison
+};
+
+struct SortBatch
+{
+    struct SortLine *lines;
+    size_t count;
+    size_t cap;
+    size_t bytes;           // counted against the budget
+    char **chunks;          // copies of the pipe blocks the lines point into
+    int numOfChunks;
+    int chunksCapacity;
+};
+
+struct SortRun
+{
+    int fd;                 // an unlinked temporary file
+    char *map;              // its contents once it is written, one sorted line after another
+    size_t len;
+};
+
+struct SortSink
+{
+    int fd;                 // a run being written, -1 for stdout
+    struct Buffer buffer;
+    struct SortLine last;   // -u: the line written last, equal ones are dropped
+    bool hasLast;
+    int error;              // errno of a failed write, 0 if there was none
+};
+
+struct SortJob
+{
+    struct SortLine *from;
+    struct SortLine *to;    // scratch space for sorting, the destination for merging
+    size_t start;
+    size_t middle;          // merging: from[start .. middle) and from[middle .. end) go to to[start .. end)
+    size_t end;
+    bool merge;
+    const struct SortSpec *spec;
+};
+
+struct MergeSource
+{
+    struct SortLine *lines; // the batch still in memory, NULL for a spilled run
+    size_t count;
+    const char *data;       // a spilled run
+    size_t len;
+    size_t pos;             // next line to read, in lines or in data
+    struct SortLine current;
+    int order;              // earlier runs hold earlier input and win ties, which keeps the sort stable
+};
+
+struct SortNumber
+{
+    bool negative;
+    const char *digits;     // integer part without leading zeros
+    size_t numOfDigits;
+    const char *fraction;   // without trailing zeros
+    size_t fractionLen;
+};
+
+// ---- FUNCTION DECLARATIONS ----
+
+static bool parseOptions(char **parsed, const char *letters, const char *withValue, bool hasPattern, struct TextOptions *opts); //getopt for the subset a builtin supports, false if the real tool is needed
+static bool parseFields(const char *list, struct FieldList *fields); //cut -f LIST, false if it is invalid or beyond MAX_CUT_FIELDS
+static bool isField(struct FieldList *fields, int field); //checks if a field is selected
+static bool openInput(struct TextInput *in, const char *name, const char *tool); //opens a file (or stdin for NULL and "-") and reports failures
+static bool nextBlock(struct TextInput *in); //moves on to the next block of whole lines, false at end of input
+static void closeInput(struct TextInput *in); //unmaps or frees the input and closes its fd
+static const char *operand(struct TextOptions *opts, int index); //the index-th file name, NULL for stdin ("-" or no files at all)
+static void writeLines(const char *start, const char *end, const char *prefix, long long *lineNumber); //outputs whole lines, with grep's file name and line number prefixes
+static long long grepInput(struct TextInput *in, struct TextOptions *opts, const char *prefix); //selected lines of one input, -1 once -q found one
+static void cutLine(const char *line, const char *end, char delimiter, struct FieldList *fields, bool onlyDelimited); //outputs the selected fields of one line
+static void uniqLine(const char *line, size_t len, unsigned long long count, struct TextOptions *opts); //outputs one group of equal lines if the options select it
+static bool parseSortSpec(struct TextOptions *opts, struct SortSpec *spec); //turns sort's options into keys and a budget, false if the real sort is needed
+static bool parseSortKey(const char *def, struct TextOptions *opts, struct SortKey *key); //-k POS1[,POS2] with n and r as the only key options
+static bool isPosixLocale(bool numeric); //checks if the locale compares bytes (and uses '.' and no thousands separator)
+static const char *nextField(const char *ptr, const char *lim, int tab); //start of the field after the one ptr is in
+static void keyRange(const struct SortLine *line, const struct SortKey *key, int tab, const char **start, const char **end); //where a key starts and ends in a line, like GNU sort
+static void parseNumber(const char *ptr, const char *end, struct SortNumber *num); //sort -n's view of a key: blanks, an optional '-', digits, '.', digits
+static int compareNumbers(const char *a, const char *aEnd, const char *b, const char *bEnd); //compares two keys as decimal numbers of any length
+static int compareBytes(const char *a, size_t aLen, const char *b, size_t bLen); //memcmp(), then the shorter one first
+static int compareLines(const struct SortLine *a, const struct SortLine *b, const struct SortSpec *spec); //key by key, then the whole lines unless -u
+static void setPrefix(struct SortLine *line, const struct SortSpec *spec); //fills in a line's prefix from its first key
+static void mergeLines(const struct SortLine *a, size_t aCount, const struct SortLine *b, size_t bCount, struct SortLine *out, const struct SortSpec *spec); //stable merge of two sorted ranges
+static void mergeSort(struct SortLine *lines, struct SortLine *scratch, size_t count, const struct SortSpec *spec); //stable sort of lines in place
+static void *runSortJob(void *arg); //thread body: sorts a slice (prefixes included) or merges two neighbouring ones
+static void runSortJobs(struct SortJob *jobs, int count); //runs each job on a thread of its own (the first on the calling thread) and waits for them
+static void sortBatch(struct SortLine *lines, size_t count, const struct SortSpec *spec); //sorts lines on every core
+static void addLine(struct SortBatch *batch, const char *text, size_t len); //appends a line, the text has to outlive the batch's sorting
+static void emitLine(struct SortSink *sink, const struct SortLine *line, const struct SortSpec *spec); //writes a line to stdout or to a run, dropping -u duplicates
+static void flushSink(struct SortSink *sink); //writes what a run's sink buffered
+static bool spillBatch(struct SortBatch *batch, struct SortRun *runs, int *numOfRuns, const struct SortSpec *spec); //sorts the batch into a new run and empties it
+static bool createRun(struct SortRun *run); //opens an unlinked temporary file in $TMPDIR
+static bool finishRun(struct SortRun *run, struct SortSink *sink); //flushes a run and maps it for merging
+static void closeRuns(struct SortRun *runs, int numOfRuns); //unmaps and closes spilled runs
+static bool nextMergeLine(struct MergeSource *source, const struct SortSpec *spec); //moves a source on to its next line, false when it has none left
+static void siftDown(struct MergeSource *sources, int *heap, int size, int index, const struct SortSpec *spec); //restores the merge heap below index
+static bool mergeRuns(struct SortRun *runs, int numOfRuns, struct SortLine *lines, size_t count, struct SortSink *sink, const struct SortSpec *spec); //k-way merge of runs and the sorted batch into the sink
+
+bool isTextBuiltin(char **parsed)
+{
+    struct TextOptions opts;
+    struct FieldList fields;
+
+    if (strcmp(parsed[0], "grep") == 0)
+
+    {
+        return parseOptions(parsed, "Fvcqn", "", true, &opts) && (opts.flags['F'] || strpbrk(opts.pattern, "\\.[*^$") == NULL); // a regex is left to grep
+    }
+
+    if (strcmp(parsed[0], "wc") == 0)
+
+    {
+        return parseOptions(parsed, "lwc", "", false, &opts);
+    }
+
+    if (strcmp(parsed[0], "cut") == 0)
+
+    {
+        return parseOptions(parsed, "s", "df", false, &opts) && opts.values['f'] != NULL && parseFields(opts.values['f'], &fields) &&
+               (opts.values['d'] == NULL || strlen(opts.values['d']) == 1); // -c, -b and multi-byte delimiters are left to cut
+    }
+
+    if (strcmp(parsed[0], "uniq") == 0)
+
+    {
+        return parseOptions(parsed, "cdu", "", false, &opts) && opts.numOfOperands <= 1; // uniq IN OUT writes to a file
+    }
+
+    if (strcmp(parsed[0], "sort") == 0)
+
+    {
+        struct SortSpec spec;
+        return parseOptions(parsed, "nru", "ktS", false, &opts) && parseSortSpec(&opts, &spec);
+    }
+
+    return false;
+}
+
+int builtinGrep(char **parsed)
+{
+    struct TextOptions opts;
+    long long selected = 0;
+    bool failed = false;
+
+    parseOptions(parsed, "Fvcqn", "", true, &opts);
+
+    for (int i = 0; i < opts.numOfOperands || (i == 0 && opts.numOfOperands == 0); i++)
+
+    {
+        struct TextInput in;
+        const char *name = operand(&opts, i);
+
+        if (!openInput(&in, name, "grep"))
+
+        {
+            failed = true;
+            continue;
+        }
+
+        const char *prefix = (opts.numOfOperands > 1) ? (name ? name : "(standard input)") : NULL;
+        long long count = grepInput(&in, &opts, prefix);
+        closeInput(&in);
+
+        if (count < 0) // -q, the first selected line settles it
+
+        {
+            return 0;
+        }
+
+        if (opts.flags['c'] && !opts.flags['q'])
+
+        {
+            outPrintf(prefix ? "%s:%lld\n" : "%s%lld\n", prefix ? prefix : "", count);
+        }
+
+        selected += count;
+    }
+
+    return (failed && !(opts.flags['q'] && selected > 0)) ? 2 : (selected > 0) ? 0 : 1;
+}
+
+int builtinWc(char **parsed)
+{
+    struct TextOptions opts;
+    parseOptions(parsed, "lwc", "", false, &opts);
+
+    bool shown[3] = {opts.flags['l'], opts.flags['w'], opts.flags['c']}; // lines, words, bytes
+
+    if (!shown[0] && !shown[1] && !shown[2])
+
+    {
+        shown[0] = shown[1] = shown[2] = true;
+    }
+
+    int numOfInputs = opts.numOfOperands ? opts.numOfOperands : 1;
+    int width = 1;
+
+    // coreutils' column width: wide enough for the total size of the regular files, 7 if a pipe or a device is
+    // among the inputs, 1 if there is only a single number to print
+    if (shown[0] + shown[1] + shown[2] > 1 || numOfInputs > 1)
+
+    {
+        unsigned long long total = 0;
+        int minimum = 1;
+        struct stat st;
+
+        for (int i = 0; i < numOfInputs; i++)
+
+        {
+            const char *name = operand(&opts, i);
+            int rc = (name == NULL) ? fstat(STDIN_FILENO, &st) : stat(name, &st);
+
+            total += (rc == 0 && S_ISREG(st.st_mode)) ? (unsigned long long) st.st_size : 0;
+            minimum = (rc == 0 && !S_ISREG(st.st_mode)) ? 7 : minimum;
+        }
+
+        for (; total >= 10; total /= 10)
+
+        {
+            width++;
+        }
+
+        width = (width < minimum) ? minimum : width;
+    }
+
+    unsigned long long totals[3] = {0, 0, 0};
+    int status = 0;
+
+    for (int i = 0; i <= numOfInputs; i++)
+
+    {
+        unsigned long long counts[3] = {0, 0, 0};
+
+        if (i == numOfInputs && numOfInputs == 1)
+
+        {
+            break; // a total only follows several inputs
+        }
+
+        if (i < numOfInputs)
+
+        {
+            struct TextInput in;
+            bool inWord = false;
+
+            if (!openInput(&in, operand(&opts, i), "wc"))
+
+            {
+                status = 1;
+                continue;
+            }
+
+            while (nextBlock(&in))
+
+            {
+                counts[0] += shown[0] ? countByte(in.data, in.len, '\n') : 0;
+                counts[1] += shown[1] ? countWords(in.data, in.len, &inWord) : 0;
+                counts[2] += in.len;
+            }
+
+            closeInput(&in);
+        }
+
+        bool first = true;
+
+        for (int j = 0; j < 3; j++)
+
+        {
+            counts[j] = (i == numOfInputs) ? totals[j] : counts[j];
+            totals[j] += counts[j];
+
+            if (shown[j])
+
+            {
+                outPrintf("%s%*llu", first ? "" : " ", width, counts[j]);
+                first = false;
+            }
+        }
+
+        char *name = (i == numOfInputs) ? "total" : (opts.numOfOperands > 0) ? wordValue(opts.words[opts.firstOperand + i]) : NULL;
+        outPrintf(name ? " %s\n" : "\n", name);
+    }
+
+    return status;
+}
+
+int builtinCut(char **parsed)
+{
+    struct TextOptions opts;
+    struct FieldList fields;
+
+    parseOptions(parsed, "s", "df", false, &opts);
+    parseFields(opts.values['f'], &fields);
+
+    char delimiter = opts.values['d'] ? opts.values['d'][0] : '\t';
+    int status = 0;
+
+    for (int i = 0; i < opts.numOfOperands || (i == 0 && opts.numOfOperands == 0); i++)
+
+    {
+        struct TextInput in;
+
+        if (!openInput(&in, operand(&opts, i), "cut"))
+
+        {
+            status = 1;
+            continue;
+        }
+
+        while (nextBlock(&in))
+
+        {
+            const char *end = in.data + in.len;
+
+            for (const char *line = in.data; line < end; )
+
+            {
+                const char *newline = findByte(line, end - line, '\n');
+                const char *lineEnd = newline ? newline : end;
+
+                cutLine(line, lineEnd, delimiter, &fields, opts.flags['s']);
+                line = lineEnd + 1;
+            }
+
+            outFlush(); // the next block overwrites the buffer the output points into
+        }
+
+        closeInput(&in);
+    }
+
+    return status;
+}
+
+int builtinUniq(char **parsed)
+{
+    struct TextOptions opts;
+    struct TextInput in;
+    struct Buffer saved = {NULL, 0, 0}; // the previous line, once its block is gone
+    const char *previous = NULL;
+    size_t previousLen = 0;
+    unsigned long long count = 0;
+
+    parseOptions(parsed, "cdu", "", false, &opts);
+
+    if (!openInput(&in, operand(&opts, 0), "uniq"))
+
+    {
+        return 1;
+    }
+
+    while (nextBlock(&in))
+
+    {
+        const char *end = in.data + in.len;
+
+        for (const char *line = in.data; line < end; )
+
+        {
+            const char *newline = findByte(line, end - line, '\n');
+            size_t len = (newline ? newline : end) - line;
+
+            if (count > 0 && len == previousLen && memcmp(line, previous, len) == 0)
+
+            {
+                count++;
+            }
+
+            else
+
+            {
+                if (count > 0)
+
+                {
+                    uniqLine(previous, previousLen, count, &opts);
+                }
+
+                previous = line;
+                previousLen = len;
+                count = 1;
+            }
+
+            line += len + 1;
+        }
+
+        outFlush();
+
+        if (count > 0 && previous != saved.data) // keep the group's line for the comparisons in the next block
+
+        {
+            saved.len = 0;
+            bufferAppend(&saved, previous, previousLen);
+            previous = saved.data;
+        }
+    }
+
+    if (count > 0)
+
+    {
+        uniqLine(previous, previousLen, count, &opts);
+    }
+
+    outFlush();
+    closeInput(&in);
+    free(saved.data);
+    return 0;
+}
+
+int builtinSort(char **parsed)
+{
+    struct TextOptions opts;
+    struct SortSpec spec;
+    struct SortBatch batch;
+    struct SortRun runs[MAX_SORT_RUNS];
+    int numOfRuns = 0;
+    bool ok = true;
+
+    parseOptions(parsed, "nru", "ktS", false, &opts);
+    parseSortSpec(&opts, &spec);
+    memset(&batch, 0, sizeof(batch));
+
+    int numOfInputs = opts.numOfOperands ? opts.numOfOperands : 1;
+    struct TextInput *inputs = calloc(numOfInputs, sizeof(struct TextInput)); // kept open, the lines point into them
+    int opened = 0;
+
+    for (; ok && opened < numOfInputs; opened++)
+
+    {
+        struct TextInput *in = &inputs[opened];
+
+        if (!openInput(in, operand(&opts, opened), "sort"))
+
+        {
+            ok = false; // like sort, nothing is output if an input can't be read
+            break;
+        }
+
+        while (ok && nextBlock(in))
+
+        {
+            const char *data = in->data;
+
+            if (!in->mapped) // the read buffer is reused for the next block
+
+            {
+                if (batch.numOfChunks == batch.chunksCapacity)
+
+                {
+                    batch.chunksCapacity = batch.chunksCapacity ? batch.chunksCapacity * 2 : 16;
+                    batch.chunks = realloc(batch.chunks, batch.chunksCapacity * sizeof(char *));
+                }
+
+                batch.chunks[batch.numOfChunks] = malloc(in->len);
+                memcpy(batch.chunks[batch.numOfChunks], in->data, in->len);
+                data = batch.chunks[batch.numOfChunks++];
+            }
+
+            const char *end = data + in->len;
+
+            for (const char *line = data; ok && line < end; )
+
+            {
+                const char *newline = findByte(line, end - line, '\n');
+                const char *lineEnd = newline ? newline : end;
+
+                addLine(&batch, line, lineEnd - line);
+                line = lineEnd + 1;
+
+                if (batch.bytes >= spec.budget)
+
+                {
+                    ok = spillBatch(&batch, runs, &numOfRuns, &spec);
+                }
+            }
+        }
+    }
+
+    if (ok)
+
+    {
+        struct SortSink sink;
+
+        memset(&sink, 0, sizeof(sink));
+        sink.fd = -1;
+        sortBatch(batch.lines, batch.count, &spec);
+        mergeRuns(runs, numOfRuns, batch.lines, batch.count, &sink, &spec);
+        outFlush(); // the output points into the inputs and the runs
+    }
+
+    closeRuns(runs, numOfRuns);
+
+    for (int i = 0; i < batch.numOfChunks; i++)
+
+    {
+        free(batch.chunks[i]);
+    }
+
+    for (int i = 0; i < opened; i++)
+
+    {
+        closeInput(&inputs[i]);
+    }
+
+    free(batch.chunks);
+    free(batch.lines);
+    free(inputs);
+    return ok ? 0 : 2;
+}
+
+static bool parseOptions(char **parsed, const char *letters, const char *withValue, bool hasPattern, struct TextOptions *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->words = parsed;
+    int i = 1;
+
+    for (; parsed[i][0] == '-' && parsed[i][1] != '\0'; i++)
+
+    {
+        if (strcmp(parsed[i], "--") == 0)
+
+        {
+            i++;
+            break;
+        }
+
+        for (char *opt = parsed[i] + 1; *opt != '\0'; opt++)
+
+        {
+            unsigned char letter = (unsigned char) *opt;
+
+            if (letter < 128 && strchr(withValue, letter) != NULL)
+
+            {
+                if (opt[1] == '\0' && parsed[i + 1][0] == '\0')
+
+                {
+                    return false; // missing argument, the real tool says so
+                }
+
+                opts->values[letter] = (opt[1] != '\0') ? opt + 1 : wordValue(parsed[++i]);
+
+                if (letter == 'k' && opts->numOfKeys == MAX_SORT_KEYS)
+
+                {
+                    return false;
+                }
+
+                if (letter == 'k')
+
+                {
+                    opts->keys[opts->numOfKeys++] = opts->values[letter];
+                }
+
+                break;
+            }
+
+            if (letter >= 128 || strchr(letters, letter) == NULL)
+
+            {
+                return false;
+            }
+
+            opts->flags[letter] = true;
+        }
+    }
+
+    if (hasPattern)
+
+    {
+        if (parsed[i][0] == '\0')
+
+        {
+            return false;
+        }
+
+        opts->pattern = wordValue(parsed[i++]);
+    }
+
+    opts->firstOperand = i;
+
+    for (; parsed[i][0] != '\0'; i++)
+
+    {
+        if (parsed[i][0] == '-' && parsed[i][1] != '\0')
+
+        {
+            return false; // GNU tools take options after the operands too
+        }
+
+        opts->numOfOperands++;
+    }
+
+    return true;
+}
+
+static bool parseFields(const char *list, struct FieldList *fields)
+{
+    memset(fields, 0, sizeof(*fields));
+    fields->from = INT_MAX;
+
+    for (const char *ptr = list; ; ptr++)
+
+    {
+        char *end = NULL;
+        long low = (*ptr == '-') ? 1 : strtol(ptr, &end, 10);
+        long high = low;
+
+        ptr = (*ptr == '-') ? ptr : end;
+
+        if (low < 1 || low > MAX_CUT_FIELDS)
+
+        {
+            return false;
+        }
+
+        if (*ptr == '-')
+
+        {
+            ptr++;
+            high = (*ptr >= '0' && *ptr <= '9') ? strtol(ptr, &end, 10) : LONG_MAX;
+            ptr = (high == LONG_MAX) ? ptr : end;
+        }
+
+        if (high == LONG_MAX)
+
+        {
+            fields->from = (low < fields->from) ? (int) low : fields->from;
+        }
+
+        else if (high < low || high > MAX_CUT_FIELDS)
+
+        {
+            return false;
+        }
+
+        for (long field = low; high != LONG_MAX && field <= high; field++)
+
+        {
+            fields->wanted[field] = true;
+            fields->last = (field > fields->last) ? (int) field : fields->last;
+        }
+
+        if (*ptr == '\0')
+
+        {
+            return true;
+        }
+
+        if (*ptr != ',')
+
+        {
+            return false;
+        }
+    }
+}
+
+static bool isField(struct FieldList *fields, int field)
+{
+    return field >= fields->from || (field <= fields->last && fields->wanted[field]);
+}
+
+static bool openInput(struct TextInput *in, const char *name, const char *tool)
+{
+    memset(in, 0, sizeof(*in));
+    in->name = name;
+    in->fd = (name == NULL) ? STDIN_FILENO : open(name, O_RDONLY | O_CLOEXEC);
+
+    if (in->fd < 0)
+
+    {
+        fprintf(stderr, "%s: %s: %s: %s\n", shellName, tool, name, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    off_t offset = (name == NULL) ? lseek(STDIN_FILENO, 0, SEEK_CUR) : 0; // < file may have been read from already
+    bool regular = fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0;
+
+    if (regular && st.st_size <= offset)
+
+    {
+        in->done = true; // nothing left to read
+        return true;
+    }
+
+    if (regular)
+
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, in->fd, 0);
+
+        if (map != MAP_FAILED)
+
+        {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            in->mapped = true;
+            in->mapLen = st.st_size;
+            in->mapOffset = offset;
+            in->data = (char *) map + offset;
+            return true;
+        }
+    }
+
+    return true;
+}
+
+static bool nextBlock(struct TextInput *in)
+{
+    if (in->mapped)
+
+    {
+        bool first = !in->done;
+        in->len = first ? in->mapLen - in->mapOffset : 0;
+        in->done = true;
+        return first;
+    }
+
+    if (in->done)
+
+    {
+        return false;
+    }
+
+    if (in->pending > 0)
+
+    {
+        memmove(in->data, in->data + in->len, in->pending);
+    }
+
+    size_t filled = in->pending;
+    size_t scanned = 0; // bytes already known not to contain a newline
+
+    while (true)
+
+    {
+        if (in->cap - filled < TEXT_BLOCK_SIZE / 2)
+
+        {
+            in->cap = (in->cap < TEXT_BLOCK_SIZE) ? TEXT_BLOCK_SIZE : in->cap * 2; // a line longer than a block grows it
+            in->data = realloc(in->data, in->cap);
+        }
+
+        ssize_t n = read(in->fd, in->data + filled, in->cap - filled);
+
+        if (n < 0 && errno == EINTR)
+
+        {
+            continue;
+        }
+
+        if (n <= 0)
+
+        {
+            in->done = true;
+            in->len = filled; // the last line, newline or not
+            in->pending = 0;
+            return filled > 0;
+        }
+
+        filled += n;
+        char *newline = memrchr(in->data + scanned, '\n', filled - scanned);
+
+        if (newline != NULL)
+
+        {
+            in->len = newline + 1 - in->data;
+            in->pending = filled - in->len;
+            return true;
+        }
+
+        scanned = filled;
+    }
+}
+
+static void closeInput(struct TextInput *in)
+{
+    if (in->mapped)
+
+    {
+        munmap(in->data - in->mapOffset, in->mapLen);
+
+        if (in->name == NULL)
+
+        {
+            lseek(STDIN_FILENO, 0, SEEK_END); // like a tool that read it, the input is used up
+        }
+    }
+
+    else
+
+    {
+        free(in->data);
+    }
+
+    if (in->name != NULL)
+
+    {
+        close(in->fd);
+    }
+}
+
+static const char *operand(struct TextOptions *opts, int index)
+{
+    if (index >= opts->numOfOperands)
+
+    {
+        return NULL;
+    }
+
+    char *name = wordValue(opts->words[opts->firstOperand + index]);
+    return (strcmp(name, "-") == 0) ? NULL : name;
+}
+
+static void writeLines(const char *start, const char *end, const char *prefix, long long *lineNumber)
+{
+    if (prefix == NULL && lineNumber == NULL)
+
+    {
+        outWriteRef(start, end - start); // the whole span at once
+
+        if (end > start && end[-1] != '\n')
+
+        {
+            outWrite("\n", 1); // the input's last line had no newline, grep adds one
+        }
+
+        return;
+    }
+
+    while (start < end)
+
+    {
+        const char *newline = findByte(start, end - start, '\n');
+        const char *lineEnd = newline ? newline + 1 : end;
+
+        if (prefix != NULL)
+
+        {
+            outPrintf("%s:", prefix);
+        }
+
+        if (lineNumber != NULL)
+
+        {
+            outPrintf("%lld:", ++*lineNumber);
+        }
+
+        outWriteRef(start, lineEnd - start);
+
+        if (newline == NULL)
+
+        {
+            outWrite("\n", 1);
+        }
+
+        start = lineEnd;
+    }
+}
+
+static long long grepInput(struct TextInput *in, struct TextOptions *opts, const char *prefix)
+{
+    size_t patternLen = strlen(opts->pattern);
+    bool invert = opts->flags['v'];
+    bool print = !opts->flags['c'] && !opts->flags['q'];
+    long long lineNumber = 0;
+    long long *numbers = opts->flags['n'] ? &lineNumber : NULL;
+    long long selected = 0;
+
+    while (nextBlock(in))
+
+    {
+        const char *ptr = in->data;
+        const char *end = in->data + in->len;
+
+        while (ptr < end)
+
+        {
+            // find the next matching line, every line before it is a non-matching one
+            const char *match = findString(ptr, end - ptr, opts->pattern, patternLen);
+            const char *lineStart = end;
+            const char *lineEnd = end;
+
+            if (match != NULL)
+
+            {
+                const char *newline = memrchr(ptr, '\n', match - ptr);
+                lineStart = newline ? newline + 1 : ptr;
+                newline = findByte(match, end - match, '\n');
+                lineEnd = newline ? newline + 1 : end;
+            }
+
+            if (invert && lineStart > ptr)
+
+            {
+                selected += countByte(ptr, lineStart - ptr, '\n') + (lineStart[-1] != '\n');
+
+                if (print)
+
+                {
+                    writeLines(ptr, lineStart, prefix, numbers);
+                }
+            }
+
+            else if (numbers != NULL && lineStart > ptr)
+
+            {
+                lineNumber += countByte(ptr, lineStart - ptr, '\n'); // skipped lines still count
+            }
+
+            if (match != NULL && !invert)
+
+            {
+                selected++;
+
+                if (print)
+
+                {
+                    writeLines(lineStart, lineEnd, prefix, numbers);
+                }
+            }
+
+            else if (match != NULL && numbers != NULL)
+
+            {
+                lineNumber++;
+            }
+
+            if (opts->flags['q'] && selected > 0)
+
+            {
+                return -1;
+            }
+
+            ptr = lineEnd;
+        }
+
+        outFlush(); // the next block overwrites the buffer the output points into
+    }
+
+    return selected;
+}
+
+static void cutLine(const char *line, const char *end, char delimiter, struct FieldList *fields, bool onlyDelimited)
+{
+    const char *next = findByte(line, end - line, delimiter);
+
+    if (next == NULL) // no delimiter at all, the line is passed through (or dropped with -s)
+
+    {
+        if (!onlyDelimited)
+
+        {
+            outWriteRef(line, end - line);
+            outWrite("\n", 1);
+        }
+
+        return;
+    }
+
+    bool first = true;
+    int field = 1;
+    const char *start = line;
+
+    while (true)
+
+    {
+        const char *fieldEnd = next ? next : end;
+
+        if (isField(fields, field))
+
+        {
+            if (!first)
+
+            {
+                outWrite(&delimiter, 1);
+            }
+
+            outWriteRef(start, fieldEnd - start);
+            first = false;
+        }
+
+        if (next == NULL || (field >= fields->last && fields->from == INT_MAX))
+
+        {
+            break; // the rest of the line has no selected field
+        }
+
+        start = next + 1;
+        next = findByte(start, end - start, delimiter);
+        field++;
+    }
+
+    outWrite("\n", 1);
+}
+
+static void uniqLine(const char *line, size_t len, unsigned long long count, struct TextOptions *opts)
+{
+    if ((opts->flags['d'] && count < 2) || (opts->flags['u'] && count > 1))
+
+    {
+        return;
+    }
+
+    if (opts->flags['c'])
+
+    {
+        outPrintf("%7llu ", count);
+    }
+
+    outWriteRef(line, len);
+    outWrite("\n", 1);
+}
+
+static bool parseSortSpec(struct TextOptions *opts, struct SortSpec *spec)
+{
+    memset(spec, 0, sizeof(*spec));
+    spec->tab = -1;
+    spec->reverse = opts->flags['r'];
+    spec->unique = opts->flags['u'];
+
+    if (opts->values['t'] != NULL)
+
+    {
+        if (strlen(opts->values['t']) != 1)
+
+        {
+            return false;
+        }
+
+        spec->tab = (unsigned char) opts->values['t'][0];
+    }
+
+    if (opts->values['S'] != NULL)
+
+    {
+        // sort's SIZE: kibibytes by default, b for bytes, K, M and G suffixes ('%' of memory is left to sort)
+        char *size = opts->values['S'];
+        char *end = NULL;
+        unsigned long long units = (*size >= '0' && *size <= '9') ? strtoull(size, &end, 10) : 0;
+        const char *suffixes = "bKMG";
+        const char *suffix = (end != NULL && *end != '\0') ? strchr(suffixes, (*end == 'k') ? 'K' : (*end == 'm') ? 'M' : (*end == 'g') ? 'G' : *end) : NULL;
+
+        if (end == NULL || (*end != '\0' && (suffix == NULL || end[1] != '\0')))
+
+        {
+            return false;
+        }
+
+        int shift = (suffix == NULL) ? 10 : (int) (suffix - suffixes) * 10;
+        spec->budget = (units > (SIZE_MAX >> shift)) ? SIZE_MAX : (size_t) units << shift;
+    }
+
+    else
+
+    {
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long pageSize = sysconf(_SC_PAGESIZE);
+        spec->budget = (pages > 0 && pageSize > 0) ? (size_t) pages * pageSize / SORT_MEMORY_SHARE : (size_t) 256 << 20;
+    }
+
+    spec->budget = (spec->budget > 0) ? spec->budget : 1;
+    bool numeric = opts->flags['n'];
+
+    for (int i = 0; i < opts->numOfKeys; i++)
+
+    {
+        if (!parseSortKey(opts->keys[i], opts, &spec->keys[i]))
+
+        {
+            return false;
+        }
+
+        numeric = numeric || spec->keys[i].numeric;
+    }
+
+    spec->numOfKeys = opts->numOfKeys;
+
+    if (spec->numOfKeys == 0) // the whole line is the key
+
+    {
+        spec->keys[0].endField = -1;
+        spec->keys[0].numeric = opts->flags['n'];
+        spec->keys[0].reverse = opts->flags['r'];
+        spec->numOfKeys = 1;
+    }
+
+    return isPosixLocale(numeric);
+}
+
+static bool parseSortKey(const char *def, struct TextOptions *opts, struct SortKey *key)
+{
+    const char *ptr = def;
+    bool hasOptions = false;
+
+    memset(key, 0, sizeof(*key));
+    key->endField = -1;
+
+    for (int pos = 0; pos < 2; pos++)
+
+    {
+        char *end = NULL;
+        long field = (*ptr >= '0' && *ptr <= '9') ? strtol(ptr, &end, 10) : 0;
+        long character = (pos == 0) ? 1 : 0;
+
+        if (field < 1 || field > INT_MAX / 2)
+
+        {
+            return false;
+        }
+
+        ptr = end;
+
+        if (*ptr == '.')
+
+        {
+            ptr++;
+            character = (*ptr >= '0' && *ptr <= '9') ? strtol(ptr, &end, 10) : -1;
+            ptr = (character < 0) ? ptr : end;
+
+            if (character < ((pos == 0) ? 1 : 0) || character > INT_MAX / 2)
+
+            {
+                return false;
+            }
+        }
+
+        for (; *ptr == 'n' || *ptr == 'r'; ptr++)
+
+        {
+            key->numeric = key->numeric || *ptr == 'n';
+            key->reverse = key->reverse || *ptr == 'r';
+            hasOptions = true;
+        }
+
+        if (pos == 0)
+
+        {
+            key->startField = (int) field - 1;
+            key->startChar = (int) character - 1;
+        }
+
+        else
+
+        {
+            key->endField = (int) field - 1;
+            key->endChar = (int) character;
+        }
+
+        if (*ptr != ',' || pos == 1)
+
+        {
+            break;
+        }
+
+        ptr++;
+    }
+
+    if (!hasOptions) // a key without options of its own takes the global ones
+
+    {
+        key->numeric = opts->flags['n'];
+        key->reverse = opts->flags['r'];
+    }
+
+    return *ptr == '\0';
+}
+
+static bool isPosixLocale(bool numeric)
+{
+    const char *categories[] = {"LC_COLLATE", "LC_NUMERIC"};
+    const char *all = getenv("LC_ALL");
+
+    for (int i = 0; i < (numeric ? 2 : 1); i++)
+
+    {
+        const char *value = (all != NULL && *all != '\0') ? all : getenv(categories[i]);
+        value = (value != NULL && *value != '\0') ? value : getenv("LANG");
+
+        if (value != NULL && *value != '\0' && strcmp(value, "C") != 0 && strcmp(value, "POSIX") != 0 && strncmp(value, "C.", 2) != 0)
+
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static const char *nextField(const char *ptr, const char *lim, int tab)
+{
+    if (tab >= 0)
+
+    {
+        const char *found = findByte(ptr, lim - ptr, (char) tab);
+        return found ? found + 1 : lim;
+    }
+
+    // without -t a field is a run of blanks and the non-blanks after it
+    for (; ptr < lim && (*ptr == ' ' || *ptr == '\t'); ptr++);
+    for (; ptr < lim && *ptr != ' ' && *ptr != '\t'; ptr++);
+
+    return ptr;
+}
+
+static void keyRange(const struct SortLine *line, const struct SortKey *key, int tab, const char **start, const char **end)
+{
+    const char *lim = line->text + line->len;
+    const char *ptr = line->text;
+
+    for (int field = key->startField; ptr < lim && field > 0; field--)
+
+    {
+        ptr = nextField(ptr, lim, tab);
+    }
+
+    *start = (lim - ptr < key->startChar) ? lim : ptr + key->startChar;
+
+    if (key->endField < 0)
+
+    {
+        *end = lim;
+        return;
+    }
+
+    // POS2 without a character position takes in the whole field, so the search stops after it
+    int fields = key->endField + (key->endChar == 0);
+    ptr = line->text;
+
+    while (ptr < lim && fields-- > 0)
+
+    {
+        if (tab < 0)
+
+        {
+            ptr = nextField(ptr, lim, tab);
+            continue;
+        }
+
+        const char *found = findByte(ptr, lim - ptr, (char) tab);
+        ptr = found ? found : lim;
+        ptr += (ptr < lim && (fields > 0 || key->endChar > 0)); // the end field's own delimiter isn't part of the key
+    }
+
+    if (key->endChar > 0)
+
+    {
+        ptr = (lim - ptr < key->endChar) ? lim : ptr + key->endChar;
+    }
+
+    *end = (ptr < *start) ? *start : ptr;
+}
+
+static void parseNumber(const char *ptr, const char *end, struct SortNumber *num)
+{
+    for (; ptr < end && (*ptr == ' ' || *ptr == '\t'); ptr++);
+
+    num->negative = ptr < end && *ptr == '-';
+    ptr += num->negative;
+
+    for (; ptr < end && *ptr == '0'; ptr++);
+
+    num->digits = ptr;
+
+    for (; ptr < end && *ptr >= '0' && *ptr <= '9'; ptr++);
+
+    num->numOfDigits = ptr - num->digits;
+    num->fraction = ptr;
+    num->fractionLen = 0;
+
+    if (ptr < end && *ptr == '.')
+
+    {
+        num->fraction = ++ptr;
+
+        for (; ptr < end && *ptr >= '0' && *ptr <= '9'; ptr++);
+
+        num->fractionLen = ptr - num->fraction;
+
+        while (num->fractionLen > 0 && num->fraction[num->fractionLen - 1] == '0')
+
+        {
+            num->fractionLen--;
+        }
+    }
+}
+
+static int compareNumbers(const char *a, const char *aEnd, const char *b, const char *bEnd)
+{
+    struct SortNumber x, y;
+
+    parseNumber(a, aEnd, &x);
+    parseNumber(b, bEnd, &y);
+
+    // anything that isn't a number counts as 0, and so does -0
+    int xSign = (x.numOfDigits == 0 && x.fractionLen == 0) ? 0 : x.negative ? -1 : 1;
+    int ySign = (y.numOfDigits == 0 && y.fractionLen == 0) ? 0 : y.negative ? -1 : 1;
+
+    if (xSign != ySign || xSign == 0)
+
+    {
+        return (xSign > ySign) - (xSign < ySign);
+    }
+
+    int diff = (x.numOfDigits != y.numOfDigits) ? ((x.numOfDigits < y.numOfDigits) ? -1 : 1) : memcmp(x.digits, y.digits, x.numOfDigits);
+
+    if (diff == 0)
+
+    {
+        diff = memcmp(x.fraction, y.fraction, (x.fractionLen < y.fractionLen) ? x.fractionLen : y.fractionLen);
+        diff = (diff != 0) ? diff : (x.fractionLen > y.fractionLen) - (x.fractionLen < y.fractionLen);
+    }
+
+    diff = (diff > 0) - (diff < 0);
+    return (xSign < 0) ? -diff : diff;
+}
+
+static int compareBytes(const char *a, size_t aLen, const char *b, size_t bLen)
+{
+    int diff = memcmp(a, b, (aLen < bLen) ? aLen : bLen);
+    return (diff != 0) ? diff : (aLen > bLen) - (aLen < bLen);
+}
+
+static int compareLines(const struct SortLine *a, const struct SortLine *b, const struct SortSpec *spec)
+{
+    for (int i = 0; i < spec->numOfKeys; i++)
+
+    {
+        const struct SortKey *key = &spec->keys[i];
+        int diff;
+
+        if (i == 0 && a->prefix != b->prefix)
+
+        {
+            diff = (a->prefix < b->prefix) ? -1 : 1;
+        }
+
+        else
+
+        {
+            const char *aStart, *aEnd, *bStart, *bEnd;
+
+            keyRange(a, key, spec->tab, &aStart, &aEnd);
+            keyRange(b, key, spec->tab, &bStart, &bEnd);
+            diff = key->numeric ? compareNumbers(aStart, aEnd, bStart, bEnd) : compareBytes(aStart, aEnd - aStart, bStart, bEnd - bStart);
+        }
+
+        if (diff != 0)
+
+        {
+            return key->reverse ? -diff : diff;
+        }
+    }
+
+    if (spec->unique) // lines with equal keys are duplicates
+
+    {
+        return 0;
+    }
+
+    int diff = compareBytes(a->text, a->len, b->text, b->len);
+    return spec->reverse ? -diff : diff;
+}
+
+static void setPrefix(struct SortLine *line, const struct SortSpec *spec)
+{
+    const char *start, *end;
+    keyRange(line, &spec->keys[0], spec->tab, &start, &end);
+
+    if (spec->keys[0].numeric)
+
+    {
+        // the integer part, clamped; truncating and clamping keep the order, only equal prefixes need a closer look
+        struct SortNumber num;
+        long long value = 0;
+
+        parseNumber(start, end, &num);
+
+        for (size_t i = 0; i < num.numOfDigits && i < 18; i++)
+
+        {
+            value = value * 10 + (num.digits[i] - '0');
+        }
+
+        value = (num.numOfDigits > 18) ? 999999999999999999LL : value;
+        line->prefix = (uint64_t) (num.negative ? -value : value) ^ (1ULL << 63);
+        return;
+    }
+
+    uint64_t prefix = 0;
+    size_t len = end - start;
+
+    for (size_t i = 0; i < sizeof(prefix); i++)
+
+    {
+        prefix = (prefix << 8) | ((i < len) ? (unsigned char) start[i] : 0);
+    }
+
+    line->prefix = prefix;
+}
+
+static void mergeLines(const struct SortLine *a, size_t aCount, const struct SortLine *b, size_t bCount, struct SortLine *out, const struct SortSpec *spec)
+{
+    size_t i = 0, j = 0, k = 0;
+
+    while (i < aCount && j < bCount)
+
+    {
+        out[k++] = (compareLines(&b[j], &a[i], spec) < 0) ? b[j++] : a[i++]; // ties go to a, which came first
+    }
+
+    memmove(out + k, a + i, (aCount - i) * sizeof(struct SortLine));
+    memmove(out + k + aCount - i, b + j, (bCount - j) * sizeof(struct SortLine)); // may already be in place
+}
+
+static void mergeSort(struct SortLine *lines, struct SortLine *scratch, size_t count, const struct SortSpec *spec)
+{
+    if (count <= INSERTION_SORT_LINES)
+
+    {
+        for (size_t i = 1; i < count; i++)
+
+        {
+            struct SortLine line = lines[i];
+            size_t j = i;
+
+            for (; j > 0 && compareLines(&line, &lines[j - 1], spec) < 0; j--)
+
+            {
+                lines[j] = lines[j - 1];
+            }
+
+            lines[j] = line;
+        }
+
+        return;
+    }
+
+    size_t half = count / 2;
+
+    mergeSort(lines, scratch, half, spec);
+    mergeSort(lines + half, scratch + half, count - half, spec);
+
+    if (compareLines(&lines[half], &lines[half - 1], spec) >= 0)
+
+    {
+        return; // already in order, common for presorted input
+    }
+
+    // the merge reads the right half in place, it is never overwritten before it has been read
+    memcpy(scratch, lines, half * sizeof(struct SortLine));
+    mergeLines(scratch, half, lines + half, count - half, lines, spec);
+}
+
+static void *runSortJob(void *arg)
+{
+    struct SortJob *job = arg;
+
+    if (job->merge)
+
+    {
+        mergeLines(job->from + job->start, job->middle - job->start, job->from + job->middle, job->end - job->middle, job->to + job->start, job->spec);
+        return NULL;
+    }
+
+    for (size_t i = job->start; i < job->end; i++)
+
+    {
+        setPrefix(&job->from[i], job->spec);
+    }
+
+    mergeSort(job->from + job->start, job->to + job->start, job->end - job->start, job->spec);
+    return NULL;
+}
+
+static void runSortJobs(struct SortJob *jobs, int count)
+{
+    pthread_t threads[MAX_SORT_THREADS];
+    bool started[MAX_SORT_THREADS] = {false};
+
+    for (int i = 1; i < count; i++)
+
+    {
+        started[i] = pthread_create(&threads[i], NULL, runSortJob, &jobs[i]) == 0;
+    }
+
+    for (int i = 0; i < count; i++)
+
+    {
+        if (i == 0 || !started[i]) // no thread to be had, the job runs here
+
+        {
+            runSortJob(&jobs[i]);
+        }
+    }
+
+    for (int i = 1; i < count; i++)
+
+    {
+        if (started[i])
+
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static void sortBatch(struct SortLine *lines, size_t count, const struct SortSpec *spec)
+{
+    if (count == 0)
+
+    {
+        return;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int numOfThreads = (count < SORT_PARALLEL_LINES || cores < 2) ? 1 : (cores > MAX_SORT_THREADS) ? MAX_SORT_THREADS : (int) cores;
+    struct SortLine *scratch = malloc(count * sizeof(struct SortLine));
+    struct SortJob jobs[MAX_SORT_THREADS];
+    size_t bounds[MAX_SORT_THREADS + 1];
+
+    // every thread sorts a slice, then neighbouring slices are merged pairwise, half as many merges each round
+    for (int i = 0; i <= numOfThreads; i++)
+
+    {
+        bounds[i] = count * i / numOfThreads;
+    }
+
+    for (int i = 0; i < numOfThreads; i++)
+
+    {
+        jobs[i] = (struct SortJob) {lines, scratch, bounds[i], bounds[i], bounds[i + 1], false, spec};
+    }
+
+    runSortJobs(jobs, numOfThreads);
+
+    struct SortLine *from = lines;
+    struct SortLine *to = scratch;
+
+    for (int width = 1; width < numOfThreads; width *= 2)
+
+    {
+        int numOfJobs = 0;
+
+        for (int i = 0; i < numOfThreads; i += 2 * width)
+
+        {
+            int middle = (i + width < numOfThreads) ? i + width : numOfThreads;
+            int end = (i + 2 * width < numOfThreads) ? i + 2 * width : numOfThreads;
+            jobs[numOfJobs++] = (struct SortJob) {from, to, bounds[i], bounds[middle], bounds[end], true, spec};
+        }
+
+        runSortJobs(jobs, numOfJobs);
+
+        struct SortLine *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != lines)
+
+    {
+        memcpy(lines, from, count * sizeof(struct SortLine));
+    }
+
+    free(scratch);
+}
+
+static void addLine(struct SortBatch *batch, const char *text, size_t len)
+{
+    if (batch->count == batch->cap)
+
+    {
+        batch->cap = batch->cap ? batch->cap * 2 : 1024;
+        batch->lines = realloc(batch->lines, batch->cap * sizeof(struct SortLine));
+    }
+
+    batch->lines[batch->count++] = (struct SortLine) {text, len, 0};
+    batch->bytes += len + 1 + 2 * sizeof(struct SortLine); // the record and its copy in the sort's scratch space
+}
+
+static void emitLine(struct SortSink *sink, const struct SortLine *line, const struct SortSpec *spec)
+{
+    if (spec->unique && sink->hasLast && compareLines(&sink->last, line, spec) == 0)
+
+    {
+        return;
+    }
+
+    sink->last = *line;
+    sink->hasLast = true;
+
+    if (sink->fd < 0)
+
+    {
+        outWriteRef(line->text, line->len);
+        outWrite("\n", 1);
+        return;
+    }
+
+    bufferAppend(&sink->buffer, line->text, line->len);
+    bufferAppend(&sink->buffer, "\n", 1);
+
+    if (sink->buffer.len >= TEXT_BLOCK_SIZE)
+
+    {
+        flushSink(sink);
+    }
+}
+
+static void flushSink(struct SortSink *sink)
+{
+    for (size_t done = 0; done < sink->buffer.len && sink->error == 0; )
+
+    {
+        ssize_t n = write(sink->fd, sink->buffer.data + done, sink->buffer.len - done);
+
+        if (n < 0 && errno != EINTR)
+
+        {
+            sink->error = errno;
+        }
+
+        done += (n > 0) ? n : 0;
+    }
+
+    sink->buffer.len = 0;
+}
+
+static bool spillBatch(struct SortBatch *batch, struct SortRun *runs, int *numOfRuns, const struct SortSpec *spec)
+{
+    struct SortSink sink;
+
+    if (*numOfRuns == MAX_SORT_RUNS) // too many to merge at once, the runs so far become one
+
+    {
+        struct SortRun merged;
+
+        if (!createRun(&merged))
+
+        {
+            return false;
+        }
+
+        memset(&sink, 0, sizeof(sink));
+        sink.fd = merged.fd;
+        mergeRuns(runs, *numOfRuns, NULL, 0, &sink, spec);
+        bool ok = finishRun(&merged, &sink);
+
+        closeRuns(runs, *numOfRuns);
+        runs[0] = merged;
+        *numOfRuns = 1;
+
+        if (!ok)
+
+        {
+            return false;
+        }
+    }
+
+    struct SortRun *run = &runs[*numOfRuns];
+
+    if (!createRun(run))
+
+    {
+        return false;
+    }
+
+    (*numOfRuns)++;
+    sortBatch(batch->lines, batch->count, spec);
+    memset(&sink, 0, sizeof(sink));
+    sink.fd = run->fd;
+
+    for (size_t i = 0; i < batch->count; i++)
+
+    {
+        emitLine(&sink, &batch->lines[i], spec);
+    }
+
+    batch->count = 0;
+    batch->bytes = 0;
+
+    // lines after this one may still point into the block being split, so its copy stays
+    for (int i = 0; i + 1 < batch->numOfChunks; i++)
+
+    {
+        free(batch->chunks[i]);
+    }
+
+    if (batch->numOfChunks > 1)
+
+    {
+        batch->chunks[0] = batch->chunks[batch->numOfChunks - 1];
+        batch->numOfChunks = 1;
+    }
+
+    return finishRun(run, &sink);
+}
+
+static bool createRun(struct SortRun *run)
+{
+    const char *dir = getenv("TMPDIR");
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/shell-sortXXXXXX", (dir != NULL && *dir != '\0') ? dir : "/tmp");
+    memset(run, 0, sizeof(*run));
+    run->fd = mkostemp(path, O_CLOEXEC);
+
+    if (run->fd < 0)
+
+    {
+        fprintf(stderr, "%s: sort: %s: %s\n", shellName, path, strerror(errno));
+        return false;
+    }
+
+    unlink(path); // gone as soon as it is closed, whatever happens to the shell
+    return true;
+}
+
+static bool finishRun(struct SortRun *run, struct SortSink *sink)
+{
+    flushSink(sink);
+    free(sink->buffer.data);
+    sink->buffer.data = NULL;
+
+    off_t len = lseek(run->fd, 0, SEEK_CUR);
+    int error = (sink->error != 0) ? sink->error : (len < 0) ? errno : 0;
+
+    if (error == 0 && len > 0)
+
+    {
+        void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, run->fd, 0);
+        error = (map == MAP_FAILED) ? errno : 0;
+
+        if (map != MAP_FAILED)
+
+        {
+            madvise(map, len, MADV_SEQUENTIAL);
+            run->map = map;
+            run->len = len;
+        }
+    }
+
+    if (error != 0)
+
+    {
+        fprintf(stderr, "%s: sort: write failed: %s\n", shellName, strerror(error));
+        return false;
+    }
+
+    return true;
+}
+
+static void closeRuns(struct SortRun *runs, int numOfRuns)
+{
+    for (int i = 0; i < numOfRuns; i++)
+
+    {
+        if (runs[i].map != NULL)
+
+        {
+            munmap(runs[i].map, runs[i].len);
+        }
+
+        close(runs[i].fd);
+    }
+}
+
+static bool nextMergeLine(struct MergeSource *source, const struct SortSpec *spec)
+{
+    if (source->lines != NULL)
+
+    {
+        if (source->pos == source->count)
+
+        {
+            return false;
+        }
+
+        source->current = source->lines[source->pos++];
+        return true;
+    }
+
+    if (source->pos >= source->len)
+
+    {
+        return false;
+    }
+
+    const char *text = source->data + source->pos;
+    const char *newline = findByte(text, source->len - source->pos, '\n');
+    size_t len = newline ? (size_t) (newline - text) : source->len - source->pos;
+
+    source->current = (struct SortLine) {text, len, 0};
+    source->pos += len + 1;
+    setPrefix(&source->current, spec);
+    return true;
+}
+
+static void siftDown(struct MergeSource *sources, int *heap, int size, int index, const struct SortSpec *spec)
+{
+    while (true)
+
+    {
+        int smallest = index;
+
+        for (int child = 2 * index + 1; child <= 2 * index + 2 && child < size; child++)
+
+        {
+            int diff = compareLines(&sources[heap[child]].current, &sources[heap[smallest]].current, spec);
+
+            if (diff < 0 || (diff == 0 && sources[heap[child]].order < sources[heap[smallest]].order))
+
+            {
+                smallest = child;
+            }
+        }
+
+        if (smallest == index)
+
+        {
+            return;
+        }
+
+        int swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+static bool mergeRuns(struct SortRun *runs, int numOfRuns, struct SortLine *lines, size_t count, struct SortSink *sink, const struct SortSpec *spec)
+{
+    struct MergeSource sources[MAX_SORT_RUNS + 1];
+    int heap[MAX_SORT_RUNS + 1];
+    int size = 0;
+
+    for (int i = 0; i <= numOfRuns; i++)
+
+    {
+        memset(&sources[i], 0, sizeof(sources[i]));
+        sources[i].order = i;
+
+        if (i < numOfRuns)
+
+        {
+            sources[i].data = runs[i].map;
+            sources[i].len = runs[i].len;
+        }
+
+        else
+
+        {
+            sources[i].lines = lines; // the batch still in memory came last
+            sources[i].count = count;
+        }
+
+        if ((i < numOfRuns || lines != NULL) && nextMergeLine(&sources[i], spec))
+
+        {
+            heap[size++] = i;
+        }
+    }
+
+    for (int i = size / 2 - 1; i >= 0; i--)
+
+    {
+        siftDown(sources, heap, size, i, spec);
+    }
+
+    while (size > 0)
+
+    {
+        emitLine(sink, &sources[heap[0]].current, spec);
+
+        if (!nextMergeLine(&sources[heap[0]], spec))
+
+        {
+            heap[0] = heap[--size];
+        }
+
+        siftDown(sources, heap, size, 0, spec);
+    }
+
+    return sink->error == 0;
+}